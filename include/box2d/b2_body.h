@@ -137,6 +137,16 @@ public:
 	/// @warning This function is locked during callbacks.
 	b2Fixture* CreateFixture(const b2FixtureDef* def);
 
+	/// Creates many fixtures at once, for example the static geometry of a level.
+	/// Their broad-phase proxies are built in one batch into a balanced subtree,
+	/// which is faster than calling CreateFixture for each of them.
+	/// The mass is updated once at the end.
+	/// @param defs the fixture definitions.
+	/// @param count the number of fixture definitions.
+	/// @param fixtures optionally receives the created fixtures, in the order of defs.
+	/// @warning This function is locked during callbacks.
+	void CreateFixtures(const b2FixtureDef* defs, int32 count, b2Fixture** fixtures = nullptr);
+
 	/// Creates a fixture from a shape and attach it to this body.
 	/// This is a convenience function. Use b2FixtureDef if you need to set parameters
 	/// like friction, restitution, user data, or filtering.
@@ -423,6 +433,10 @@ private:
 	void SynchronizeFixtures();
 	void SynchronizeTransform();
 
+	// Create the broad-phase proxies of the fixtures from first up to, but not including, last.
+	// Many proxies are created in one batch.
+	void CreateProxies(b2Fixture* first, b2Fixture* last);
+
 	// This is used to prevent connected bodies from colliding.
 	// It may lie, depending on the collideConnected flag.
 	bool ShouldCollide(const b2Body* other) const;
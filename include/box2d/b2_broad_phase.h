@@ -27,6 +27,7 @@
 #include "b2_settings.h"
 #include "b2_collision.h"
 #include "b2_dynamic_tree.h"
+#include "b2_task.h"
 
 struct B2_API b2Pair
 {
@@ -37,6 +38,8 @@ struct B2_API b2Pair
 /// The broad-phase is used for computing pairs and performing volume queries and ray casts.
 /// This broad-phase does not persist pairs. Instead, this reports potentially new pairs.
 /// It is up to the client to consume the new pairs and to track subsequent overlap.
+/// Static proxies are kept in their own tree. They never pair with each other, and
+/// inserting a moving proxy does not rebalance against the static geometry.
 class B2_API b2BroadPhase
 {
 public:
@@ -46,12 +49,23 @@ public:
 		e_nullProxy = -1
 	};
 
+	/// The tree a proxy lives in.
+	enum ProxyType
+	{
+		e_movableProxy = 0,
+		e_staticProxy = 1
+	};
+
 	b2BroadPhase();
 	~b2BroadPhase();
 
 	/// Create a proxy with an initial AABB. Pairs are not reported until
 	/// UpdatePairs is called.
-	int32 CreateProxy(const b2AABB& aabb, void* userData);
+	int32 CreateProxy(const b2AABB& aabb, void* userData, ProxyType type = e_movableProxy);
+
+	/// Create many proxies at once, see b2DynamicTree::CreateProxies.
+	/// Pairs are not reported until UpdatePairs is called.
+	void CreateProxies(const b2TreeProxyDef* defs, int32 count, int32* proxyIds, ProxyType type = e_movableProxy);
 
 	/// Destroy a proxy. It is up to the client to remove any pairs.
 	void DestroyProxy(int32 proxyId);
@@ -76,9 +90,14 @@ public:
 	int32 GetProxyCount() const;
 
 	/// Update the pairs. This results in pair callbacks. This can only add pairs.
+	/// With a task executor the tree queries run in parallel, but the pairs and their
+	/// order are the same and the callbacks are still made on the calling thread.
 	template <typename T>
 	void UpdatePairs(T* callback);
 
+	/// Run the tree queries of UpdatePairs on an executor. Pass nullptr to query serially.
+	void SetTaskExecutor(b2TaskExecutor* executor);
+
 	/// Query an AABB for overlapping proxies. The callback class
 	/// is called for each proxy that overlaps the supplied AABB.
 	template <typename T>
@@ -94,15 +113,24 @@ public:
 	template <typename T>
 	void RayCast(T* callback, const b2RayCastInput& input) const;
 
-	/// Get the height of the embedded tree.
+	/// Get the height of the taller of the two trees.
 	int32 GetTreeHeight() const;
 
-	/// Get the balance of the embedded tree.
+	/// Get the worse balance of the two trees.
 	int32 GetTreeBalance() const;
 
-	/// Get the quality metric of the embedded tree.
+	/// Get the worse quality metric of the two trees.
 	float GetTreeQuality() const;
 
+	/// Rebuild the static tree top-down, keeping the proxy ids. UpdatePairs does this
+	/// by itself once many static proxies were inserted one at a time.
+	void RebuildStaticTree();
+
+	/// Spend a bounded amount of work on the quality of the movable tree.
+	/// See b2DynamicTree::Optimize.
+	/// @return the number of leaves partitioned.
+	int32 Optimize(int32 nodeBudget);
+
 	/// Shift the world origin. Useful for large worlds.
 	/// The shift formula is: position -= newOrigin
 	/// @param newOrigin the new origin with respect to the old origin
@@ -110,16 +138,48 @@ public:
 
 private:
 
-	friend class b2DynamicTree;
+	friend class b2PairTask;
+
+	/// Pairs found for one slice of the move buffer.
+	struct PairBuffer
+	{
+		b2Pair* pairs;
+		int32 capacity;
+		int32 count;
+	};
+
+	/// Proxy ids keep the tree in the low bit and the tree node above it.
+	static int32 GetProxyId(int32 nodeId, int32 type)
+	{
+		return (nodeId << 1) | type;
+	}
+
+	static int32 GetNodeId(int32 proxyId)
+	{
+		return proxyId >> 1;
+	}
+
+	const b2DynamicTree& GetTree(int32 proxyId) const
+	{
+		return m_trees[proxyId & 1];
+	}
 
 	void BufferMove(int32 proxyId);
 	void UnBufferMove(int32 proxyId);
 
-	bool QueryCallback(int32 proxyId);
+	/// Find the pairs of the moved proxies in [begin, end) and append them to buffer.
+	void FindPairs(int32 begin, int32 end, PairBuffer* buffer) const;
+
+	/// Fill the pair buffer, using the task executor if there is one.
+	void FindNewPairs();
 
-	b2DynamicTree m_tree;
+	b2DynamicTree m_trees[2];	// indexed by ProxyType
 
 	int32 m_proxyCount;
+	int32 m_staticProxyCount;
+
+	// Static proxies inserted one at a time since the static tree was last built.
+	int32 m_staticInsertCount;
 
 	int32* m_moveBuffer;
 	int32 m_moveCapacity;
@@ -129,24 +189,26 @@ private:
 	int32 m_pairCapacity;
 	int32 m_pairCount;
 
-	int32 m_queryProxyId;
+	b2TaskExecutor* m_taskExecutor;
+	PairBuffer* m_partBuffers;
+	int32 m_partCapacity;
 };
 
 inline void* b2BroadPhase::GetUserData(int32 proxyId) const
 {
-	return m_tree.GetUserData(proxyId);
+	return GetTree(proxyId).GetUserData(GetNodeId(proxyId));
 }
 
 inline bool b2BroadPhase::TestOverlap(int32 proxyIdA, int32 proxyIdB) const
 {
-	const b2AABB& aabbA = m_tree.GetFatAABB(proxyIdA);
-	const b2AABB& aabbB = m_tree.GetFatAABB(proxyIdB);
+	const b2AABB& aabbA = GetFatAABB(proxyIdA);
+	const b2AABB& aabbB = GetFatAABB(proxyIdB);
 	return b2TestOverlap(aabbA, aabbB);
 }
 
 inline const b2AABB& b2BroadPhase::GetFatAABB(int32 proxyId) const
 {
-	return m_tree.GetFatAABB(proxyId);
+	return GetTree(proxyId).GetFatAABB(GetNodeId(proxyId));
 }
 
 inline int32 b2BroadPhase::GetProxyCount() const
@@ -156,48 +218,31 @@ inline int32 b2BroadPhase::GetProxyCount() const
 
 inline int32 b2BroadPhase::GetTreeHeight() const
 {
-	return m_tree.GetHeight();
+	return b2Max(m_trees[e_movableProxy].GetHeight(), m_trees[e_staticProxy].GetHeight());
 }
 
 inline int32 b2BroadPhase::GetTreeBalance() const
 {
-	return m_tree.GetMaxBalance();
+	return b2Max(m_trees[e_movableProxy].GetMaxBalance(), m_trees[e_staticProxy].GetMaxBalance());
 }
 
 inline float b2BroadPhase::GetTreeQuality() const
 {
-	return m_tree.GetAreaRatio();
+	return b2Max(m_trees[e_movableProxy].GetAreaRatio(), m_trees[e_staticProxy].GetAreaRatio());
 }
 
 template <typename T>
 void b2BroadPhase::UpdatePairs(T* callback)
 {
-	// Reset pair buffer
-	m_pairCount = 0;
-
 	// Perform tree queries for all moving proxies.
-	for (int32 i = 0; i < m_moveCount; ++i)
-	{
-		m_queryProxyId = m_moveBuffer[i];
-		if (m_queryProxyId == e_nullProxy)
-		{
-			continue;
-		}
-
-		// We have to query the tree with the fat AABB so that
-		// we don't fail to create a pair that may touch later.
-		const b2AABB& fatAABB = m_tree.GetFatAABB(m_queryProxyId);
-
-		// Query tree, create pairs and add them pair buffer.
-		m_tree.Query(this, fatAABB);
-	}
+	FindNewPairs();
 
 	// Send pairs to caller
 	for (int32 i = 0; i < m_pairCount; ++i)
 	{
 		b2Pair* primaryPair = m_pairBuffer + i;
-		void* userDataA = m_tree.GetUserData(primaryPair->proxyIdA);
-		void* userDataB = m_tree.GetUserData(primaryPair->proxyIdB);
+		void* userDataA = GetUserData(primaryPair->proxyIdA);
+		void* userDataB = GetUserData(primaryPair->proxyIdB);
 
 		callback->AddPair(userDataA, userDataB);
 	}
@@ -211,7 +256,7 @@ void b2BroadPhase::UpdatePairs(T* callback)
 			continue;
 		}
 
-		m_tree.ClearMoved(proxyId);
+		m_trees[proxyId & 1].ClearMoved(GetNodeId(proxyId));
 	}
 
 	// Reset move buffer
@@ -221,18 +266,72 @@ void b2BroadPhase::UpdatePairs(T* callback)
 template <typename T>
 inline void b2BroadPhase::Query(T* callback, const b2AABB& aabb) const
 {
-	m_tree.Query(callback, aabb);
+	// Report proxy ids rather than the node ids of each tree.
+	struct TreeQuery
+	{
+		bool QueryCallback(int32 nodeId)
+		{
+			proceed = callback->QueryCallback(GetProxyId(nodeId, type));
+			return proceed;
+		}
+
+		T* callback;
+		int32 type;
+		bool proceed;
+	};
+
+	TreeQuery query = { callback, e_movableProxy, true };
+	m_trees[e_movableProxy].Query(&query, aabb);
+
+	if (query.proceed)
+	{
+		query.type = e_staticProxy;
+		m_trees[e_staticProxy].Query(&query, aabb);
+	}
 }
 
 template <typename T>
 inline void b2BroadPhase::RayCast(T* callback, const b2RayCastInput& input) const
 {
-	m_tree.RayCast(callback, input);
+	// Report proxy ids and carry the clipped ray over to the second tree.
+	struct TreeRayCast
+	{
+		float RayCastCallback(const b2RayCastInput& subInput, int32 nodeId)
+		{
+			float value = callback->RayCastCallback(subInput, GetProxyId(nodeId, type));
+			if (value == 0.0f)
+			{
+				terminated = true;
+			}
+			else if (value > 0.0f)
+			{
+				maxFraction = value;
+			}
+			return value;
+		}
+
+		T* callback;
+		int32 type;
+		float maxFraction;
+		bool terminated;
+	};
+
+	TreeRayCast rayCast = { callback, e_movableProxy, input.maxFraction, false };
+	m_trees[e_movableProxy].RayCast(&rayCast, input);
+
+	if (rayCast.terminated == false)
+	{
+		b2RayCastInput subInput = input;
+		subInput.maxFraction = rayCast.maxFraction;
+		rayCast.type = e_staticProxy;
+		m_trees[e_staticProxy].RayCast(&rayCast, subInput);
+	}
 }
 
 inline void b2BroadPhase::ShiftOrigin(const b2Vec2& newOrigin)
 {
-	m_tree.ShiftOrigin(newOrigin);
+	m_trees[e_movableProxy].ShiftOrigin(newOrigin);
+	m_trees[e_staticProxy].ShiftOrigin(newOrigin);
 }
 
 #endif
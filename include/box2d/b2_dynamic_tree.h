@@ -26,10 +26,14 @@
 #include "b2_api.h"
 #include "b2_collision.h"
 #include "b2_growable_stack.h"
+#include <float.h>
 #include <vector>
 
 #define b2_nullNode (-1)
 
+/// From about this many proxies b2DynamicTree::CreateProxies beats repeated CreateProxy.
+#define b2_minBulkProxyCount 16
+
 /// A node in the dynamic tree. The client does not interact with this directly.
 struct B2_API b2TreeNode
 {
@@ -55,9 +59,46 @@ struct B2_API b2TreeNode
 	// leaf = 0, free node = -1
 	int32 height;
 
+	/// Leaf: the proxy category bits. Internal node: union of the category bits below it.
+	uint16 categoryBits;
+
 	bool moved;
 };
 
+/// A proxy to create with b2DynamicTree::CreateProxies.
+struct B2_API b2TreeProxyDef
+{
+	/// Tight fitting AABB, fattened like in b2DynamicTree::CreateProxy.
+	b2AABB aabb;
+
+	void* userData = nullptr;
+
+	uint16 categoryBits = 0xFFFF;
+};
+
+/// A node of the 4-wide copy of the tree built by b2DynamicTree::BuildWideNodes.
+/// The child boxes are stored per component so that one SIMD compare tests all four.
+/// Unused lanes hold an empty box that never overlaps anything.
+struct B2_API b2WideNode
+{
+	float lowerX[4];
+	float lowerY[4];
+	float upperX[4];
+	float upperY[4];
+
+	/// Index of a child wide node, or ~proxyId for a leaf.
+	int32 child[4];
+
+	uint16 categoryBits[4];
+};
+
+/// Get a bit per lane of node whose box overlaps aabb.
+B2_API int32 b2WideOverlap(const b2WideNode& node, const b2AABB& aabb);
+
+/// Get a bit per lane of node whose box is not separated from the segment through p1
+/// along the axis v. This is the separating axis test of b2DynamicTree::RayCast.
+B2_API int32 b2WideSegmentAxis(const b2WideNode& node, const b2Vec2& p1, const b2Vec2& v, const b2Vec2& abs_v);
+
 struct b2QueryVectorCallback
 {
 
@@ -72,15 +113,17 @@ struct b2QueryVectorCallback
 		return true;
 	}
 
-	float RayCastCallback(b2RayCastInput& input, int32 nodeId)
+	float RayCastCallback(const b2RayCastInput& input, int32 nodeId)
 	{
 		m_lst.push_back(nodeId);
-		return 0.1f;	// get all objects overlapping with the ray
+		return input.maxFraction;	// don't clip the ray to get all objects overlapping with the ray
 	}
 
 	std::vector<int32>& m_lst;
 };
 
+struct b2BuildLeaf;
+
 /// A dynamic AABB tree broad-phase, inspired by Nathanael Presson's btDbvt.
 /// A dynamic tree arranges data in a binary tree to accelerate
 /// queries such as volume queries and ray casts. Leafs are proxies
@@ -99,7 +142,15 @@ public:
 	~b2DynamicTree();
 
 	/// Create a proxy. Provide a tight fitting AABB and a userData pointer.
-	int32 CreateProxy(const b2AABB& aabb, void* userData);
+	/// The category bits let queries skip subtrees that cannot pass their mask.
+	int32 CreateProxy(const b2AABB& aabb, void* userData, uint16 categoryBits = 0xFFFF);
+
+	/// Create many proxies at once. The new proxies are built into a subtree top-down with a
+	/// binned surface area heuristic in O(n log n), which is faster than repeated CreateProxy
+	/// and gives a better tree. The subtree is then inserted as a whole, so this works best
+	/// for an empty tree or for proxies away from the existing ones, like a level being loaded.
+	/// @param proxyIds receives the id of each proxy, in the order of defs.
+	void CreateProxies(const b2TreeProxyDef* defs, int32 count, int32* proxyIds);
 
 	/// Destroy a proxy. This asserts if the id is invalid.
 	void DestroyProxy(int32 proxyId);
@@ -110,6 +161,10 @@ public:
 	/// @return true if the proxy was re-inserted.
 	bool MoveProxy(int32 proxyId, const b2AABB& aabb1, const b2Vec2& displacement);
 
+	/// Check if MoveProxy with the same arguments would leave the tree unchanged.
+	/// This does not modify the tree, so it can run under a shared lock.
+	bool IsProxyFit(int32 proxyId, const b2AABB& aabb, const b2Vec2& displacement) const;
+
 	/// Get proxy user data.
 	/// @return the proxy user data or 0 if the id is invalid.
 	void* GetUserData(int32 proxyId) const;
@@ -120,10 +175,20 @@ public:
 	/// Get the fat AABB for a proxy.
 	const b2AABB& GetFatAABB(int32 proxyId) const;
 
+	/// Get the root node index or b2_nullNode if the tree is empty.
+	int32 GetRoot() const;
+
+	/// Get a node for read-only traversal, for example to build a flat copy of the tree.
+	const b2TreeNode& GetNode(int32 nodeId) const;
+
+	/// Get the number of allocated nodes, used or free.
+	int32 GetNodeCapacity() const;
+
 	/// Query an AABB for overlapping proxies. The callback class
 	/// is called for each proxy that overlaps the supplied AABB.
+	/// Subtrees without any category in maskBits are skipped.
 	template <typename T>
-	void Query(T* callback, const b2AABB& aabb) const;
+	void Query(T* callback, const b2AABB& aabb, uint16 maskBits = 0xFFFF) const;
 
 	/// Ray-cast against the proxies in the tree. This relies on the callback
 	/// to perform a exact ray-cast in the case were the proxy contains a shape.
@@ -132,14 +197,15 @@ public:
 	/// number of proxies in the tree.
 	/// @param input the ray-cast input data. The ray extends from p1 to p1 + maxFraction * (p2 - p1).
 	/// @param callback a callback class that is called for each proxy that is hit by the ray.
+	/// @param maskBits subtrees without any category in maskBits are skipped.
 	template <typename T>
-	void RayCast(T* callback, const b2RayCastInput& input) const;
+	void RayCast(T* callback, const b2RayCastInput& input, uint16 maskBits = 0xFFFF) const;
 
 	// Query nodes and put the result into lst
-	int Query(const b2AABB& aabb, std::vector<int32>& lst) const;
+	int Query(const b2AABB& aabb, std::vector<int32>& lst, uint16 maskBits = 0xFFFF) const;
 
 	// RayCast nodes and put the result into lst
-	int RayCast(const b2RayCastInput& input, std::vector<int32>& lst) const;
+	int RayCast(const b2RayCastInput& input, std::vector<int32>& lst, uint16 maskBits = 0xFFFF) const;
 
 	/// Validate this tree. For testing.
 	void Validate() const;
@@ -158,6 +224,38 @@ public:
 	/// Build an optimal tree. Very expensive. For testing.
 	void RebuildBottomUp();
 
+	/// Rebuild the internal nodes top-down like CreateProxies does. Proxy ids are unchanged.
+	/// This is O(n log n), cheap enough for a tree that changes rarely.
+	void RebuildTopDown();
+
+	/// Spend a bounded amount of work on the tree quality. Once enough leaves have been
+	/// reinserted, this starts a top-down rebuild like RebuildTopDown over a snapshot of
+	/// the leaf boxes and partitions a little more of it on every call. When the partition
+	/// is done the new tree replaces the old one and is refit to the current boxes.
+	/// Leaves created or destroyed in the meantime are handled. Starting and finishing
+	/// a rebuild each cost one pass over the nodes. A tree that does not change is left
+	/// alone. Proxy ids are unchanged.
+	/// @param nodeBudget about how many leaves to partition per call.
+	/// @return the number of leaves partitioned.
+	int32 Optimize(int32 nodeBudget);
+
+	/// Build a 4-wide copy of the tree with SoA child boxes. Query and RayCast
+	/// use it until the tree next changes, so this pays off when the tree is
+	/// queried many times between updates. Proxy ids are unchanged.
+	/// The order in which proxies are reported differs from the binary tree.
+	void BuildWideNodes();
+
+	/// Check if Query and RayCast currently use the wide nodes.
+	bool HasWideNodes() const;
+
+	/// Go back to querying the binary nodes. The wide nodes memory is kept for the next build.
+	void ClearWideNodes();
+
+	/// Replace the tree with a copy of nodes, for example loaded from a file.
+	/// Nodes [0, nodeCount) must form one tree rooted at root with valid parent links.
+	/// Proxy ids become the node indices.
+	void Restore(const b2TreeNode* nodes, int32 nodeCount, int32 root);
+
 	/// Shift the world origin. Useful for large worlds.
 	/// The shift formula is: position -= newOrigin
 	/// @param newOrigin the new origin with respect to the old origin
@@ -173,12 +271,23 @@ private:
 
 	int32 Balance(int32 index);
 
+	int32 BuildTopDown(const int32* leafIds, int32 count);
+
+	void CancelRebuild();
+	void FinishRebuild();
+
 	int32 ComputeHeight() const;
 	int32 ComputeHeight(int32 nodeId) const;
 
 	void ValidateStructure(int32 index) const;
 	void ValidateMetrics(int32 index) const;
 
+	template <typename T>
+	void QueryWide(T* callback, const b2AABB& aabb, uint16 maskBits) const;
+
+	template <typename T>
+	void RayCastWide(T* callback, const b2RayCastInput& input, uint16 maskBits) const;
+
 	int32 m_root;
 
 	b2TreeNode* m_nodes;
@@ -188,6 +297,23 @@ private:
 	int32 m_freeList;
 
 	int32 m_insertionCount;
+
+	// Insertions since the tree was last built top-down.
+	int32 m_optimizeDebt;
+
+	// Rebuild in progress in Optimize. The splits are recorded parents first and
+	// the ranges still to split are kept on a stack.
+	b2BuildLeaf* m_rebuildLeaves;
+	int32 m_rebuildLeafCount;
+	int32* m_rebuildSplits;
+	int32 m_rebuildSplitCount;
+	int32* m_rebuildRanges;
+	int32 m_rebuildRangeCount;
+
+	// Wide copy of the tree. Node 0 holds the children of the root.
+	b2WideNode* m_wideNodes;
+	int32 m_wideCapacity;
+	bool m_wideValid;
 };
 
 inline void* b2DynamicTree::GetUserData(int32 proxyId) const
@@ -214,9 +340,41 @@ inline const b2AABB& b2DynamicTree::GetFatAABB(int32 proxyId) const
 	return m_nodes[proxyId].aabb;
 }
 
+inline int32 b2DynamicTree::GetRoot() const
+{
+	return m_root;
+}
+
+inline const b2TreeNode& b2DynamicTree::GetNode(int32 nodeId) const
+{
+	b2Assert(0 <= nodeId && nodeId < m_nodeCapacity);
+	return m_nodes[nodeId];
+}
+
+inline int32 b2DynamicTree::GetNodeCapacity() const
+{
+	return m_nodeCapacity;
+}
+
+inline bool b2DynamicTree::HasWideNodes() const
+{
+	return m_wideValid;
+}
+
+inline void b2DynamicTree::ClearWideNodes()
+{
+	m_wideValid = false;
+}
+
 template <typename T>
-inline void b2DynamicTree::Query(T* callback, const b2AABB& aabb) const
+inline void b2DynamicTree::Query(T* callback, const b2AABB& aabb, uint16 maskBits) const
 {
+	if (m_wideValid)
+	{
+		QueryWide(callback, aabb, maskBits);
+		return;
+	}
+
 	b2GrowableStack<int32, 256> stack;
 	stack.Push(m_root);
 
@@ -230,7 +388,7 @@ inline void b2DynamicTree::Query(T* callback, const b2AABB& aabb) const
 
 		const b2TreeNode* node = m_nodes + nodeId;
 
-		if (b2TestOverlap(node->aabb, aabb))
+		if ((node->categoryBits & maskBits) != 0 && b2TestOverlap(node->aabb, aabb))
 		{
 			if (node->IsLeaf())
 			{
@@ -250,8 +408,14 @@ inline void b2DynamicTree::Query(T* callback, const b2AABB& aabb) const
 }
 
 template <typename T>
-inline void b2DynamicTree::RayCast(T* callback, const b2RayCastInput& input) const
+inline void b2DynamicTree::RayCast(T* callback, const b2RayCastInput& input, uint16 maskBits) const
 {
+	if (m_wideValid)
+	{
+		RayCastWide(callback, input, maskBits);
+		return;
+	}
+
 	b2Vec2 p1 = input.p1;
 	b2Vec2 p2 = input.p2;
 	b2Vec2 r = p2 - p1;
@@ -288,6 +452,11 @@ inline void b2DynamicTree::RayCast(T* callback, const b2RayCastInput& input) con
 
 		const b2TreeNode* node = m_nodes + nodeId;
 
+		if ((node->categoryBits & maskBits) == 0)
+		{
+			continue;
+		}
+
 		if (b2TestOverlap(node->aabb, segmentAABB) == false)
 		{
 			continue;
@@ -335,17 +504,147 @@ inline void b2DynamicTree::RayCast(T* callback, const b2RayCastInput& input) con
 	}
 }
 
-inline int b2DynamicTree::Query(const b2AABB& aabb, std::vector<int32>& lst) const
+template <typename T>
+inline void b2DynamicTree::QueryWide(T* callback, const b2AABB& aabb, uint16 maskBits) const
+{
+	if (m_root == b2_nullNode)
+	{
+		return;
+	}
+
+	b2GrowableStack<int32, 256> stack;
+	stack.Push(0);
+
+	while (stack.GetCount() > 0)
+	{
+		const b2WideNode* node = m_wideNodes + stack.Pop();
+
+		int32 mask = b2WideOverlap(*node, aabb);
+
+		for (int32 i = 0; i < 4; ++i)
+		{
+			if ((mask & (1 << i)) == 0 || (node->categoryBits[i] & maskBits) == 0)
+			{
+				continue;
+			}
+
+			int32 child = node->child[i];
+			if (child < 0)
+			{
+				bool proceed = callback->QueryCallback(~child);
+				if (proceed == false)
+				{
+					return;
+				}
+			}
+			else
+			{
+				stack.Push(child);
+			}
+		}
+	}
+}
+
+template <typename T>
+inline void b2DynamicTree::RayCastWide(T* callback, const b2RayCastInput& input, uint16 maskBits) const
+{
+	if (m_root == b2_nullNode)
+	{
+		return;
+	}
+
+	b2Vec2 p1 = input.p1;
+	b2Vec2 p2 = input.p2;
+	b2Vec2 r = p2 - p1;
+	b2Assert(r.LengthSquared() > 0.0f);
+	r.Normalize();
+
+	// v is perpendicular to the segment.
+	b2Vec2 v = b2Cross(1.0f, r);
+	b2Vec2 abs_v = b2Abs(v);
+
+	float maxFraction = input.maxFraction;
+
+	b2AABB segmentAABB;
+	{
+		b2Vec2 t = p1 + maxFraction * (p2 - p1);
+		segmentAABB.lowerBound = b2Min(p1, t);
+		segmentAABB.upperBound = b2Max(p1, t);
+	}
+
+	b2GrowableStack<int32, 256> stack;
+	stack.Push(0);
+
+	while (stack.GetCount() > 0)
+	{
+		const b2WideNode* node = m_wideNodes + stack.Pop();
+
+		int32 mask = b2WideOverlap(*node, segmentAABB) & b2WideSegmentAxis(*node, p1, v, abs_v);
+		bool clipped = false;
+
+		for (int32 i = 0; i < 4; ++i)
+		{
+			if ((mask & (1 << i)) == 0 || (node->categoryBits[i] & maskBits) == 0)
+			{
+				continue;
+			}
+
+			// A hit in an earlier lane may have shortened the segment.
+			if (clipped)
+			{
+				b2AABB box;
+				box.lowerBound.Set(node->lowerX[i], node->lowerY[i]);
+				box.upperBound.Set(node->upperX[i], node->upperY[i]);
+				if (b2TestOverlap(box, segmentAABB) == false)
+				{
+					continue;
+				}
+			}
+
+			int32 child = node->child[i];
+			if (child >= 0)
+			{
+				stack.Push(child);
+				continue;
+			}
+
+			b2RayCastInput subInput;
+			subInput.p1 = input.p1;
+			subInput.p2 = input.p2;
+			subInput.maxFraction = maxFraction;
+
+			float value = callback->RayCastCallback(subInput, ~child);
+
+			if (value == 0.0f)
+			{
+				// The client has terminated the ray cast.
+				return;
+			}
+
+			if (value > 0.0f)
+			{
+				// Update segment bounding box.
+				maxFraction = value;
+				b2Vec2 t = p1 + maxFraction * (p2 - p1);
+				segmentAABB.lowerBound = b2Min(p1, t);
+				segmentAABB.upperBound = b2Max(p1, t);
+				clipped = true;
+			}
+		}
+	}
+}
+
+inline int b2DynamicTree::Query(const b2AABB& aabb, std::vector<int32>& lst, uint16 maskBits) const
 {
 	b2QueryVectorCallback cb(lst);
-	Query(&cb, aabb);
+	Query(&cb, aabb, maskBits);
 	return static_cast<int>(lst.size());
 }
 
-inline int b2DynamicTree::RayCast(const b2RayCastInput& input, std::vector<int32>& lst) const
+inline int b2DynamicTree::RayCast(const b2RayCastInput& input, std::vector<int32>& lst, uint16 maskBits) const
 {
 	b2QueryVectorCallback cb(lst);
-	RayCast(&cb, input);
+	RayCast(&cb, input, maskBits);
 	return static_cast<int>(lst.size());
 }
 
@@ -32,6 +32,7 @@ class b2BlockAllocator;
 class b2Body;
 class b2BroadPhase;
 class b2Fixture;
+struct b2TreeProxyDef;
 
 /// This holds contact filtering data.
 struct B2_API b2Filter
@@ -227,6 +228,9 @@ protected:
 	void CreateProxies(b2BroadPhase* broadPhase, const b2Transform& xf);
 	void DestroyProxies(b2BroadPhase* broadPhase);
 
+	// Fill the proxies and their definitions for b2BroadPhase::CreateProxies. Returns the proxy count.
+	int32 InitProxies(const b2Transform& xf, b2TreeProxyDef* defs);
+
 	void Synchronize(b2BroadPhase* broadPhase, const b2Transform& xf1, const b2Transform& xf2);
 
 	float m_density;
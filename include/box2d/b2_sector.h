@@ -8,11 +8,109 @@
 #include "b2_collision.h"
 #include "b2_dynamic_tree.h"
 #include <rx/lock/lock_guards.hpp>
+#include <atomic>
+#include <chrono>
 #include <cstddef>
+#include <cstdint>
+#include <optional>
 
-using b2ObjectId = int;
+// Ʈ ڵ.  32Ʈ  ε,  32Ʈ  
+/**
+ * Despawnϸ  밡 ٲǷ  ڵδ  Ʈ ã Ѵ. 
+ *  0 ƴϹǷ 0 ߸ ڵ̴.
+ */
+using b2ObjectId = uint64_t;
+
+constexpr b2ObjectId b2_nullObjectId = 0;
+
+inline b2ObjectId b2MakeObjectId(uint32 index, uint32 generation)
+{
+  return (static_cast<b2ObjectId>(generation) << 32) | index;
+}
+
+inline uint32 b2GetObjectIndex(b2ObjectId oid)
+{
+  return static_cast<uint32>(oid);
+}
+
+inline uint32 b2GetObjectGeneration(b2ObjectId oid)
+{
+  return static_cast<uint32>(oid >> 32);
+}
 
 class b2Sector;
+class b2SectorObject;
+
+// b2SectorGrid   ܰ (useFramePhases)
+enum class b2SectorPhase
+{
+  Idle,     // ܰ .  ȣ  ´
+  Write,    // Spawn, Despawn, Move ȣѴ
+  Read      //  ȣѴ. ƹ͵ ٲ Ƿ   ʴ´
+};
+
+//  ε  [ix0, ix1] x [iy0, iy1]. ix0 > ix1 ̸  
+struct b2SectorRange
+{
+  int ix0;
+  int iy0;
+  int ix1;
+  int iy1;
+
+  bool Contains(int ix, int iy) const
+  {
+    return ix0 <= ix && ix <= ix1 && iy0 <= iy && iy <= iy1;
+  }
+
+  bool operator==(const b2SectorRange& other) const
+  {
+    return ix0 == other.ix0 && iy0 == other.iy0 && ix1 == other.ix1 && iy1 == other.iy1;
+  }
+};
+
+// b2Sector::ApplyProxyOps    ϴ Ͻ 
+struct b2SectorProxyOp
+{
+  enum Type
+  {
+    Destroy,
+    Move,
+    Create
+  };
+
+  b2Sector* sector;
+  Type type;
+  int32 proxyId;            // Destroy, Move 
+  b2AABB aabb;              // Move, Create 
+  b2SectorObject* object;   // Create  Ͻø attach 
+};
+
+//  Ʈ ϴ Һ shape. b2SectorGrid::RegisterShapeTemplate 
+struct b2SectorShapeTemplate
+{
+  // tf shape AABB.  AABB ȸϿ ιǷ ȸϸ ComputeAABB  Ŭ  ִ.
+  void ComputeAABB(b2AABB* aabb, const b2Transform& tf) const
+  {
+    b2Vec2 c = b2Mul(tf, localAABB.GetCenter());
+    b2Vec2 h = localAABB.GetExtents();
+
+    //  ȸص AABB .
+    if (shape->m_type != b2Shape::e_circle)
+    {
+      h.Set(
+        b2Abs(tf.q.c) * h.x + b2Abs(tf.q.s) * h.y,
+        b2Abs(tf.q.s) * h.x + b2Abs(tf.q.c) * h.y);
+    }
+
+    aabb->lowerBound = c - h;
+    aabb->upperBound = c + h;
+  }
+
+  b2Shape* shape;       // ׸ Ǯ  shape
+  b2AABB localAABB;     // ȸ    shape AABB
+  float radius;         //  ߽ ȸ shape    
+  int level;            // ø  Ʈ  
+};
 
 // b2SectorGrid ο ϰ b2DynamicTree Proxy Ͽ 
 //   ְ ϴ Ʈ
@@ -27,6 +125,16 @@ public:
     bool attached;
   };
 
+  // shape ϴ 
+  enum ShapeStorage
+  {
+    e_ownedShape,     // Ҹڿ delete
+    e_pooledShape,    // b2SectorGrid Ǯ ȯ
+    e_sharedShape     // b2SectorShapeTemplate shape. ø Բ 
+  };
+
+  static constexpr int MaxProxyCount = 4;
+
 public: 
   // 
   /** 
@@ -35,25 +143,36 @@ public:
    * @param filter - 浹  
    * @param tf - ȯ 
    * @param userData - ø̼ǿ  .   
+   * @param storage - shape ϴ 
+   * @param shapeTemplate - e_sharedShape  shape  ø
    */
   b2SectorObject(
     b2ObjectId oid, b2Shape* shape, const b2Filter& filter,
-    const b2Transform& tf, void* userData)
+    const b2Transform& tf, void* userData, 
+    ShapeStorage storage = e_ownedShape, const b2SectorShapeTemplate* shapeTemplate = nullptr)
     : m_objectId(oid)
     , m_shape(shape)
+    , m_shapeStorage(storage)
+    , m_shapeTemplate(shapeTemplate)
     , m_filter(filter)
     , m_transform(tf)
     , m_userData(userData)
+    , m_level(0)
+    , m_range{ 0, 0, -1, -1 }
     , m_proxyCount(0)
     , m_proxies()
   {
     b2Assert(m_shape);
     b2Assert(m_userData);
+    b2Assert((m_shapeStorage == e_sharedShape) == (m_shapeTemplate != nullptr));
   }
 
   ~b2SectorObject()
   {
-    delete m_shape;
+    if (m_shapeStorage == e_ownedShape)
+    {
+      delete m_shape;
+    }
   }
 
   b2ObjectId GetObjectId() const 
@@ -61,11 +180,39 @@ public:
     return m_objectId;
   }
 
+  // b2SectorGrid  Ҵ  
+  void SetObjectId(b2ObjectId oid)
+  {
+    m_objectId = oid;
+  }
+
   const b2Shape* GetShape() const
   {
     return m_shape;
   }
 
+  ShapeStorage GetShapeStorage() const
+  {
+    return m_shapeStorage;
+  }
+
+  const b2SectorShapeTemplate* GetShapeTemplate() const
+  {
+    return m_shapeTemplate;
+  }
+
+  // tf shape AABB. ø ϸ ComputeAABB  ĳ  AABB ȯѴ.
+  void ComputeAABB(b2AABB* aabb, const b2Transform& tf) const
+  {
+    if (m_shapeTemplate)
+    {
+      m_shapeTemplate->ComputeAABB(aabb, tf);
+      return;
+    }
+
+    m_shape->ComputeAABB(aabb, tf, 0);
+  }
+
   const b2Filter& GetFilter() const
   {
     return m_filter;
@@ -93,11 +240,44 @@ public:
     m_transform = tf;
   }
 
+  // b2SectorGrid Ʈ  
+  int GetLevel() const
+  {
+    return m_level;
+  }
+
+  void SetLevel(int level)
+  {
+    m_level = level;
+  }
+
+  // Ͻð ִ ͵ ε .   Ϳ Ͻð ִ.
+  const b2SectorRange& GetRange() const
+  {
+    return m_range;
+  }
+
+  void SetRange(const b2SectorRange& range)
+  {
+    m_range = range;
+  }
+
+  //  Ͻð Ʈ  AABB.  ȿ ̸ Ʈ  ʴ´.
+  const b2AABB& GetFatAABB() const
+  {
+    return m_fatAABB;
+  }
+
+  void SetFatAABB(const b2AABB& fatAABB)
+  {
+    m_fatAABB = fatAABB;
+  }
+
   // b2DynamicTree proxy 
   bool AttachProxy(b2Sector* sector, int proxyId)
   {
     b2Assert(sector);
-    b2Assert(0 <= m_proxyCount && m_proxyCount <= 4);
+    b2Assert(0 <= m_proxyCount && m_proxyCount <= MaxProxyCount);
 
     for ( auto& proxy : m_proxies )
     { 
@@ -120,6 +300,21 @@ public:
   // attach   Ϳ 
   void DetachProxyAll();
 
+  // sector 
+  void DetachProxy(b2Sector* sector);
+
+  // sector  Ʈ  Ͻø ops ߰
+  /**
+   * Ʈ  ȣ ʿ b2Sector::ApplyProxyOps Ƽ óѴ.
+   */
+  void DetachProxy(b2Sector* sector, std::vector<b2SectorProxyOp>& ops);
+
+  // attach   Ϳ Ͻø aabb ̵
+  void MoveProxyAll(const b2AABB& aabb, const b2Vec2& displacement);
+
+  // Ʈ   ̵ attach  ͵ ̵  
+  void CountProxyMoves();
+
   int GetProxyIdBy(b2Sector* sector)
   {
     for (auto& proxy : m_proxies)
@@ -153,12 +348,65 @@ public:
 private: 
   b2ObjectId m_objectId;
   b2Shape* m_shape; 
+  ShapeStorage m_shapeStorage;
+  const b2SectorShapeTemplate* m_shapeTemplate;
   b2Filter m_filter; 
   b2Transform m_transform; 
   void* m_userData;
+  int m_level;
+  b2SectorRange m_range;
+  b2AABB m_fatAABB;
 
   int m_proxyCount; 
-  std::array<Proxy, 4> m_proxies;
+  std::array<Proxy, MaxProxyCount> m_proxies;
+};
+
+// b2DynamicTree::RayCast ݹ Ͻ b2SectorObject callback(input, object) ѱ
+template <typename F>
+struct b2SectorRayCastWrapper
+{
+  float RayCastCallback(const b2RayCastInput& input, int32 proxyId)
+  {
+    return callback(input, reinterpret_cast<b2SectorObject*>(tree->GetUserData(proxyId)));
+  }
+
+  const b2DynamicTree* tree;
+  F& callback;
+};
+
+//   б  b2DynamicTree  б  BVH
+/**
+ * 带  켱  ϰ Ʈ ǳʶ   ε(skip) д. 
+ *   迭 θ  ȸѴ.
+ */
+struct b2SectorSnapshot
+{
+  struct Node
+  {
+    b2AABB aabb;
+    b2SectorObject* object;   // leaf ƴϸ nullptr
+    int32 proxyId;            // leaf ƴϸ b2_nullNode
+    int32 skip;               //   Ʈ   ε
+    uint16 categoryBits;      // Ʈ leaf categoryBits 
+  };
+
+  // tree  ״ nodes 
+  void Build(const b2DynamicTree& tree);
+
+  // aabb ġ leaf Ʈ objects ߰. categoryBits maskBits ġ ʴ Ʈ ǳʶڴ.
+  int Query(const b2AABB& aabb, std::vector<b2SectorObject*>& objects, uint16 maskBits = 0xFFFF) const;
+
+  // aabb ġ leaf proxyId lst ߰
+  int Query(const b2AABB& aabb, std::vector<int32>& lst, uint16 maskBits = 0xFFFF) const;
+
+  // input ̿ ġ leaf proxyId lst ߰
+  int RayCast(const b2RayCastInput& input, std::vector<int32>& lst, uint16 maskBits = 0xFFFF) const;
+
+  // input ̿ ġ leaf callback(input, object) ȣ. ϰ b2DynamicTree::RayCast .
+  template <typename F>
+  void RayCast(const b2RayCastInput& input, F& callback, uint16 maskBits = 0xFFFF) const;
+
+  std::vector<Node> nodes;
 };
 
 //   b2SectorObject ϰ, b2DynamicTree Ͻÿ 
@@ -171,34 +419,93 @@ public:
   using ObjectId = std::size_t;
 
 public: 
-  // index bounds 
-  b2Sector(int index, const b2AABB& bounds);
+  // 
+  /**
+   * @param tree -   Ʈ.  Ѱ ޴´. nullptr̸  .
+   * @param phase - ׸  ܰ. Read ̸ܰ б⿡   ʴ´.
+   */
+  b2Sector(
+    int index, const b2AABB& bounds, b2DynamicTree* tree = nullptr, 
+    const std::atomic<b2SectorPhase>* phase = nullptr);
 
   ~b2Sector();
 
   // aabb   userData ϴ b2DynamicTree Proxy . userData b2SectorObject.
-  int32 CreateProxy(const b2AABB& aabb, void* userData);
+  /**
+   * categoryBits Ʈ 帶 Ʈ  Ǿ  maskBits Ʈ ǳʶڴ.
+   */
+  int32 CreateProxy(const b2AABB& aabb, void* userData, uint16 categoryBits = 0xFFFF);
 
   // proxyId Ͻø b2DynamicTree 
   void DestroyProxy(int32 proxyId);
 
   // proxyId Ͻø b2DynamicTree ̵. 
+  /**
+   * displacement  ̵ fat AABB   ÷  ̵ ٽ  ʰ Ѵ.
+   * @return Ʈ ٽ ־ true
+   */
   bool MoveProxy(int32 proxyId, const b2AABB& aabb, const b2Vec2& displacement);
 
+  //  Ϳ  ops   xlock . Create op.object attach Ѵ.
+  /**
+   * ӵ Create b2_minBulkProxyCount ̸̻ b2DynamicTree::CreateProxies   .
+   */
+  void ApplyProxyOps(const b2SectorProxyOp* ops, int count);
+
   // aabb    proxyId  
-  int Query(const b2AABB& aabb, std::vector<int32>& lst) const
-  {
-    rx::slock slock(m_lock);
-    return m_tree->Query(aabb, lst);
-  }
+  /**
+   * Query, RayCast maskBits categoryBits ġ ʴ Ͻô Ʈ ȸ ߿ ǳʶڴ.
+   */
+  int Query(const b2AABB& aabb, std::vector<int32>& lst, uint16 maskBits = 0xFFFF) const;
+
+  // aabb   Ͻð ִ b2SectorObject objects ߰
+  int Query(const b2AABB& aabb, std::vector<b2SectorObject*>& objects, uint16 maskBits = 0xFFFF) const;
 
   // input ̿ 浹ϴ proxyId  
-  int RayCast(const b2RayCastInput& input, std::vector<int32>& lst) const
+  int RayCast(const b2RayCastInput& input, std::vector<int32>& lst, uint16 maskBits = 0xFFFF) const;
+
+  // input ̿ ġ Ͻ b2SectorObject callback(input, object) ȣ
+  /**
+   * callback ϰ b2DynamicTree::RayCast . 
+   * 0̸ ߴϰ,  ̸   ڸ,  ϰ Ѵ.
+   */
+  template <typename F>
+  void RayCast(const b2RayCastInput& input, F& callback, uint16 maskBits = 0xFFFF) const
   {
-    rx::slock slock(m_lock);
-    return m_tree->RayCast(input, lst);
+    int candidateCount = 0;
+
+    auto counted = [&callback, &candidateCount](const b2RayCastInput& subInput, b2SectorObject* object) {
+      ++candidateCount;
+      return callback(subInput, object);
+    };
+
+    auto snapshot = m_snapshot.load(std::memory_order_acquire);
+    if (snapshot)
+    {
+      snapshot->RayCast(input, counted, maskBits);
+    }
+    else
+    {
+      std::optional<rx::slock> slock;
+      if (!IsReadPhase())
+      {
+        slock.emplace(m_lock);
+      }
+
+      b2SectorRayCastWrapper<decltype(counted)> wrapper{ m_tree, counted };
+      m_tree->RayCast(&wrapper, input, maskBits);
+    }
+
+    CountQuery(candidateCount);
   }
 
+  //  Ʈ   Խ.  Query, RayCast    д´.
+  /**
+   *   ۸  ϹǷ д    Խ  ȿ б⸦  Ѵ. 
+   * (ƽ  ܰ Ŀ ѹ ȣϴ 뵵)  忡 ȣѴ.
+   */
+  void PublishSnapshot();
+
   // proxyId شϴ b2SectorObject 
   b2SectorObject* GetObject(int32 proxyId)
   {
@@ -212,12 +519,199 @@ public:
     return b2TestOverlap(m_bounds, aabb);
   }
 
+  int GetIndex() const
+  {
+    return m_index;
+  }
+
+  const b2AABB& GetBounds() const
+  {
+    return m_bounds;
+  }
+
+  // Ʈ   Ͻ ̵ 
+  void AddMoveCount()
+  {
+    m_moveCount.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  // Ͻ ̵ Ƚ   Ʈ ٽ  Ƚ 
+  /**
+   * @param reset - true  Ŀ 0 .
+   */
+  void GetMoveCounts(int& moveCount, int& reinsertCount, bool reset);
+
+  // Query, RayCast ȣ   Ͻ  
+  /**
+   * @param reset - true  Ŀ 0 .
+   */
+  void GetQueryCounts(int& queryCount, int& candidateCount, bool reset);
+
+  // xlock  ٸ ð  ()
+  /**
+   * Ʈ ٲٴ xlock . slock   б   谡 ȴ.
+   * @param reset - true  Ŀ 0 .
+   */
+  int64_t GetLockWaitTime(bool reset);
+
+  // Ʈ Ͻ  
+  void GetTreeMetrics(int& proxyCount, int& treeHeight) const;
+
+  // Ͻð ϳ   Ȯ
+  bool IsEmpty() const;
+
+  //     ִ Ƚ ø ƴϸ 0 . 
+  /**
+   * b2SectorGrid::EvictSectors ȣѴ.
+   * @return   ִ Ƚ
+   */
+  int CountIdleTicks();
+
+  // Ʈ  ȣ  ѱ.  ʹ ⸸ ؾ Ѵ.
+  b2DynamicTree* ReleaseTree();
+
+  // Ʈ      켱  nodes . Ʈ 0̴.
+  /**
+   * ڽ θ𺸴 ڿ ְ child, parent nodes  ε ٲ۴. 
+   */
+  void CopyTree(std::vector<b2TreeNode>& nodes) const;
+
+  // Ʈ ٲ 4-wide 带 ٽ .   Query, RayCast wide 带 .
+  void BuildWideNodes();
+
+  // Ʈ ǰ  nodeBudgetŭ . b2DynamicTree::Optimize 
+  /**
+   * @return  leaf . Ʈ ٲ ʾ 0
+   */
+  int32 OptimizeTree(int32 nodeBudget);
+
+  // CopyTree  ġ nodes  Ʈ ٲ۴. leaf ε proxyId ȴ.
+  void RestoreTree(const std::vector<b2TreeNode>& nodes);
+
+  // , Ʈ  ϴ 뷫 Ʈ 
+  std::size_t GetMemorySize() const;
+
+private: 
+  // ׸尡 Read ̸ܰ ƹ Ʈ ٲ ʴ´.
+  bool IsReadPhase() const
+  {
+    return m_phase && m_phase->load(std::memory_order_acquire) == b2SectorPhase::Read;
+  }
+
+  void CountQuery(int candidateCount) const
+  {
+    m_queryCount.fetch_add(1, std::memory_order_relaxed);
+    m_candidateCount.fetch_add(candidateCount, std::memory_order_relaxed);
+  }
+
+  // xlock  ¿ ops Create   Ʈ ְ  ü attach
+  void CreateProxies(const b2SectorProxyOp* ops, int count);
+
+  // xlock  Ŀ ȣؼ start ٸ ð Ѵ
+  void AddLockWait(std::chrono::steady_clock::time_point start)
+  {
+    auto wait = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start);
+    m_lockWaitTime.fetch_add(wait.count(), std::memory_order_relaxed);
+  }
+
 private: 
   mutable rx::lockable m_lock;            // recursive shared mutex
+  const std::atomic<b2SectorPhase>* m_phase;
 
   int m_index;
   b2AABB m_bounds;
   b2DynamicTree* m_tree;
+
+  b2SectorSnapshot m_snapshots[2];
+  std::atomic<const b2SectorSnapshot*> m_snapshot;   // Խõ . nullptr̸ Ʈ  
+  int m_snapshotIndex;                               //   
+
+  int m_idleTicks;
+
+  int m_proxyCount;                   // xlock ٲ۴
+
+  std::atomic<int> m_moveCount;       // MoveProxy ȣ . slock øǷ atomic
+  std::atomic<int> m_reinsertCount;   // Ʈ ٽ  
+
+  mutable std::atomic<int> m_queryCount;        // Query, RayCast ȣ .   д ߿ ø
+  mutable std::atomic<int> m_candidateCount;    // Query, RayCast  Ͻ 
+  std::atomic<int64_t> m_lockWaitTime;          // xlock  ð  ()
 };
 
+template <typename F>
+void b2SectorSnapshot::RayCast(const b2RayCastInput& input, F& callback, uint16 maskBits) const
+{
+  b2Vec2 p1 = input.p1;
+  b2Vec2 p2 = input.p2;
+  b2Vec2 r = p2 - p1;
+
+  if (r.LengthSquared() <= 0.0f)
+  {
+    return;
+  }
+
+  r.Normalize();
+
+  // v is perpendicular to the segment.
+  b2Vec2 v = b2Cross(1.0f, r);
+  b2Vec2 abs_v = b2Abs(v);
+
+  float maxFraction = input.maxFraction;
+
+  b2AABB segmentAABB;
+  {
+    b2Vec2 t = p1 + maxFraction * (p2 - p1);
+    segmentAABB.lowerBound = b2Min(p1, t);
+    segmentAABB.upperBound = b2Max(p1, t);
+  }
+
+  int32 index = 0;
+  int32 nodeCount = static_cast<int32>(nodes.size());
+
+  while (index < nodeCount)
+  {
+    const Node& node = nodes[index];
+
+    // Separating axis for segment (Gino, p80).
+    bool overlap = (node.categoryBits & maskBits) != 0 && b2TestOverlap(node.aabb, segmentAABB);
+    if (overlap)
+    {
+      b2Vec2 c = node.aabb.GetCenter();
+      b2Vec2 h = node.aabb.GetExtents();
+      overlap = b2Abs(b2Dot(v, p1 - c)) - b2Dot(abs_v, h) <= 0.0f;
+    }
+
+    if (!overlap)
+    {
+      index = node.skip;
+      continue;
+    }
+
+    if (node.object)
+    {
+      b2RayCastInput subInput;
+      subInput.p1 = p1;
+      subInput.p2 = p2;
+      subInput.maxFraction = maxFraction;
+
+      float value = callback(subInput, node.object);
+
+      if (value == 0.0f)
+      {
+        return;
+      }
+
+      if (value > 0.0f)
+      {
+        maxFraction = value;
+        b2Vec2 t = p1 + maxFraction * (p2 - p1);
+        segmentAABB.lowerBound = b2Min(p1, t);
+        segmentAABB.upperBound = b2Max(p1, t);
+      }
+    }
+
+    ++index;
+  }
+}
+
 #endif //B2_SECTOR_H
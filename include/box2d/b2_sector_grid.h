@@ -1,12 +1,20 @@
 #ifndef B2_SECTOR_GRID_H
 #define B2_SECTOR_GRID_H
 
+#include "b2_block_allocator.h"
 #include "b2_sector.h"
 #include "b2_sector_collider.h"
+#include "b2_circle_shape.h"
+#include "b2_polygon_shape.h"
+#include <array>
+#include <atomic>
+#include <climits>
 #include <functional>
-#include <set>
-#include <queue>
+#include <memory>
+#include <optional>
+#include <string>
 #include <unordered_map>
+#include <vector>
 
 struct b2Result
 {
@@ -14,7 +22,11 @@ struct b2Result
   {
     Success,
     Fail_Too_Many_Shape_Child_Count,
-    Fail_Invalid_Object_Position
+    Fail_Invalid_Object_Position,
+    Fail_Too_Large_Object,
+    Fail_Invalid_Shape_Template,
+    Fail_Invalid_Data,
+    Fail_Grid_Not_Empty
   };
 
   template <typename T>
@@ -24,15 +36,239 @@ struct b2Result
   }
 };
 
+struct b2SectorReader;   // b2SectorGrid::Load ͸ д Ŀ
+
+// b2SectorGrid::RegisterShapeTemplate  ø ̵
+using b2ShapeTemplateId = int;
+
+// b2SectorGrid::MoveBatch ϴ Ʈ ϳ ̵
+struct b2SectorMove
+{
+  b2ObjectId oid;
+  b2Vec2 position;
+  b2Rot rotation;
+};
+
+// b2SectorGrid::QuerySweep  ϳ
+template <typename T>
+struct b2SectorSweepHit
+{
+  T id;         // Ʈ userData T ȯ 
+  float toi;    // xfStart xfEnd  浹  [0, 1]
+};
+
+// b2SectorGrid::KNearest, QueryRadiusSorted  ϳ
+template <typename T>
+struct b2SectorNearest
+{
+  T id;             // Ʈ userData T ȯ 
+  float distance;   //  ġ  Ʈ shape Ÿ. ġ 0
+};
+
+// b2SectorGrid::RayCast ݹ
+/**
+ * ϰ b2RayCastCallback::ReportFixture . 
+ * -1̸ , 0̸ ߴ, fraction̸ ̸   ڸ, 1̸ ڸ ʰ Ѵ.
+ */
+using b2SectorRayCastCallback = 
+  std::function<float(b2SectorObject* object, const b2Vec2& point, const b2Vec2& normal, float fraction)>;
+
+// b2SectorGrid::RayCastClosest 
+struct b2SectorRayCastHit
+{
+  b2SectorObject* object;
+  b2Vec2 point;
+  b2Vec2 normal;
+  float fraction;   // p1 p2   [0, 1]
+};
+
+//  ϴ . 帶 ϳ Ѵ.
+struct b2SectorQueryScratch
+{
+  std::vector<b2SectorObject*> objects;
+  std::vector<b2SectorSweepHit<b2SectorObject*>> hits;
+  std::vector<b2SectorNearest<b2SectorObject*>> nearest;
+};
+
+// ۾ . task(workerIndex) 0 ~ workerCount-1  ķ ϰ   ؾ Ѵ.
+using b2SectorTaskExecutor = std::function<void(int workerCount, const std::function<void(int)>& task)>;
+
+// b2SectorGrid::QueryBatch  Ŀ 
+/**
+ * colliders[i]  ids[offsets[i]] ~ ids[offsets[i + 1] - 1] ִ. 
+ * ƽ  νϽ ٽ  ۸ ϹǷ Ҵ .
+ */
+template <typename T>
+struct b2SectorQueryBatch
+{
+  struct Worker
+  {
+    b2SectorQueryScratch scratch;
+    std::vector<int> counts;
+    std::vector<T> ids;
+  };
+
+  std::vector<Worker> workers;
+  std::vector<int> offsets;
+  std::vector<T> ids;
+};
+
+// b2SectorGrid::FindAllPairs ݹ. a filterA, b filterB  Ʈ
+using b2SectorPairCallback = std::function<void(b2SectorObject* a, b2SectorObject* b)>;
+
+// b2SectorGrid::FindAllPairs Ŀ 
+/**
+ * ƽ  νϽ ٽ  ۸ ϹǷ Ҵ .
+ */
+struct b2SectorPairBatch
+{
+  struct Worker
+  {
+    b2SectorQueryScratch scratch;
+    std::vector<b2SectorObject*> candidates;
+    std::vector<std::pair<b2SectorObject*, b2SectorObject*>> pairs;
+  };
+
+  std::vector<Worker> workers;
+  std::vector<b2Sector*> sectors;
+};
+
+// b2SectorGrid::Save Ʈ userData ٸ μ ã  ִ Ű ٲ۴
+using b2SectorUserDataSaver = std::function<uint64_t(const void* userData)>;
+
+// b2SectorGrid::Load Ű userData ´. nullptr̸ ε尡 Ѵ.
+using b2SectorUserDataLoader = std::function<void*(uint64_t key)>;
+
+//  ϳ 
+struct b2SectorStats
+{
+  int index;              // b2Sector::GetIndex
+  int level;              //     ǥ
+  int ix;
+  int iy;
+  b2AABB bounds;
+  int proxyCount;         // Ʈ Ͻ 
+  int treeHeight;         // Ʈ 
+  int moveCount;          // Ͻ ̵ 
+  int reinsertCount;      //   fat AABB  Ʈ ٽ  
+  int queryCount;         //  Query, RayCast ȣ 
+  int candidateCount;     //  ȣ  Ͻ 
+  int64_t lockWaitTime;   // Ʈ ٲٴ xlock ٸ ð  ()
+
+  // ̵  Ʈ ٽ  
+  float GetReinsertRate() const
+  {
+    return moveCount > 0 ? static_cast<float>(reinsertCount) / moveCount : 0.0f;
+  }
+};
+
+//  ϳ  . Ʈ ׸    ְ 迡  ´.
+struct b2SectorLevelStats
+{
+  float sectorSize;
+  int sectorCountX;
+  int sectorCountY;
+  b2AABB bounds;          // ͵   (GetWorldBoundsExtended)
+  int objectCount;
+};
+
+// Ʈʿ ĥ   
+enum class b2SectorHeatValue
+{
+  ProxyCount,
+  TreeHeight,
+  MoveCount,
+  ReinsertCount,
+  QueryCount,
+  CandidateCount,
+  LockWaitTime
+};
+
+//    踦 ڷ ģ . sectorSize   ͸ ã  .
+struct b2SectorHeatmap
+{
+  int level = 0;
+  int width = 0;            // X  
+  int height = 0;           // Y  
+  b2AABB bounds;            // ڰ  
+  float sectorSize = 0.0f;
+  float maxValue = 0.0f;
+  std::vector<float> cells; // cells[iy * width + ix].  ʴ ʹ 0
+
+  float GetValue(int ix, int iy) const
+  {
+    return cells[iy * width + ix];
+  }
+
+  // CSV .   y  ̰  (iy ū ) .
+  void WriteCsv(std::string& out) const;
+};
+
+// b2SectorGrid::GetStats  ׸ 
+/**
+ * īʹ  relaxed atomic ϱ̹Ƿ ׻  ξ ȴ. 
+ * GetStats resetCounters ƽ θ ƽ   ȴ.
+ */
+struct b2SectorGridStats
+{
+  static constexpr int HistogramSize = 16;
+
+  int residentSectorCount = 0;    // ޸𸮿 ִ  
+  int pooledTreeCount = 0;        // Ϸ   Ʈ 
+  int evictedSectorCount = 0;     // ݱ   
+  std::size_t sectorMemory = 0;   // , Ʈ, ,  ̺ ϴ 뷫 Ʈ 
+
+  int proxyCount = 0;             //   Ͻ 
+  int moveCount = 0;              //   Ͻ ̵ 
+  int reinsertCount = 0;          //   Ʈ  
+  int64_t lockWaitTime = 0;       //   xlock  ð  ()
+
+  int queryCount = 0;             // Ϳ shape ˻ ϴ ׸   (浹, sweep, , nearest)
+  int candidateCount = 0;         //   Ϳ  Ʈ 
+  int hitCount = 0;               //     
+
+  //  Ͻ  . 0 ĭ  , i ĭ [2^(i-1), 2^i),  ĭ  ̻
+  std::array<int, HistogramSize> proxyHistogram{};
+
+  //  Ʈ  .  ĭ  ̻
+  std::array<int, HistogramSize> treeHeightHistogram{};
+
+  std::vector<b2SectorLevelStats> levels;   //   
+  std::vector<b2SectorStats> sectors;       //  ͺ 
+
+  //  Ʈ    .  ͳ fat AABB ʹ ũ.
+  float GetHitRate() const
+  {
+    return candidateCount > 0 ? static_cast<float>(hitCount) / candidateCount : 0.0f;
+  }
+
+  // level ͵ value  heatmap ڷ ģ
+  void GetHeatmap(int level, b2SectorHeatValue value, b2SectorHeatmap& heatmap) const;
+};
+
 struct b2SectorSettings
 {
   b2AABB bounds;          // ü  
   float sectorSize;       // x, y size are same
+
+  bool useDenseSectors = false;     // ͸ iy * countX + ix 迭 Ͽ   ȸ
+  bool preallocateSectors = false;  // useDenseSectors  ڿ  ͸ ̸ 
+  bool useSectorSnapshots = false;  // PublishSnapshots Խ    
+  int levelCount = 1;               //  ũ⸦ 2辿 Ű ׸ . ū Ʈ   д
+  int sectorEvictTicks = 0;         // EvictSectors  Ƚŭ ȣϴ   ִ ͸ . 0̸   
+  int sectorTreePoolSize = 0;       //   Ʈ  Ϳ Ϸ ϴ ִ 
+  float proxyExtension = b2_aabbExtension;  // Ͻ fat AABB . ǥ  Ʈ ũ⿡ ° Ű
+  bool useFramePhases = false;      // BeginWrite, BeginRead ƽ  Read ܰ    
+  bool useWideTrees = false;        // EndWrite ٲ  Ʈ 4-wide 带  б ܰ  
+  int treeOptimizeBudget = 0;       // EndWrite  Ʈ ǰ   ۾ (leaf ). 0̸  
 };
 
 /// ο b2Sector  ͵ ׸   浹 ó
 /**
  * b2SectorSettings    ũ⸦ 
+ * levelCount 1 ũ  ũ⸦ 2辿 Ű ׸带  ΰ, Ʈ ȸص 
+ *  ϳ     ִ´. Ʈ ִ 4 Ϳ ġ 
+ *    .
  */
 class B2_API b2SectorGrid
 {
@@ -49,22 +285,60 @@ public:
   /**
    * @param shape: shape heap Ҵϰ,  b2SectorGrid Ѿ.
    * @param userData: userData  ̵   ϴ   (   )
-   * @return ߰ Ʈ b2ObjectId Ѵ. ϸ  Ѵ.
+   * @return ߰ Ʈ b2ObjectId Ѵ. ϸ b2_nullObjectId Ѵ.
    */
   std::pair<b2ObjectId, b2Result::Code>
     Spawn(b2Shape* shape, const b2Filter& filter, b2Transform& tf, void* userData);
 
+  // shape ׸ Ǯ Ͽ b2SectorObject 
+  /**
+   * Ʈ shape  ׸ b2BlockAllocator ҴϹǷ 
+   *  , ŵǴ źȯ  Ѵ. ȣ  shape ÿ ξ ȴ.
+   */
+  std::pair<b2ObjectId, b2Result::Code>
+    Spawn(const b2Shape& shape, const b2Filter& filter, const b2Transform& tf, void* userData);
+
+  // ø shape ϴ b2SectorObject 
+  /**
+   * shape  ʰ, AABB ø  AABB ȯϿ Ѵ.
+   * @return ø  Fail_Invalid_Shape_Template
+   */
+  std::pair<b2ObjectId, b2Result::Code>
+    Spawn(b2ShapeTemplateId shapeTemplate, const b2Filter& filter, const b2Transform& tf, void* userData);
+
+  //  Ʈ  shape ø 
+  /**
+   * shape ׸ Ǯ ϰ  AABB ,  ̸  д. 
+   * ø ׸尡 Ҹ  ȴ.
+   * @return Spawn  ø ̵
+   */
+  b2ShapeTemplateId RegisterShapeTemplate(const b2Shape& shape);
+
+  //  ø .  nullptr
+  const b2SectorShapeTemplate* GetShapeTemplate(b2ShapeTemplateId shapeTemplate);
+
   // oid b2SectorObject .  
   void Despawn(b2ObjectId oid);
 
   // oid b2SectorObject ġ ϰ ȸŴ. 
   /**
+   *  ġ ̸  Ἥ Ʈ fat AABB ̵  ø. 
+   * fat AABB ȿ ̸  Ʈ ǵ帮 ʴ´.
    * @param oid - the object to move
    * @param position - the new position of the object
    * @param rotation - the rotation angle of the object
    */
   void Move(b2ObjectId oid, const b2Vec2& position, const b2Rot& rotation);
 
+  //  Ʈ ѹ ̵. 
+  /**
+   *  ͺ Ƽ ͸ xlock ѹ ´. ƽ  Ʈ 
+   * ű  Move ݺ ȣϴ ͺ   .
+   * @param moves - ̵ Ʈ.  oid      ȴ.
+   * @param count - moves 
+   */
+  void MoveBatch(const b2SectorMove* moves, int count);
+
   // shape ġ Ʈ Ѵ. 
   /**
    * @param obj - b2SectorObject. Shape, Filter, Transform needs to be valid
@@ -98,45 +372,342 @@ public:
   template <typename T>
   int QueryOBB(float hx, float hy, const b2Vec2& pos, float angle, const b2Filter& filter, std::vector<T>& objects);
 
+  // shape xfStart xfEnd 鼭 εġ Ʈ 浹   ´
+  /**
+   *   AABB ġ ͵鿡 ĺ ã b2TimeOfImpact 浹  Ѵ. 
+   * ó  ִ Ʈ toi 0̴.  ƽ ڱ ũ⺸ ָ  
+   * źȯ  Ʈ ġ ʵ   Ѵ.
+   * @param hits - toi ,  b2ObjectId  ߰
+   */
+  template <typename T>
+  int QuerySweep(
+    const b2Shape* shape, const b2Filter& filter, 
+    const b2Transform& xfStart, const b2Transform& xfEnd, std::vector<b2SectorSweepHit<T>>& hits);
+
+  // QuerySweep   b2SectorObject scratch.hits ´.
+  int QuerySweepObjects(
+    const b2Shape* shape, const b2Filter& filter, 
+    const b2Transform& xfStart, const b2Transform& xfEnd, b2SectorQueryScratch& scratch);
+
+  // p1 p2  ̿ εġ Ʈ callback ȣ
+  /**
+   *  ̰  ͸  湮ϰ(grid DDA) ĺ b2Shape::RayCast ȮѴ. 
+   * callback ̸ ڸ ߸  ʸ ʹ 湮 ʴ´. 
+   *  Ϳ ģ Ʈ   ȣ ȣ    ٸ  ִ.
+   */
+  void RayCast(const b2Vec2& p1, const b2Vec2& p2, const b2Filter& filter, const b2SectorRayCastCallback& callback);
+
+  // p1 p2  ̿   εġ Ʈ ´
+  /**
+   * þ üũ Ʈĵ ⿡ Ѵ.
+   * @return εġ Ʈ  false
+   */
+  bool RayCastClosest(const b2Vec2& p1, const b2Vec2& p2, const b2Filter& filter, b2SectorRayCastHit& hit);
+
+  // point   k Ʈ ´
+  /**
+   *  ġ ͺ  ĭ ٱ    ã, 
+   *  ݱ ã k° Ÿ ־ . 
+   * ĺ fat AABB Ÿ  Ÿ  ͸ b2Distance shape Ÿ Ѵ.
+   * @param results - Ÿ ,  b2ObjectId  ߰
+   */
+  template <typename T>
+  int KNearest(const b2Vec2& point, int k, const b2Filter& filter, std::vector<b2SectorNearest<T>>& results);
+
+  // oid Ʈ shape   k Ʈ ´. oid ڽ Ѵ.
+  template <typename T>
+  int KNearest(b2ObjectId oid, int k, const b2Filter& filter, std::vector<b2SectorNearest<T>>& results);
+
+  // point radius  Ʈ   ´
+  template <typename T>
+  int QueryRadiusSorted(const b2Vec2& point, float radius, const b2Filter& filter, std::vector<b2SectorNearest<T>>& results);
+
+  // oid Ʈ shape radius  Ʈ   ´. oid ڽ Ѵ.
+  template <typename T>
+  int QueryRadiusSorted(b2ObjectId oid, float radius, const b2Filter& filter, std::vector<b2SectorNearest<T>>& results);
+
+  // point radius    Ʈ ִ k Ÿ  scratch.nearest ´
+  /**
+   * @param k -    INT_MAX. 0 ̸ ã ʰ 0
+   * @param radius - Ÿ   b2_maxFloat. ̸ ã ʰ 0
+   */
+  int QueryNearestObjects(
+    const b2Vec2& point, int k, float radius, const b2Filter& filter, b2SectorQueryScratch& scratch);
+
+  // QueryNearestObjects  oid Ʈ shape  Ѵ. oid  0
+  int QueryNearestObjects(
+    b2ObjectId oid, int k, float radius, const b2Filter& filter, b2SectorQueryScratch& scratch);
+
+  //  collider  Query Ŀ  
+  /**
+   * colliders workerCount  ӵ   executor Ѵ. 
+   *  Ŀ batch ڱ ۸ ϸ  colliders  .
+   * @param executor -   ȣ 忡  
+   * @param batch - . offsets, ids  collider  ã´.
+   */
+  template <typename T>
+  void QueryBatch(
+    const b2SectorCollider* colliders, int count, 
+    int workerCount, const b2SectorTaskExecutor& executor, b2SectorQueryBatch<T>& batch);
+
+  // collider ġ b2SectorObject scratch.objects ´. 
+  /**
+   * ߺ ŵǰ b2ObjectId  ĵȴ. scratch ϸ Ҵ .
+   * @return ġ Ʈ 
+   */
+  int QueryObjects(const b2SectorCollider& collider, b2SectorQueryScratch& scratch);
+
+  // aabb Ͻð ġ b2SectorObject scratch.objects ´. ͸  浹 üũ .
+  int QueryObjects(const b2AABB& aabb, b2SectorQueryScratch& scratch);
+
+  // ġ Ʈ   ã ָ   callback ȣ
+  /**
+   * ͸ ڱ Ʈ ȿ self-joinѴ.  Ϳ ģ   Ʈ   
+   * ġ ù Ϳ,  ٸ  ū  Ʈ ù Ϳ   ˻Ͽ Ѵ. 
+   * ͵ workerCount    executor ϰ, callback ȣ 忡 
+   *  ε  ȣѴ. Move ÿ ȣϸ ̴ Ʈ  ų ߺ  ִ.
+   * @param filterA, filterB - ShouldCollide(filterA, a ), ShouldCollide(filterB, b ) . 
+   *                              Ǹ b2ObjectId   a
+   * @param executor -   ȣ 忡  
+   */
+  void FindAllPairs(
+    const b2Filter& filterA, const b2Filter& filterB, 
+    int workerCount, const b2SectorTaskExecutor& executor, b2SectorPairBatch& batch, 
+    const b2SectorPairCallback& callback);
+
+  // ȣ 忡 FindAllPairs 
+  void FindAllPairs(const b2Filter& filterA, const b2Filter& filterB, const b2SectorPairCallback& callback);
+
+  //   Ʈ  Խ (useSectorSnapshots)
+  /**
+   * ƽ  ܰ (Move ) Ŀ  忡 ѹ ȣѴ.   Ϳ 
+   * ׸   ̹ Խ  д´.     Ƿ 
+   *   Խ   Ѵ. Despawn Ʈ   Խ Ŀ .
+   * ͱ   ã useDenseSectors  Ѵ.
+   */
+  void PublishSnapshots();
+
+  // sectorEvictTicks   ִ ͸  
+  /**
+   * ƽ  ܰ (Spawn, Despawn, Move ) Ŀ  忡 ѹ ȣѴ. ʹ 
+   * ÿ ص ȴ. useSectorSnapshots̸    ͸   Ƿ 
+   *    ȣ Ŀ .  Ʈ sectorTreePoolSize  ߴٰ Ѵ.
+   * @return ̹   
+   */
+  int EvictSectors();
+
+  //  ܰ  (useFramePhases)
+  /**
+   * EndWrite  忡 Spawn, Despawn, Move, MoveBatch ȣѴ. 
+   *  ܰ迡  ȣϸ  忡 b2Assert ´.
+   */
+  void BeginWrite();
+
+  //  ܰ 
+  /**
+   * useWideTrees̸ ̹ ܰ迡 ٲ  Ʈ wide 带 . 
+   * useSectorSnapshots̸  ԽѴ.  Ʈ( ), б 
+   * ( ) ϹǷ   ܰ бⰡ ĵ ȴ.
+   */
+  void EndWrite();
+
+  // б ܰ  (useFramePhases)
+  /**
+   * EndRead  ȣѴ. ƹ͵ ٲ Ƿ ׸    ʴ´. 
+   *  ܰ迡 ⸦ ȣϸ  忡 b2Assert ´. 
+   * ܰ踦 ٲٴ ȣ  ܰ  ۾    忡 Ѵ.
+   */
+  void BeginRead();
+
+  // б ܰ 
+  void EndRead();
+
+  b2SectorPhase GetPhase() const
+  {
+    return m_phase.load(std::memory_order_acquire);
+  }
+
+  //   , ޸ 뷮,  ȿ ͺ Ͻ, Ʈ, ̵,  踦 
+  /**
+   * ͸ slock   Ʈ ̸ д ̹Ƿ  ߿ ֱ ҷ ȴ.
+   * @param resetCounters - true ̵, ,   ī͸ 0 . ƽ ȣϸ ƽ   ȴ.
+   */
+  void GetStats(b2SectorGridStats& stats, bool resetCounters = false);
+
+  // , ø, Ʈ  Ʈ out ڿ ̳ʸ δ
+  /**
+   *   float  μ Load д´. ʹ  Ƿ 
+   * userData saver  Ű Ѵ.  ѱ shape Ǯ shape ȴ.
+   * @param includeTrees -  Ʈ 带 ״ Ͽ Load ٽ  ʴ´.
+   */
+  void Save(std::vector<uint8_t>& out, const b2SectorUserDataSaver& saver, bool includeTrees = true);
+
+  // Save   д´.   ׸带   LoadѴ.
+  static b2Result::Code LoadSettings(const uint8_t* data, std::size_t size, b2SectorSettings& settings);
+
+  // Save ͷ  ׸带 ä
+  /**
+   * b2ObjectId    Ƿ   ڵ ״ . 
+   *  ġ     Ʈ   ϰ, 
+   * ٸų Ʈ  ͺ  Ͻø . 
+   * ϸ Ϻθ ε ̹Ƿ ׸带  Ѵ.
+   * @return Ͱ ߸Ǿ Fail_Invalid_Data, ׸忡 ø̳ Ʈ  Fail_Grid_Not_Empty
+   */
+  b2Result::Code Load(const uint8_t* data, std::size_t size, const b2SectorUserDataLoader& loader);
+
   const b2AABB& GetWorldBounds() const
   {
     return m_settings.bounds;
   }
 
-  const b2AABB& GetWorldBoundsExtended() const
+  // level ͵  . level 0 ⺻  ũ
+  const b2AABB& GetWorldBoundsExtended(int level = 0) const
   {
-    return m_sectorBoundsExtended;
+    return m_levels[level].boundsExtended;
   }
 
-  float GetSectorSize() const
+  float GetSectorSize(int level = 0) const
   {
-    return m_settings.sectorSize;
+    return m_levels[level].sectorSize;
   }
 
-  int GetSectorCountX() const
+  int GetSectorCountX(int level = 0) const
   {
-    return m_sectorCountX;
+    return m_levels[level].sectorCountX;
   }
 
-  int GetSectorCountY() const
+  int GetSectorCountY(int level = 0) const
   {
-    return m_sectorCountY;
+    return m_levels[level].sectorCountY;
+  }
+
+  int GetLevelCount() const
+  {
+    return m_levelCount;
   }
 
   static bool IsValid(b2ObjectId oid)
   {
-    return oid > 0;
+    return oid != b2_nullObjectId;
+  }
+
+  // oid Ʈ ִ Ȯ. Despawn Ʈ ڵ̸ false
+  bool IsAlive(b2ObjectId oid)
+  {
+    std::optional<rx::slock> slock;
+    if (!IsReadPhase())
+    {
+      slock.emplace(m_lock);
+    }
+
+    return FindObject(oid) != nullptr;
   }
 
 private:
-  using ObjectMap = std::unordered_map<b2ObjectId, b2SectorObject*>;
-  using SectorMap = std::unordered_map<int, b2Sector*>;   // y index * m_sectorCountX + x index
+  // Ʈ . Despawnϸ 븦 ø   Ͽ ִ´.
+  struct ObjectSlot
+  {
+    b2SectorObject* object;   //   nullptr
+    uint32 generation;        // 0 ƴ
+    uint32 nextFree;          //     
+  };
+
+  using SectorMap = std::unordered_map<int, b2Sector*>;   // GetSectorIndexFrom(level, ix, iy)
 
-  // x ε ix̰, y ε iy Ͱ  
-  void EnsureSector(int ix, int iy);
+  //  ũⰡ  ϳ ׸.  l  ũ sectorSize * 2^l
+  struct Level
+  {
+    float sectorSize;
+    int sectorCountX;             // X    
+    int sectorCountY;             // Y  
+    int indexBase;                //  ̿  ε ġ ʵ ϴ 
+    b2AABB boundsExtended;        // ü ʹ ٱ ͸  .  ó
+    std::atomic<int> objectCount; //   Ʈ . 0̸  ǳʶ
+    std::unique_ptr<std::atomic<b2Sector*>[]> denseSectors;   // useDenseSectors  
+  };
+
+  //  ߽ ȸ shape    
+  static float GetShapeDiameter(const b2Shape* shape);
+
+  //  AABB  Ÿ. ġ 0
+  static float GetDistance(const b2AABB& a, const b2AABB& b);
+
+  // ȸ   shape    .   ū 
+  int GetLevelFor(const b2Shape* shape) const;
+
+  // aabb ġ   level ׸  ߶ Ѵ. 
+  /**
+   * @return aabb Ȯ  ȿ   true
+   */
+  bool GetSectorRange(int level, const b2AABB& aabb, b2SectorRange& range) const;
+
+  //  Ʈ ִ Ͻ   ʴ  Ȯ
+  static bool CheckProxyCount(const b2SectorRange& range)
+  {
+    return (range.ix1 - range.ix0 + 1) * (range.iy1 - range.iy0 + 1) <= b2SectorObject::MaxProxyCount;
+  }
+
+  // aabb proxyExtension ŭ ø displacement   ø AABB
+  b2AABB ComputeFatAABB(const b2AABB& aabb, const b2Vec2& displacement) const;
+
+  // aabb displacement obj fat AABB 
+  /**
+   * b2DynamicTree::MoveProxy    proxyExtension Ѵ. 
+   * Ʈ b2_aabbExtension    ǥ  Ź ٽ ְ ȴ.
+   * @return fat AABB ٲ Ͻø Űܾ ϸ true
+   */
+  bool UpdateFatAABB(b2SectorObject* obj, const b2AABB& aabb, const b2Vec2& displacement) const;
+
+  // level x ε ix̰, y ε iy Ͱ  
+  void EnsureSector(int level, int ix, int iy);
+
+  // range ͵  
+  void EnsureRange(int level, const b2SectorRange& range)
+  {
+    for (int iy = range.iy0; iy <= range.iy1; ++iy)
+    {
+      for (int ix = range.ix0; ix <= range.ix1; ++ix)
+      {
+        EnsureSector(level, ix, iy);
+      }
+    }
+  }
+
+  // level ix, iy ġ 踦   .  Ʈ  
+  b2Sector* CreateSector(int level, int ix, int iy);
+
+  // ͸  Ʈ sectorTreePoolSize  
+  void DestroySector(b2Sector* sector);
+
+  //  ε  ix, iy 
+  void GetSectorCoord(int index, int& level, int& ix, int& iy) const
+  {
+    level = m_levelCount - 1;
+    while (index < m_levels[level].indexBase)
+    {
+      --level;
+    }
+
+    const Level& lv = m_levels[level];
+    ix = (index - lv.indexBase) % lv.sectorCountX;
+    iy = (index - lv.indexBase) / lv.sectorCountX;
+  }
+
+  //  ε dense ̺ ĭ 
+  std::atomic<b2Sector*>& GetDenseSlot(int index)
+  {
+    int level = m_levelCount - 1;
+    while (index < m_levels[level].indexBase)
+    {
+      --level;
+    }
+
+    return m_levels[level].denseSectors[index - m_levels[level].indexBase];
+  }
 
   // Ϳ  Լ f ȣ
-  bool Apply(b2Sector* sector, std::function<bool(b2Sector*)> f)
+  template <typename F>
+  bool Apply(b2Sector* sector, F& f)
   {
     if (sector)
     {
@@ -146,35 +717,83 @@ private:
     return false;
   }
 
-  //  9 Ϳ  Լ f ȣ
-  int ApplyNeighbors(int ix, int iy, std::function<bool(b2Sector*)> f)
+  // range ͵鿡  Լ f ȣ
+  template <typename F>
+  int ApplyRange(int level, const b2SectorRange& range, F f)
   {
     int trueCount = 0;
 
-    if (Apply(GetSector(ix - 1, iy - 1), f)) { trueCount++; }
-    if (Apply(GetSector(ix - 0, iy - 1), f)) { trueCount++; }
-    if (Apply(GetSector(ix + 1, iy - 1), f)) { trueCount++; }
+    for (int iy = range.iy0; iy <= range.iy1; ++iy)
+    {
+      for (int ix = range.ix0; ix <= range.ix1; ++ix)
+      {
+        if (Apply(GetSector(level, ix, iy), f)) { trueCount++; }
+      }
+    }
 
-    if (Apply(GetSector(ix - 1, iy - 0), f)) { trueCount++; }
-    if (Apply(GetSector(ix - 0, iy - 0), f)) { trueCount++; }
-    if (Apply(GetSector(ix + 1, iy - 0), f)) { trueCount++; }
+    return trueCount;
+  }
 
-    if (Apply(GetSector(ix - 1, iy + 1), f)) { trueCount++; }
-    if (Apply(GetSector(ix - 0, iy + 1), f)) { trueCount++; }
-    if (Apply(GetSector(ix + 1, iy + 1), f)) { trueCount++; }
+  // from  to  ű  ٲ ͵鿡  f(sector, type) ȣ
+  /**
+   * from ִ ʹ Destroy,   ִ ʹ Move, to ִ ʹ Create 
+   * ȣѴ.  ͸  ȣϹǷ Ͻ ڸ  ʴ. 
+   * Create  ʹ  .
+   */
+  template <typename F>
+  void ApplyRangeDiff(int level, const b2SectorRange& from, const b2SectorRange& to, F f)
+  {
+    for (int iy = from.iy0; iy <= from.iy1; ++iy)
+    {
+      for (int ix = from.ix0; ix <= from.ix1; ++ix)
+      {
+        if (!to.Contains(ix, iy))
+        {
+          f(GetSector(level, ix, iy), b2SectorProxyOp::Destroy);
+        }
+      }
+    }
 
-    return trueCount;
+    for (int iy = to.iy0; iy <= to.iy1; ++iy)
+    {
+      for (int ix = to.ix0; ix <= to.ix1; ++ix)
+      {
+        if (from.Contains(ix, iy))
+        {
+          f(GetSector(level, ix, iy), b2SectorProxyOp::Move);
+        }
+        else
+        {
+          EnsureSector(level, ix, iy);
+          f(GetSector(level, ix, iy), b2SectorProxyOp::Create);
+        }
+      }
+    }
   }
 
-  // ix, iy ͸ 
-  b2Sector* GetSector(int ix, int iy)
+  // level ix, iy ͸ 
+  b2Sector* GetSector(int level, int ix, int iy)
   {
-    int index = GetSectorIndexFrom(ix, iy);
+    if (m_settings.useDenseSectors)
+    {
+      const Level& lv = m_levels[level];
+      b2Assert(0 <= ix && ix < lv.sectorCountX && 0 <= iy && iy < lv.sectorCountY);
+
+      //   д´. EvictSectors  nullptr ٲٰ ͸ ų ̷   ִ.
+      //    ׸ slock  Ƿ EvictSectors xlock ġ ʴ´.
+      //    д  m_retiredSectors EvictSectors    ȣ  
+      // ͸  ιǷ    Ѵ.  ʹ nullptr̹Ƿ ȣϴ  óѴ.
+      return lv.denseSectors[iy * lv.sectorCountX + ix].load(std::memory_order_acquire);
+    }
 
     {
-      rx::slock slock(m_lock);
+      std::optional<rx::slock> slock;
+      if (!IsReadPhase())
+      {
+        slock.emplace(m_lock);
+      }
 
-      auto iter = m_sectors.find(index);
+      auto iter = m_sectors.find(GetSectorIndexFrom(level, ix, iy));
       if (iter != m_sectors.end())
       {
         return iter->second;
@@ -184,193 +803,289 @@ private:
     return nullptr;
   }
 
-  int GetSectorIndexX(float x)
+  //     ε
+  int GetSectorIndexFrom(int level, int ix, int iy) const
   {
-    float sx = x - m_sectorBoundsExtended.lowerBound.x;
+    const Level& lv = m_levels[level];
+    return lv.indexBase + iy * lv.sectorCountX + ix;
+  }
 
-    if (sx < 0) // object cannot be outside bounds
-    {
-      return -1;
-    }
+  //   aabb ġ ͵ Ʈ ߺ  b2ObjectId  objects ´.
+  /**
+   * ȣϴ ʿ m_lock slock  ־ Ѵ.
+   * @param maskBits - categoryBits ġ ʴ Ͻô  Ʈ ȸ ߿ ǳʶڴ. GetMaskBits(filter)
+   */
+  void CollectObjects(const b2AABB& aabb, std::vector<b2SectorObject*>& objects, uint16 maskBits = 0xFFFF);
 
-    int ix = static_cast<int>(sx / m_settings.sectorSize);
-    int addX = (sx - m_settings.sectorSize * ix) > 0 ? 1 : 0;
-    ix += addX;
+  // shape  Ʈ    ã scratch.nearest Ÿ  ´.
+  /**
+   * ȣϴ ʿ m_lock slock  ־ Ѵ (IsLockFreeRead ƴ ).
+   */
+  void CollectNearest(
+    const b2Shape* shape, const b2Transform& xf, const b2SectorObject* exclude, 
+    int k, float radius, const b2Filter& filter, b2SectorQueryScratch& scratch);
 
-    if (ix >= (m_sectorCountX - 1))
-    {
-      return -2;
-    }
+  // sector   worker.pairs ߰
+  /**
+   * ȣϴ ʿ m_lock slock  ־ Ѵ (IsLockFreeRead ƴ ).
+   */
+  void FindPairsInSector(
+    b2Sector* sector, const b2Filter& filterA, const b2Filter& filterB, b2SectorPairBatch::Worker& worker);
 
-    return ix;
-  }
+  // a, b ġ Ϳ ´  pairs ߰
+  void AddPair(
+    b2SectorObject* a, b2SectorObject* b, const b2Filter& filterA, const b2Filter& filterB, 
+    std::vector<std::pair<b2SectorObject*, b2SectorObject*>>& pairs);
 
-  int GetSectorIndexY(float y)
-  {
-    float sy = y - m_sectorBoundsExtended.lowerBound.y;
+  // ops  ε  Ͽ ͸ xlock ѹ  
+  void ApplyProxyOps(std::vector<b2SectorProxyOp>& ops);
+
+  // Ϳ b2TestOverlap collider ġ ʴ Ʈ objects 
+  int FilterObjects(const b2SectorCollider& collider, std::vector<b2SectorObject*>& objects);
 
-    if (sy < 0) // object cannot be outside bounds
+  //   Ϳ  Լ f ȣ
+  template <typename F>
+  void ForEachSector(F f)
+  {
+    std::optional<rx::slock> slock;
+    if (!IsReadPhase())
     {
-      return -1;
+      slock.emplace(m_lock);
     }
 
-    int iy = static_cast<int>(sy / m_settings.sectorSize);
-    int addY = (sy - m_settings.sectorSize * iy) > 0 ? 1 : 0;
-    iy += addY;
+    if (m_settings.useDenseSectors)
+    {
+      for (auto sector : m_denseResidents)
+      {
+        f(sector);
+      }
+      return;
+    }
 
-    if (iy >= (m_sectorCountY - 1))
+    for (auto& kv : m_sectors)
     {
-      return -2;
+      f(kv.second);
     }
+  }
 
-    return iy;
+  // Read ̸ܰ ƹ͵ ٲ Ƿ   д´.
+  bool IsReadPhase() const
+  {
+    return m_phase.load(std::memory_order_acquire) == b2SectorPhase::Read;
   }
 
-  int GetSectorIndexFrom(float x, float y)
+  //  ׸   ͸   ִ .  аų Read ܰ
+  bool IsLockFreeRead() const
   {
-    return GetSectorIndexY(y) * m_sectorCountX + GetSectorIndexX(x);
+    return m_settings.useSectorSnapshots || IsReadPhase();
   }
 
-  int GetSectorIndexFrom(const b2AABB& aabb)
+  //  忡 Read ܰ ⸦ ´
+  void CheckWritePhase() const
   {
-    return GetSectorIndexFrom(aabb.GetCenter().x, aabb.GetCenter().y);
+    b2Assert(m_phase.load(std::memory_order_relaxed) != b2SectorPhase::Read);
   }
 
-  int GetSectorIndexFrom(int ix, int iy)
+  //  忡 Write ܰ  ´
+  void CheckReadPhase() const
   {
-    return iy * m_sectorCountX + ix;
+    b2Assert(m_phase.load(std::memory_order_relaxed) != b2SectorPhase::Write);
   }
 
-  bool CheckIndexBounds(int ix, int iy)
+  // ׸  ϳ ĺ    Ѵ
+  void CountQuery(std::size_t candidateCount, std::size_t hitCount)
   {
-    return
-      ix >= 1 && ix < m_sectorCountX - 1 &&
-      iy >= 1 && iy < m_sectorCountY - 1;
+    m_queryCount.fetch_add(1, std::memory_order_relaxed);
+    m_candidateCount.fetch_add(static_cast<int>(candidateCount), std::memory_order_relaxed);
+    m_hitCount.fetch_add(static_cast<int>(hitCount), std::memory_order_relaxed);
   }
 
   // ׷ ų  īװ  ũ Ʈ Ǹ 浹 üũ
   bool ShouldCollide(const b2Filter& filterA, const b2Filter& filterB);
 
-  int AcquireObjectId();
+  // filter ShouldCollide   ִ categoryBits. Ʈ ȸ Ʈ ǳʶٴ  .
+  /**
+   *  ׷ ũ  浹ϹǷ ƹ͵ Ÿ ʴ´.
+   */
+  static uint16 GetMaskBits(const b2Filter& filter);
+
+  // shape ˻  Ʈ  Ϳ ִ´
+  /**
+   * @param ownedShape -  ޴ shape. nullptr̸ shape Ǯ Ѵ.
+   * @param shapeTemplate -  shape  ʰ Ѵ.
+   */
+  std::pair<b2ObjectId, b2Result::Code> SpawnObject(
+    const b2Shape* shape, b2Shape* ownedShape, const b2SectorShapeTemplate* shapeTemplate, 
+    const b2Filter& filter, const b2Transform& tf, void* userData);
+
+  // Save Ʈ ϳ oid    Ѵ. Ͻô  ʴ´.
+  /**
+   * ȣϴ ʿ m_lock xlock  ־ Ѵ.
+   */
+  std::pair<b2SectorObject*, b2Result::Code> LoadObject(
+    b2ObjectId oid, const b2Shape* shape, const b2SectorShapeTemplate* shapeTemplate, 
+    const b2Filter& filter, const b2Transform& tf, void* userData);
+
+  // Save  Ʈ о Ϳ ϰ Ʈ Ͻø δ
+  b2Result::Code LoadTrees(b2SectorReader& reader);
+
+  // Ʈ Ǯ Ҵ shape . ȣϴ ʿ m_lock xlock  ־ Ѵ.
+  void DestroyObject(b2SectorObject* obj);
 
-  void ReleaseObjectId(int id);
+  // Ǯ Ҵ shape . ȣϴ ʿ m_lock xlock  ־ Ѵ.
+  void FreeShape(b2Shape* shape);
+
+  // oid Ʈ  迭 ã. ų 밡 ٸ nullptr
+  /**
+   * ȣϴ ʿ m_lock  ־ Ѵ.
+   */
+  b2SectorObject* FindObject(b2ObjectId oid) const
+  {
+    uint32 index = b2GetObjectIndex(oid);
+    if (index >= m_objectSlots.size())
+    {
+      return nullptr;
+    }
+
+    const ObjectSlot& slot = m_objectSlots[index];
+    return slot.generation == b2GetObjectGeneration(oid) ? slot.object : nullptr;
+  }
+
+  //  Կ obj ְ ڵ . ȣϴ ʿ m_lock xlock  ־ Ѵ.
+  b2ObjectId AcquireObjectId(b2SectorObject* obj);
+
+  // oid   븦 ø. ȣϴ ʿ m_lock xlock  ־ Ѵ.
+  void ReleaseObjectId(b2ObjectId oid);
 
 private:
   rx::lockable m_lock;            // recursive shared mutex
   b2SectorSettings m_settings;
 
-  int m_sectorCountX;             // X    
-  int m_sectorCountY;             // Y  
-  b2AABB m_sectorBoundsExtended;  // ü ʹ ٱ ϳ ͸  .  ó
+  std::unique_ptr<Level[]> m_levels;  // 0   
+  int m_levelCount;
 
-  ObjectMap m_objects;
+  std::vector<ObjectSlot> m_objectSlots;   // b2GetObjectIndex(oid) ã
+  uint32 m_freeObjectSlot;                 //    ó
   SectorMap m_sectors;
-
-  std::queue<b2ObjectId> m_idQueue;
-  int m_objectIdSequence;
+  std::vector<b2Sector*> m_denseResidents;                    // useDenseSectors  ̺ Խõ ͵
+  std::vector<b2Sector*> m_retiredSectors[2];                 // useSectorSnapshots  ⸦ ̷ 
+  std::vector<b2DynamicTree*> m_treePool;                     //   Ʈ
+  int m_evictedSectorCount;
+  std::vector<b2SectorObject*> m_retiredObjects[2];           // useSectorSnapshots  ⸦ ̷ Ʈ
+  b2BlockAllocator m_allocator;                               // Ʈ Ǯ shape. m_lock xlock  
+  std::vector<b2SectorShapeTemplate*> m_shapeTemplates;       // b2ShapeTemplateId ã
+  std::atomic<b2SectorPhase> m_phase;                         // useFramePhases  ܰ
+  std::atomic<int> m_queryCount;                              // GetStats queryCount, candidateCount, hitCount
+  std::atomic<int> m_candidateCount;
+  std::atomic<int> m_hitCount;
 };
 
 template <typename T>
 int b2SectorGrid::Query(const b2SectorCollider& collider, std::vector<T>& objects)
 {
-  b2AABB aabb;
-  collider.GetShape()->ComputeAABB(&aabb, collider.GetTransform(), 0);
+  // 帶 ۸ Ͽ  Ҵ ʴ´.
+  static thread_local b2SectorQueryScratch scratch;
 
-  int ix = GetSectorIndexX(aabb.GetCenter().x);
-  int iy = GetSectorIndexX(aabb.GetCenter().y);
+  int hitCount = QueryObjects(collider, scratch);
 
-  b2Assert(CheckIndexBounds(ix, iy));
-  if (!CheckIndexBounds(ix, iy))
+  for (int i = 0; i < hitCount; ++i)
   {
-    return 0;
+    objects.push_back(scratch.objects[i]->template GetUserData<T>());
   }
-  
-  std::set<b2ObjectId> sobjs;
 
-  // slock
+  return static_cast<int>(objects.size());
+}
+
+template <typename T>
+int b2SectorGrid::QuerySweep(
+  const b2Shape* shape, const b2Filter& filter, 
+  const b2Transform& xfStart, const b2Transform& xfEnd, std::vector<b2SectorSweepHit<T>>& hits)
+{
+  static thread_local b2SectorQueryScratch scratch;
+
+  int hitCount = QuerySweepObjects(shape, filter, xfStart, xfEnd, scratch);
+
+  for (int i = 0; i < hitCount; ++i)
   {
-    rx::slock slock(m_lock);
+    const auto& hit = scratch.hits[i];
+    hits.push_back(b2SectorSweepHit<T>{ hit.id->template GetUserData<T>(), hit.toi });
+  }
 
-    // ġ attach    ͵鿡 ߰.
-    int cnt = ApplyNeighbors(ix, iy, [this, &aabb, &objects, &sobjs](b2Sector* sector) {
-      if (sector->IsOverlapping(aabb))
-      {
-        std::vector<int32> lst;
-        sector->Query(aabb, lst);
+  return hitCount;
+}
 
-        for (auto& proxy : lst)
-        {
-          auto o = sector->GetObject(proxy);
-          sobjs.insert(o->GetObjectId());
-        }
+template <typename T>
+int b2SectorGrid::KNearest(const b2Vec2& point, int k, const b2Filter& filter, std::vector<b2SectorNearest<T>>& results)
+{
+  static thread_local b2SectorQueryScratch scratch;
 
-        return true;
-      }
+  int count = QueryNearestObjects(point, k, b2_maxFloat, filter, scratch);
 
-      return false;
-      });
+  for (const auto& nearest : scratch.nearest)
+  {
+    results.push_back(b2SectorNearest<T>{ nearest.id->template GetUserData<T>(), nearest.distance });
+  }
 
-    // detailed collision filtering
+  return count;
+}
 
-    for (auto& oid : sobjs)
-    {
-      auto iter = m_objects.find(oid);
-      if (iter != m_objects.end())
-      {
-        auto obj2 = iter->second;
+template <typename T>
+int b2SectorGrid::KNearest(b2ObjectId oid, int k, const b2Filter& filter, std::vector<b2SectorNearest<T>>& results)
+{
+  static thread_local b2SectorQueryScratch scratch;
 
-        if (ShouldCollide(collider.GetFilter(), obj2->GetFilter()))
-        {
-          auto col = b2TestOverlap(
-            collider.GetShape(), 0, obj2->GetShape(), 0, collider.GetTransform(), obj2->GetTransform()
-          );
-
-          if (col)
-          {
-            const T value = obj2->GetUserData<T>();
-            objects.push_back(value);
-          }
-        }
-      }
-    }
+  int count = QueryNearestObjects(oid, k, b2_maxFloat, filter, scratch);
+
+  for (const auto& nearest : scratch.nearest)
+  {
+    results.push_back(b2SectorNearest<T>{ nearest.id->template GetUserData<T>(), nearest.distance });
   }
 
-  return static_cast<int>(objects.size());
+  return count;
 }
 
 template <typename T>
-int b2SectorGrid::Query(const b2AABB& aabb, std::vector<T>& objects)
+int b2SectorGrid::QueryRadiusSorted(
+  const b2Vec2& point, float radius, const b2Filter& filter, std::vector<b2SectorNearest<T>>& results)
 {
-  int ix = GetSectorIndexX(aabb.GetCenter().x);
-  int iy = GetSectorIndexX(aabb.GetCenter().y);
+  static thread_local b2SectorQueryScratch scratch;
+
+  int count = QueryNearestObjects(point, INT_MAX, radius, filter, scratch);
 
-  b2Assert(ix >= 1 && iy >= 1);
+  for (const auto& nearest : scratch.nearest)
+  {
+    results.push_back(b2SectorNearest<T>{ nearest.id->template GetUserData<T>(), nearest.distance });
+  }
 
-  int overlapCount = 0;
+  return count;
+}
 
-  // slock
+template <typename T>
+int b2SectorGrid::QueryRadiusSorted(
+  b2ObjectId oid, float radius, const b2Filter& filter, std::vector<b2SectorNearest<T>>& results)
+{
+  static thread_local b2SectorQueryScratch scratch;
+
+  int count = QueryNearestObjects(oid, INT_MAX, radius, filter, scratch);
+
+  for (const auto& nearest : scratch.nearest)
   {
-    rx::slock slock(m_lock);
+    results.push_back(b2SectorNearest<T>{ nearest.id->template GetUserData<T>(), nearest.distance });
+  }
 
-    // ġ attach    ͵鿡 ߰.
-    int cnt = ApplyNeighbors(ix, iy, [this, &aabb, &objects, &overlapCount](b2Sector* sector) {
-      if (sector->IsOverlapping(aabb))
-      {
-        std::vector<int32> lst;
-        sector->Query(aabb, lst);
+  return count;
+}
 
-        for (auto& proxy : lst)
-        {
-          auto obj = sector->GetObject(proxy);
-          objects.push_back(reinterpret_cast<T>(*obj->GetUserData()));
-          ++overlapCount;
-        }
+template <typename T>
+int b2SectorGrid::Query(const b2AABB& aabb, std::vector<T>& objects)
+{
+  static thread_local b2SectorQueryScratch scratch;
 
-        return true;
-      }
+  int overlapCount = QueryObjects(aabb, scratch);
 
-      return false;
-      });
+  for (int i = 0; i < overlapCount; ++i)
+  {
+    objects.push_back(scratch.objects[i]->template GetUserData<T>());
   }
 
   return overlapCount;
@@ -383,7 +1098,7 @@ int b2SectorGrid::QueryCircle(const b2Vec2& pos, float radius, const b2Filter& f
   circle.m_radius = radius;
   circle.m_p = pos;
 
-  b2SectorCollider collider(&circle, filter, b2Transform(b2Vec2(0, 0)));
+  b2SectorCollider collider(&circle, filter, b2Transform(b2Vec2(0, 0), b2Rot(0.0f)));
   return Query(collider, objects);
 }
 
@@ -393,8 +1108,71 @@ int b2SectorGrid::QueryOBB(float hx, float hy, const b2Vec2& pos, float angle, c
   b2PolygonShape obb; 
   obb.SetAsBox(hx, hy, pos, angle);
 
-  b2SectorCollider collider(&circle, filter, b2Transform(b2Vec2(0, 0)));
-  return Query(cobj, objects);
+  b2SectorCollider collider(&obb, filter, b2Transform(b2Vec2(0, 0), b2Rot(0.0f)));
+  return Query(collider, objects);
+}
+
+template <typename T>
+void b2SectorGrid::QueryBatch(
+  const b2SectorCollider* colliders, int count, 
+  int workerCount, const b2SectorTaskExecutor& executor, b2SectorQueryBatch<T>& batch)
+{
+  if (!executor || workerCount < 1)
+  {
+    workerCount = 1;
+  }
+
+  batch.workers.resize(workerCount);
+
+  auto task = [this, colliders, count, workerCount, &batch](int workerIndex) {
+    auto& worker = batch.workers[workerIndex];
+    worker.counts.clear();
+    worker.ids.clear();
+
+    int begin = static_cast<int>(static_cast<int64_t>(count) * workerIndex / workerCount);
+    int end = static_cast<int>(static_cast<int64_t>(count) * (workerIndex + 1) / workerCount);
+
+    for (int i = begin; i < end; ++i)
+    {
+      int hitCount = QueryObjects(colliders[i], worker.scratch);
+
+      for (int k = 0; k < hitCount; ++k)
+      {
+        worker.ids.push_back(worker.scratch.objects[k]->template GetUserData<T>());
+      }
+
+      worker.counts.push_back(hitCount);
+    }
+  };
+
+  if (executor && workerCount > 1)
+  {
+    executor(workerCount, task);
+  }
+  else
+  {
+    task(0);
+  }
+
+  // Ŀ  colliders ̹Ƿ ̾ ̸ ȴ.
+  batch.offsets.resize(count + 1);
+  batch.ids.clear();
+
+  int index = 0;
+  batch.offsets[0] = 0;
+
+  for (auto& worker : batch.workers)
+  {
+    for (auto hitCount : worker.counts)
+    {
+      batch.offsets[index + 1] = batch.offsets[index] + hitCount;
+      ++index;
+    }
+
+    batch.ids.insert(batch.ids.end(), worker.ids.begin(), worker.ids.end());
+  }
+
+  b2Assert(index == count);
 }
 
 inline bool b2SectorGrid::ShouldCollide(const b2Filter& filterA, const b2Filter& filterB)
@@ -408,4 +1186,9 @@ inline bool b2SectorGrid::ShouldCollide(const b2Filter& filterA, const b2Filter&
   return collide;
 }
 
+inline uint16 b2SectorGrid::GetMaskBits(const b2Filter& filter)
+{
+  return filter.groupIndex > 0 ? 0xFFFF : filter.maskBits;
+}
+
 #endif //B2_SECTOR_GRID_H
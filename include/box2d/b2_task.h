@@ -0,0 +1,56 @@
+// MIT License
+
+// Copyright (c) 2019 Erin Catto
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#ifndef B2_TASK_H
+#define B2_TASK_H
+
+#include "b2_api.h"
+#include "b2_settings.h"
+
+/// A unit of work split into independent parts.
+class B2_API b2Task
+{
+public:
+	virtual ~b2Task() {}
+
+	/// Run one part. Different parts may run at the same time on different threads.
+	virtual void Execute(int32 partIndex) = 0;
+};
+
+/// Implement this to let Box2D run work on your own threads, for example
+/// a job system the game already has. The executor is owned by you and
+/// must remain in scope.
+class B2_API b2TaskExecutor
+{
+public:
+	virtual ~b2TaskExecutor() {}
+
+	/// The number of threads that can run parts at the same time. This is used
+	/// to decide how finely work is split.
+	virtual int32 GetWorkerCount() const = 0;
+
+	/// Call task->Execute(i) once for every i in [0, partCount), in any order and
+	/// on any threads, and return when all calls have finished.
+	virtual void Run(b2Task* task, int32 partCount) = 0;
+};
+
+#endif
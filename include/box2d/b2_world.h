@@ -66,6 +66,11 @@ public:
 	/// remain in scope.
 	void SetContactListener(b2ContactListener* listener);
 
+	/// Register an executor that runs the broad-phase pair queries on your threads.
+	/// Contacts are still created on the thread calling Step, in the same order.
+	/// The executor is owned by you and must remain in scope.
+	void SetTaskExecutor(b2TaskExecutor* executor);
+
 	/// Register a routine for debug drawing. The debug draw functions are called
 	/// inside with b2World::DebugDraw method. The debug draw object is owned
 	/// by you and must remain in scope.
@@ -162,6 +167,12 @@ public:
 	void SetSubStepping(bool flag) { m_subStepping = flag; }
 	bool GetSubStepping() const { return m_subStepping; }
 
+	/// Set how much work each step may spend on improving the broad-phase tree.
+	/// Zero turns this off, a few thousand keeps busy trees close to a fresh build.
+	/// See b2DynamicTree::Optimize.
+	void SetTreeOptimizeBudget(int32 nodeBudget) { m_treeOptimizeBudget = nodeBudget; }
+	int32 GetTreeOptimizeBudget() const { return m_treeOptimizeBudget; }
+
 	/// Get the number of broad-phase proxies.
 	int32 GetProxyCount() const;
 
@@ -174,7 +185,8 @@ public:
 	/// Get the number of contacts (each may have 0 or more contact points).
 	int32 GetContactCount() const;
 
-	/// Get the height of the dynamic tree.
+	/// Get the height of the dynamic tree. Static and moving fixtures have separate
+	/// trees, this and the functions below report the worse of the two.
 	int32 GetTreeHeight() const;
 
 	/// Get the balance of the dynamic tree.
@@ -256,6 +268,8 @@ private:
 	bool m_continuousPhysics;
 	bool m_subStepping;
 
+	int32 m_treeOptimizeBudget;
+
 	bool m_stepComplete;
 
 	b2Profile m_profile;
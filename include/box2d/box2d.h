@@ -27,6 +27,7 @@
 
 #include "b2_settings.h"
 #include "b2_draw.h"
+#include "b2_task.h"
 #include "b2_timer.h"
 
 #include "b2_chain_shape.h"
@@ -12,15 +12,17 @@
 #include <array>
 #include <cassert>
 #include <cstdint>
-#include <exception>
+#include <stdexcept>
+#include <string>
+#include <thread>
 
 namespace rx {
 
-class lock_exception : public std::exception
+class lock_exception : public std::runtime_error
 {
 public: 
   lock_exception(const char* what) 
-    : std::exception(what)
+    : std::runtime_error(what)
   {}
 };
 
@@ -8,8 +8,10 @@
 
 #include <cassert>
 #include <atomic>
+#include <chrono>
 #include <shared_mutex>
 #include <string_view>
+#include <thread>
 
 namespace rx {
 
@@ -23,9 +23,35 @@
 #include "box2d/b2_broad_phase.h"
 #include <string.h>
 
+// Below this many moved proxies per part the task overhead outweighs the queries.
+static const int32 b2_minMovesPerPart = 64;
+
+// Queries one slice of the move buffer per part into the part's own pair buffer.
+class b2PairTask : public b2Task
+{
+public:
+	b2PairTask(const b2BroadPhase* broadPhase, int32 partSize)
+		: m_broadPhase(broadPhase), m_partSize(partSize)
+	{
+	}
+
+	void Execute(int32 partIndex) override
+	{
+		int32 begin = partIndex * m_partSize;
+		int32 end = b2Min(begin + m_partSize, m_broadPhase->m_moveCount);
+		m_broadPhase->FindPairs(begin, end, m_broadPhase->m_partBuffers + partIndex);
+	}
+
+private:
+	const b2BroadPhase* m_broadPhase;
+	int32 m_partSize;
+};
+
 b2BroadPhase::b2BroadPhase()
 {
 	m_proxyCount = 0;
+	m_staticProxyCount = 0;
+	m_staticInsertCount = 0;
 
 	m_pairCapacity = 16;
 	m_pairCount = 0;
@@ -34,34 +60,84 @@ b2BroadPhase::b2BroadPhase()
 	m_moveCapacity = 16;
 	m_moveCount = 0;
 	m_moveBuffer = (int32*)b2Alloc(m_moveCapacity * sizeof(int32));
+
+	m_taskExecutor = nullptr;
+	m_partBuffers = nullptr;
+	m_partCapacity = 0;
 }
 
 b2BroadPhase::~b2BroadPhase()
 {
+	for (int32 i = 0; i < m_partCapacity; ++i)
+	{
+		b2Free(m_partBuffers[i].pairs);
+	}
+
+	b2Free(m_partBuffers);
 	b2Free(m_moveBuffer);
 	b2Free(m_pairBuffer);
 }
 
-int32 b2BroadPhase::CreateProxy(const b2AABB& aabb, void* userData)
+void b2BroadPhase::SetTaskExecutor(b2TaskExecutor* executor)
+{
+	m_taskExecutor = executor;
+}
+
+int32 b2BroadPhase::CreateProxy(const b2AABB& aabb, void* userData, ProxyType type)
 {
-	int32 proxyId = m_tree.CreateProxy(aabb, userData);
+	int32 proxyId = GetProxyId(m_trees[type].CreateProxy(aabb, userData), type);
 	++m_proxyCount;
+
+	if (type == e_staticProxy)
+	{
+		++m_staticProxyCount;
+		++m_staticInsertCount;
+	}
+
 	BufferMove(proxyId);
 	return proxyId;
 }
 
+void b2BroadPhase::CreateProxies(const b2TreeProxyDef* defs, int32 count, int32* proxyIds, ProxyType type)
+{
+	m_trees[type].CreateProxies(defs, count, proxyIds);
+	m_proxyCount += count;
+
+	if (type == e_staticProxy)
+	{
+		m_staticProxyCount += count;
+	}
+
+	for (int32 i = 0; i < count; ++i)
+	{
+		proxyIds[i] = GetProxyId(proxyIds[i], type);
+		BufferMove(proxyIds[i]);
+	}
+}
+
 void b2BroadPhase::DestroyProxy(int32 proxyId)
 {
 	UnBufferMove(proxyId);
 	--m_proxyCount;
-	m_tree.DestroyProxy(proxyId);
+
+	if ((proxyId & 1) == e_staticProxy)
+	{
+		--m_staticProxyCount;
+	}
+
+	m_trees[proxyId & 1].DestroyProxy(GetNodeId(proxyId));
 }
 
 void b2BroadPhase::MoveProxy(int32 proxyId, const b2AABB& aabb, const b2Vec2& displacement)
 {
-	bool buffer = m_tree.MoveProxy(proxyId, aabb, displacement);
+	bool buffer = m_trees[proxyId & 1].MoveProxy(GetNodeId(proxyId), aabb, displacement);
 	if (buffer)
 	{
+		if ((proxyId & 1) == e_staticProxy)
+		{
+			++m_staticInsertCount;
+		}
+
 		BufferMove(proxyId);
 	}
 }
@@ -71,6 +147,17 @@ void b2BroadPhase::TouchProxy(int32 proxyId)
 	BufferMove(proxyId);
 }
 
+void b2BroadPhase::RebuildStaticTree()
+{
+	m_trees[e_staticProxy].RebuildTopDown();
+	m_staticInsertCount = 0;
+}
+
+int32 b2BroadPhase::Optimize(int32 nodeBudget)
+{
+	return m_trees[e_movableProxy].Optimize(nodeBudget);
+}
+
 void b2BroadPhase::BufferMove(int32 proxyId)
 {
 	if (m_moveCount == m_moveCapacity)
@@ -97,35 +184,151 @@ void b2BroadPhase::UnBufferMove(int32 proxyId)
 	}
 }
 
-// This is called from b2DynamicTree::Query when we are gathering pairs.
-bool b2BroadPhase::QueryCallback(int32 proxyId)
+void b2BroadPhase::FindPairs(int32 begin, int32 end, PairBuffer* buffer) const
+{
+	// The query state is on the stack so that several slices can be queried at once.
+	struct PairQuery
+	{
+		bool QueryCallback(int32 nodeId)
+		{
+			int32 proxyId = GetProxyId(nodeId, type);
+
+			// A proxy cannot form a pair with itself.
+			if (proxyId == queryProxyId)
+			{
+				return true;
+			}
+
+			const bool moved = trees[type].WasMoved(nodeId);
+			if (moved && proxyId > queryProxyId)
+			{
+				// Both proxies are moving. Avoid duplicate pairs.
+				return true;
+			}
+
+			// Grow the pair buffer as needed.
+			if (buffer->count == buffer->capacity)
+			{
+				b2Pair* oldBuffer = buffer->pairs;
+				buffer->capacity = buffer->capacity + (buffer->capacity >> 1);
+				buffer->pairs = (b2Pair*)b2Alloc(buffer->capacity * sizeof(b2Pair));
+				memcpy(buffer->pairs, oldBuffer, buffer->count * sizeof(b2Pair));
+				b2Free(oldBuffer);
+			}
+
+			buffer->pairs[buffer->count].proxyIdA = b2Min(proxyId, queryProxyId);
+			buffer->pairs[buffer->count].proxyIdB = b2Max(proxyId, queryProxyId);
+			++buffer->count;
+
+			return true;
+		}
+
+		const b2DynamicTree* trees;
+		PairBuffer* buffer;
+		int32 queryProxyId;
+		int32 type;
+	};
+
+	PairQuery query = { m_trees, buffer, e_nullProxy, e_movableProxy };
+
+	for (int32 i = begin; i < end; ++i)
+	{
+		query.queryProxyId = m_moveBuffer[i];
+		if (query.queryProxyId == e_nullProxy)
+		{
+			continue;
+		}
+
+		// We have to query the tree with the fat AABB so that
+		// we don't fail to create a pair that may touch later.
+		const b2AABB& fatAABB = GetFatAABB(query.queryProxyId);
+
+		query.type = e_movableProxy;
+		m_trees[e_movableProxy].Query(&query, fatAABB);
+
+		// Static proxies never pair with each other.
+		if ((query.queryProxyId & 1) == e_movableProxy)
+		{
+			query.type = e_staticProxy;
+			m_trees[e_staticProxy].Query(&query, fatAABB);
+		}
+	}
+}
+
+void b2BroadPhase::FindNewPairs()
 {
-	// A proxy cannot form a pair with itself.
-	if (proxyId == m_queryProxyId)
+	m_pairCount = 0;
+
+	// Static proxies inserted one at a time degrade the static tree. Rebuild it once
+	// they make up a good part of it, typically once after a level is loaded.
+	if (m_staticInsertCount >= b2_minBulkProxyCount && 8 * m_staticInsertCount >= m_staticProxyCount)
 	{
-		return true;
+		RebuildStaticTree();
 	}
 
-	const bool moved = m_tree.WasMoved(proxyId);
-	if (moved && proxyId > m_queryProxyId)
+	int32 workerCount = m_taskExecutor != nullptr ? m_taskExecutor->GetWorkerCount() : 1;
+
+	// A few parts per worker keeps the workers busy when some slices have more pairs.
+	int32 partCount = b2Min(4 * workerCount, (m_moveCount + b2_minMovesPerPart - 1) / b2_minMovesPerPart);
+
+	if (workerCount <= 1 || partCount <= 1)
 	{
-		// Both proxies are moving. Avoid duplicate pairs.
-		return true;
+		PairBuffer buffer = { m_pairBuffer, m_pairCapacity, 0 };
+		FindPairs(0, m_moveCount, &buffer);
+
+		m_pairBuffer = buffer.pairs;
+		m_pairCapacity = buffer.capacity;
+		m_pairCount = buffer.count;
+		return;
 	}
 
-	// Grow the pair buffer as needed.
-	if (m_pairCount == m_pairCapacity)
+	// Part buffers are kept between steps so that they only grow.
+	if (partCount > m_partCapacity)
 	{
-		b2Pair* oldBuffer = m_pairBuffer;
-		m_pairCapacity = m_pairCapacity + (m_pairCapacity >> 1);
-		m_pairBuffer = (b2Pair*)b2Alloc(m_pairCapacity * sizeof(b2Pair));
-		memcpy(m_pairBuffer, oldBuffer, m_pairCount * sizeof(b2Pair));
-		b2Free(oldBuffer);
+		PairBuffer* oldBuffers = m_partBuffers;
+		m_partBuffers = (PairBuffer*)b2Alloc(partCount * sizeof(PairBuffer));
+		if (oldBuffers)
+		{
+			memcpy(m_partBuffers, oldBuffers, m_partCapacity * sizeof(PairBuffer));
+			b2Free(oldBuffers);
+		}
+
+		for (int32 i = m_partCapacity; i < partCount; ++i)
+		{
+			m_partBuffers[i].capacity = 16;
+			m_partBuffers[i].pairs = (b2Pair*)b2Alloc(m_partBuffers[i].capacity * sizeof(b2Pair));
+		}
+
+		m_partCapacity = partCount;
+	}
+
+	for (int32 i = 0; i < partCount; ++i)
+	{
+		m_partBuffers[i].count = 0;
 	}
 
-	m_pairBuffer[m_pairCount].proxyIdA = b2Min(proxyId, m_queryProxyId);
-	m_pairBuffer[m_pairCount].proxyIdB = b2Max(proxyId, m_queryProxyId);
-	++m_pairCount;
+	int32 partSize = (m_moveCount + partCount - 1) / partCount;
+	b2PairTask task(this, partSize);
+	m_taskExecutor->Run(&task, partCount);
+
+	// Parts are contiguous slices of the move buffer, so appending them in part
+	// order gives the same pairs in the same order as the serial queries.
+	int32 pairCount = 0;
+	for (int32 i = 0; i < partCount; ++i)
+	{
+		pairCount += m_partBuffers[i].count;
+	}
 
-	return true;
+	if (pairCount > m_pairCapacity)
+	{
+		b2Free(m_pairBuffer);
+		m_pairCapacity = pairCount + (pairCount >> 1);
+		m_pairBuffer = (b2Pair*)b2Alloc(m_pairCapacity * sizeof(b2Pair));
+	}
+
+	for (int32 i = 0; i < partCount; ++i)
+	{
+		memcpy(m_pairBuffer + m_pairCount, m_partBuffers[i].pairs, m_partBuffers[i].count * sizeof(b2Pair));
+		m_pairCount += m_partBuffers[i].count;
+	}
 }
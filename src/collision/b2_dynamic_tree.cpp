@@ -20,7 +20,19 @@
 // OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
 // SOFTWARE.
 #include "box2d/b2_dynamic_tree.h"
+#include "b2_wide_node.h"
 #include <string.h>
+#include <algorithm>
+
+int32 b2WideOverlap(const b2WideNode& node, const b2AABB& aabb)
+{
+	return b2WideOverlapLanes(node, aabb);
+}
+
+int32 b2WideSegmentAxis(const b2WideNode& node, const b2Vec2& p1, const b2Vec2& v, const b2Vec2& abs_v)
+{
+	return b2WideSegmentAxisLanes(node, p1, v, abs_v);
+}
 
 b2DynamicTree::b2DynamicTree()
 {
@@ -42,12 +54,27 @@ b2DynamicTree::b2DynamicTree()
 	m_freeList = 0;
 
 	m_insertionCount = 0;
+
+	m_optimizeDebt = 0;
+
+	m_rebuildLeaves = nullptr;
+	m_rebuildLeafCount = 0;
+	m_rebuildSplits = nullptr;
+	m_rebuildSplitCount = 0;
+	m_rebuildRanges = nullptr;
+	m_rebuildRangeCount = 0;
+
+	m_wideNodes = nullptr;
+	m_wideCapacity = 0;
+	m_wideValid = false;
 }
 
 b2DynamicTree::~b2DynamicTree()
 {
 	// This frees the entire tree in one shot.
 	b2Free(m_nodes);
+	b2Free(m_wideNodes);
+	CancelRebuild();
 }
 
 // Allocate a node from the pool. Grow the pool if necessary.
@@ -85,6 +112,7 @@ int32 b2DynamicTree::AllocateNode()
 	m_nodes[nodeId].child2 = b2_nullNode;
 	m_nodes[nodeId].height = 0;
 	m_nodes[nodeId].userData = nullptr;
+	m_nodes[nodeId].categoryBits = 0;
 	m_nodes[nodeId].moved = false;
 	++m_nodeCount;
 	return nodeId;
@@ -104,7 +132,7 @@ void b2DynamicTree::FreeNode(int32 nodeId)
 // Create a proxy in the tree as a leaf node. We return the index
 // of the node instead of a pointer so that we can grow
 // the node pool.
-int32 b2DynamicTree::CreateProxy(const b2AABB& aabb, void* userData)
+int32 b2DynamicTree::CreateProxy(const b2AABB& aabb, void* userData, uint16 categoryBits)
 {
 	int32 proxyId = AllocateNode();
 
@@ -113,6 +141,7 @@ int32 b2DynamicTree::CreateProxy(const b2AABB& aabb, void* userData)
 	m_nodes[proxyId].aabb.lowerBound = aabb.lowerBound - r;
 	m_nodes[proxyId].aabb.upperBound = aabb.upperBound + r;
 	m_nodes[proxyId].userData = userData;
+	m_nodes[proxyId].categoryBits = categoryBits;
 	m_nodes[proxyId].height = 0;
 	m_nodes[proxyId].moved = true;
 
@@ -121,6 +150,289 @@ int32 b2DynamicTree::CreateProxy(const b2AABB& aabb, void* userData)
 	return proxyId;
 }
 
+void b2DynamicTree::CreateProxies(const b2TreeProxyDef* defs, int32 count, int32* proxyIds)
+{
+	if (count == 0)
+	{
+		return;
+	}
+
+	b2Vec2 r(b2_aabbExtension, b2_aabbExtension);
+	for (int32 i = 0; i < count; ++i)
+	{
+		int32 proxyId = AllocateNode();
+
+		// Fatten the aabb.
+		m_nodes[proxyId].aabb.lowerBound = defs[i].aabb.lowerBound - r;
+		m_nodes[proxyId].aabb.upperBound = defs[i].aabb.upperBound + r;
+		m_nodes[proxyId].userData = defs[i].userData;
+		m_nodes[proxyId].categoryBits = defs[i].categoryBits;
+		m_nodes[proxyId].height = 0;
+		m_nodes[proxyId].moved = true;
+
+		proxyIds[i] = proxyId;
+	}
+
+	int32 subtree = BuildTopDown(proxyIds, count);
+
+	m_insertionCount += count - 1;
+
+	// InsertLeaf only needs the box, height and category bits of the node, so it can
+	// insert the whole subtree and rebalance above it.
+	InsertLeaf(subtree);
+}
+
+// A leaf being partitioned by the top-down build.
+struct b2BuildLeaf
+{
+	b2AABB aabb;
+	b2Vec2 center;
+	int32 nodeId;
+	int32 bin;
+};
+
+// Partition leaves into two non-empty groups and return the size of the first one.
+// The split minimizes the summed perimeter of both halves weighted by their leaf counts.
+// Small groups try every split along the longest axis of the centers, larger ones
+// only the boundaries of 16 bins.
+static int32 b2SplitLeaves(b2BuildLeaf* leaves, int32 count)
+{
+	b2Assert(count >= 2);
+
+	if (count == 2)
+	{
+		return 1;
+	}
+
+	b2Vec2 lower = leaves[0].center;
+	b2Vec2 upper = lower;
+	for (int32 i = 1; i < count; ++i)
+	{
+		lower = b2Min(lower, leaves[i].center);
+		upper = b2Max(upper, leaves[i].center);
+	}
+
+	int32 axis = (upper.x - lower.x) >= (upper.y - lower.y) ? 0 : 1;
+	float minC = lower(axis);
+	float extent = upper(axis) - minC;
+
+	const int32 binCount = 16;
+	float scale = extent > 0.0f ? binCount / extent : 0.0f;
+
+	if (scale <= 0.0f || b2IsValid(scale) == false)
+	{
+		// All centers coincide, any split is as good as another.
+		return count / 2;
+	}
+
+	if (count <= binCount)
+	{
+		std::sort(leaves, leaves + count, [axis](const b2BuildLeaf& a, const b2BuildLeaf& b)
+		{
+			return a.center(axis) < b.center(axis);
+		});
+
+		b2AABB rightBoxes[binCount];
+		rightBoxes[count - 1] = leaves[count - 1].aabb;
+		for (int32 i = count - 2; i > 0; --i)
+		{
+			rightBoxes[i].Combine(rightBoxes[i + 1], leaves[i].aabb);
+		}
+
+		int32 bestCount = 1;
+		float bestCost = FLT_MAX;
+		b2AABB leftBox = leaves[0].aabb;
+		for (int32 i = 1; i < count; ++i)
+		{
+			float cost = i * leftBox.GetPerimeter() + (count - i) * rightBoxes[i].GetPerimeter();
+			if (cost < bestCost)
+			{
+				bestCost = cost;
+				bestCount = i;
+			}
+
+			leftBox.Combine(leaves[i].aabb);
+		}
+
+		return bestCount;
+	}
+
+	int32 binLeafCounts[binCount] = {};
+	b2AABB binBoxes[binCount];
+
+	for (int32 i = 0; i < count; ++i)
+	{
+		b2BuildLeaf& leaf = leaves[i];
+		int32 bin = b2Min(int32((leaf.center(axis) - minC) * scale), binCount - 1);
+		leaf.bin = bin;
+
+		if (binLeafCounts[bin] == 0)
+		{
+			binBoxes[bin] = leaf.aabb;
+		}
+		else
+		{
+			binBoxes[bin].Combine(leaf.aabb);
+		}
+		++binLeafCounts[bin];
+	}
+
+	// Sweep from the right to get the cost of every right half.
+	float rightCosts[binCount];
+	int32 rightCount = 0;
+	b2AABB rightBox;
+	for (int32 i = binCount - 1; i > 0; --i)
+	{
+		if (binLeafCounts[i] > 0)
+		{
+			if (rightCount == 0)
+			{
+				rightBox = binBoxes[i];
+			}
+			else
+			{
+				rightBox.Combine(binBoxes[i]);
+			}
+			rightCount += binLeafCounts[i];
+		}
+		rightCosts[i] = rightCount > 0 ? rightCount * rightBox.GetPerimeter() : 0.0f;
+	}
+
+	// Sweep from the left and pick the cheapest split with leaves on both sides.
+	// The first and last bins hold the extreme centers, so such a split exists.
+	int32 bestBin = 0;
+	float bestCost = FLT_MAX;
+	int32 leftCount = 0;
+	b2AABB leftBox;
+	for (int32 i = 0; i < binCount - 1; ++i)
+	{
+		if (binLeafCounts[i] > 0)
+		{
+			if (leftCount == 0)
+			{
+				leftBox = binBoxes[i];
+			}
+			else
+			{
+				leftBox.Combine(binBoxes[i]);
+			}
+			leftCount += binLeafCounts[i];
+		}
+
+		if (leftCount == 0 || leftCount == count)
+		{
+			continue;
+		}
+
+		float cost = leftCount * leftBox.GetPerimeter() + rightCosts[i + 1];
+		if (cost < bestCost)
+		{
+			bestCost = cost;
+			bestBin = i;
+		}
+	}
+
+	b2BuildLeaf* mid = std::partition(leaves, leaves + count, [bestBin](const b2BuildLeaf& leaf)
+	{
+		return leaf.bin <= bestBin;
+	});
+
+	int32 leftSize = int32(mid - leaves);
+	b2Assert(0 < leftSize && leftSize < count);
+	return leftSize;
+}
+
+// Build a subtree over the given leaves and return its root.
+int32 b2DynamicTree::BuildTopDown(const int32* leafIds, int32 count)
+{
+	b2Assert(count > 0);
+
+	if (count == 1)
+	{
+		m_nodes[leafIds[0]].parent = b2_nullNode;
+		return leafIds[0];
+	}
+
+	b2BuildLeaf* leaves = (b2BuildLeaf*)b2Alloc(count * sizeof(b2BuildLeaf));
+	for (int32 i = 0; i < count; ++i)
+	{
+		leaves[i].aabb = m_nodes[leafIds[i]].aabb;
+		leaves[i].center = leaves[i].aabb.GetCenter();
+		leaves[i].nodeId = leafIds[i];
+	}
+
+	// A binary tree with count leaves has count - 1 internal nodes. They are created
+	// parents first, so their boxes can be filled afterwards in reverse order.
+	int32* internals = (int32*)b2Alloc((count - 1) * sizeof(int32));
+	int32 internalCount = 0;
+
+	struct Range
+	{
+		int32 begin;
+		int32 count;
+		int32 parent;
+		bool isChild1;
+	};
+
+	b2GrowableStack<Range, 256> stack;
+	stack.Push({ 0, count, b2_nullNode, false });
+
+	int32 root = b2_nullNode;
+	while (stack.GetCount() > 0)
+	{
+		Range range = stack.Pop();
+
+		int32 nodeId;
+		if (range.count == 1)
+		{
+			nodeId = leaves[range.begin].nodeId;
+		}
+		else
+		{
+			int32 leftCount = b2SplitLeaves(leaves + range.begin, range.count);
+
+			nodeId = AllocateNode();
+			m_nodes[nodeId].userData = nullptr;
+			m_nodes[nodeId].moved = false;
+			internals[internalCount++] = nodeId;
+
+			stack.Push({ range.begin + leftCount, range.count - leftCount, nodeId, false });
+			stack.Push({ range.begin, leftCount, nodeId, true });
+		}
+
+		m_nodes[nodeId].parent = range.parent;
+		if (range.parent == b2_nullNode)
+		{
+			root = nodeId;
+		}
+		else if (range.isChild1)
+		{
+			m_nodes[range.parent].child1 = nodeId;
+		}
+		else
+		{
+			m_nodes[range.parent].child2 = nodeId;
+		}
+	}
+
+	b2Assert(internalCount == count - 1);
+
+	for (int32 i = internalCount - 1; i >= 0; --i)
+	{
+		b2TreeNode* node = m_nodes + internals[i];
+		const b2TreeNode* child1 = m_nodes + node->child1;
+		const b2TreeNode* child2 = m_nodes + node->child2;
+		node->aabb.Combine(child1->aabb, child2->aabb);
+		node->height = 1 + b2Max(child1->height, child2->height);
+		node->categoryBits = child1->categoryBits | child2->categoryBits;
+	}
+
+	b2Free(internals);
+	b2Free(leaves);
+
+	return root;
+}
+
 void b2DynamicTree::DestroyProxy(int32 proxyId)
 {
 	b2Assert(0 <= proxyId && proxyId < m_nodeCapacity);
@@ -130,12 +442,9 @@ void b2DynamicTree::DestroyProxy(int32 proxyId)
 	FreeNode(proxyId);
 }
 
-bool b2DynamicTree::MoveProxy(int32 proxyId, const b2AABB& aabb, const b2Vec2& displacement)
+// Extend the AABB and predict its movement.
+static b2AABB b2ComputeFatAABB(const b2AABB& aabb, const b2Vec2& displacement)
 {
-	b2Assert(0 <= proxyId && proxyId < m_nodeCapacity);
-
-	b2Assert(m_nodes[proxyId].IsLeaf());
-
 	// Extend AABB
 	b2AABB fatAABB;
 	b2Vec2 r(b2_aabbExtension, b2_aabbExtension);
@@ -163,29 +472,51 @@ bool b2DynamicTree::MoveProxy(int32 proxyId, const b2AABB& aabb, const b2Vec2& d
 		fatAABB.upperBound.y += d.y;
 	}
 
+	return fatAABB;
+}
+
+bool b2DynamicTree::IsProxyFit(int32 proxyId, const b2AABB& aabb, const b2Vec2& displacement) const
+{
+	b2Assert(0 <= proxyId && proxyId < m_nodeCapacity);
+
+	b2Assert(m_nodes[proxyId].IsLeaf());
+
 	const b2AABB& treeAABB = m_nodes[proxyId].aabb;
-	if (treeAABB.Contains(aabb))
+	if (treeAABB.Contains(aabb) == false)
 	{
-		// The tree AABB still contains the object, but it might be too large.
-		// Perhaps the object was moving fast but has since gone to sleep.
-		// The huge AABB is larger than the new fat AABB.
-		b2AABB hugeAABB;
-		hugeAABB.lowerBound = fatAABB.lowerBound - 4.0f * r;
-		hugeAABB.upperBound = fatAABB.upperBound + 4.0f * r;
+		return false;
+	}
 
-		if (hugeAABB.Contains(treeAABB))
-		{
-			// The tree AABB contains the object AABB and the tree AABB is
-			// not too large. No tree update needed.
-			return false;
-		}
+	// The tree AABB still contains the object, but it might be too large.
+	// Perhaps the object was moving fast but has since gone to sleep.
+	// The huge AABB is larger than the new fat AABB.
+	b2AABB fatAABB = b2ComputeFatAABB(aabb, displacement);
+	b2Vec2 r(b2_aabbExtension, b2_aabbExtension);
+
+	b2AABB hugeAABB;
+	hugeAABB.lowerBound = fatAABB.lowerBound - 4.0f * r;
+	hugeAABB.upperBound = fatAABB.upperBound + 4.0f * r;
+
+	// The tree AABB contains the object AABB and the tree AABB is
+	// not too large. No tree update needed.
+	return hugeAABB.Contains(treeAABB);
+}
+
+bool b2DynamicTree::MoveProxy(int32 proxyId, const b2AABB& aabb, const b2Vec2& displacement)
+{
+	b2Assert(0 <= proxyId && proxyId < m_nodeCapacity);
+
+	b2Assert(m_nodes[proxyId].IsLeaf());
 
-		// Otherwise the tree AABB is huge and needs to be shrunk
+	if (IsProxyFit(proxyId, aabb, displacement))
+	{
+		return false;
 	}
 
+	// Otherwise the tree AABB is outside or huge and needs to be reinserted
 	RemoveLeaf(proxyId);
 
-	m_nodes[proxyId].aabb = fatAABB;
+	m_nodes[proxyId].aabb = b2ComputeFatAABB(aabb, displacement);
 
 	InsertLeaf(proxyId);
 
@@ -197,6 +528,8 @@ bool b2DynamicTree::MoveProxy(int32 proxyId, const b2AABB& aabb, const b2Vec2& d
 void b2DynamicTree::InsertLeaf(int32 leaf)
 {
 	++m_insertionCount;
+	++m_optimizeDebt;
+	m_wideValid = false;
 
 	if (m_root == b2_nullNode)
 	{
@@ -284,6 +617,7 @@ void b2DynamicTree::InsertLeaf(int32 leaf)
 	m_nodes[newParent].parent = oldParent;
 	m_nodes[newParent].userData = nullptr;
 	m_nodes[newParent].aabb.Combine(leafAABB, m_nodes[sibling].aabb);
+	m_nodes[newParent].categoryBits = m_nodes[leaf].categoryBits | m_nodes[sibling].categoryBits;
 	m_nodes[newParent].height = m_nodes[sibling].height + 1;
 
 	if (oldParent != b2_nullNode)
@@ -327,6 +661,7 @@ void b2DynamicTree::InsertLeaf(int32 leaf)
 
 		m_nodes[index].height = 1 + b2Max(m_nodes[child1].height, m_nodes[child2].height);
 		m_nodes[index].aabb.Combine(m_nodes[child1].aabb, m_nodes[child2].aabb);
+		m_nodes[index].categoryBits = m_nodes[child1].categoryBits | m_nodes[child2].categoryBits;
 
 		index = m_nodes[index].parent;
 	}
@@ -336,6 +671,8 @@ void b2DynamicTree::InsertLeaf(int32 leaf)
 
 void b2DynamicTree::RemoveLeaf(int32 leaf)
 {
+	m_wideValid = false;
+
 	if (leaf == m_root)
 	{
 		m_root = b2_nullNode;
@@ -378,6 +715,7 @@ void b2DynamicTree::RemoveLeaf(int32 leaf)
 			int32 child2 = m_nodes[index].child2;
 
 			m_nodes[index].aabb.Combine(m_nodes[child1].aabb, m_nodes[child2].aabb);
+			m_nodes[index].categoryBits = m_nodes[child1].categoryBits | m_nodes[child2].categoryBits;
 			m_nodes[index].height = 1 + b2Max(m_nodes[child1].height, m_nodes[child2].height);
 
 			index = m_nodes[index].parent;
@@ -456,6 +794,8 @@ int32 b2DynamicTree::Balance(int32 iA)
 			G->parent = iA;
 			A->aabb.Combine(B->aabb, G->aabb);
 			C->aabb.Combine(A->aabb, F->aabb);
+			A->categoryBits = B->categoryBits | G->categoryBits;
+			C->categoryBits = A->categoryBits | F->categoryBits;
 
 			A->height = 1 + b2Max(B->height, G->height);
 			C->height = 1 + b2Max(A->height, F->height);
@@ -467,6 +807,8 @@ int32 b2DynamicTree::Balance(int32 iA)
 			F->parent = iA;
 			A->aabb.Combine(B->aabb, F->aabb);
 			C->aabb.Combine(A->aabb, G->aabb);
+			A->categoryBits = B->categoryBits | F->categoryBits;
+			C->categoryBits = A->categoryBits | G->categoryBits;
 
 			A->height = 1 + b2Max(B->height, F->height);
 			C->height = 1 + b2Max(A->height, G->height);
@@ -516,6 +858,8 @@ int32 b2DynamicTree::Balance(int32 iA)
 			E->parent = iA;
 			A->aabb.Combine(C->aabb, E->aabb);
 			B->aabb.Combine(A->aabb, D->aabb);
+			A->categoryBits = C->categoryBits | E->categoryBits;
+			B->categoryBits = A->categoryBits | D->categoryBits;
 
 			A->height = 1 + b2Max(C->height, E->height);
 			B->height = 1 + b2Max(A->height, D->height);
@@ -527,6 +871,8 @@ int32 b2DynamicTree::Balance(int32 iA)
 			D->parent = iA;
 			A->aabb.Combine(C->aabb, D->aabb);
 			B->aabb.Combine(A->aabb, E->aabb);
+			A->categoryBits = C->categoryBits | D->categoryBits;
+			B->categoryBits = A->categoryBits | E->categoryBits;
 
 			A->height = 1 + b2Max(C->height, D->height);
 			B->height = 1 + b2Max(A->height, E->height);
@@ -667,6 +1013,8 @@ void b2DynamicTree::ValidateMetrics(int32 index) const
 	b2Assert(aabb.lowerBound == node->aabb.lowerBound);
 	b2Assert(aabb.upperBound == node->aabb.upperBound);
 
+	b2Assert(node->categoryBits == (m_nodes[child1].categoryBits | m_nodes[child2].categoryBits));
+
 	ValidateMetrics(child1);
 	ValidateMetrics(child2);
 }
@@ -716,6 +1064,10 @@ int32 b2DynamicTree::GetMaxBalance() const
 
 void b2DynamicTree::RebuildBottomUp()
 {
+	m_wideValid = false;
+	m_optimizeDebt = 0;
+	CancelRebuild();
+
 	int32* nodes = (int32*)b2Alloc(m_nodeCount * sizeof(int32));
 	int32 count = 0;
 
@@ -774,6 +1126,7 @@ void b2DynamicTree::RebuildBottomUp()
 		parent->child2 = index2;
 		parent->height = 1 + b2Max(child1->height, child2->height);
 		parent->aabb.Combine(child1->aabb, child2->aabb);
+		parent->categoryBits = child1->categoryBits | child2->categoryBits;
 		parent->parent = b2_nullNode;
 
 		child1->parent = parentIndex;
@@ -790,8 +1143,385 @@ void b2DynamicTree::RebuildBottomUp()
 	Validate();
 }
 
+void b2DynamicTree::Restore(const b2TreeNode* nodes, int32 nodeCount, int32 root)
+{
+	b2Assert(0 <= nodeCount);
+	b2Assert((nodeCount == 0) == (root == b2_nullNode));
+
+	if (nodeCount > m_nodeCapacity)
+	{
+		b2Free(m_nodes);
+		m_nodeCapacity = nodeCount;
+		m_nodes = (b2TreeNode*)b2Alloc(m_nodeCapacity * sizeof(b2TreeNode));
+	}
+
+	memcpy(m_nodes, nodes, nodeCount * sizeof(b2TreeNode));
+	m_nodeCount = nodeCount;
+	m_root = root;
+	m_wideValid = false;
+	m_optimizeDebt = 0;
+	CancelRebuild();
+
+	// The rest of the pool becomes the free list.
+	m_freeList = b2_nullNode;
+	for (int32 i = m_nodeCapacity - 1; i >= nodeCount; --i)
+	{
+		m_nodes[i].next = m_freeList;
+		m_nodes[i].height = -1;
+		m_freeList = i;
+	}
+
+	Validate();
+}
+
+void b2DynamicTree::BuildWideNodes()
+{
+	m_wideValid = true;
+
+	if (m_root == b2_nullNode)
+	{
+		return;
+	}
+
+	// Each wide node below the first replaces at least one internal binary node.
+	if (m_nodeCount > m_wideCapacity)
+	{
+		b2Free(m_wideNodes);
+		m_wideCapacity = m_nodeCount;
+		m_wideNodes = (b2WideNode*)b2Alloc(m_wideCapacity * sizeof(b2WideNode));
+	}
+
+	int32 wideCount = 1;
+
+	struct Entry
+	{
+		int32 nodeId;
+		int32 wideId;
+	};
+
+	b2GrowableStack<Entry, 256> stack;
+	stack.Push({ m_root, 0 });
+
+	while (stack.GetCount() > 0)
+	{
+		Entry entry = stack.Pop();
+		const b2TreeNode* node = m_nodes + entry.nodeId;
+
+		int32 lanes[4];
+		int32 laneCount = 0;
+
+		if (node->IsLeaf())
+		{
+			lanes[laneCount++] = entry.nodeId;
+		}
+		else
+		{
+			lanes[laneCount++] = node->child1;
+			lanes[laneCount++] = node->child2;
+		}
+
+		// Open the largest internal lane until all four lanes are used.
+		// This collapses two levels of the binary tree into most wide nodes.
+		while (laneCount < 4)
+		{
+			int32 best = -1;
+			float bestArea = -1.0f;
+			for (int32 i = 0; i < laneCount; ++i)
+			{
+				const b2TreeNode* lane = m_nodes + lanes[i];
+				if (lane->IsLeaf() == false && lane->aabb.GetPerimeter() > bestArea)
+				{
+					best = i;
+					bestArea = lane->aabb.GetPerimeter();
+				}
+			}
+
+			if (best == -1)
+			{
+				break;
+			}
+
+			const b2TreeNode* lane = m_nodes + lanes[best];
+			lanes[best] = lane->child1;
+			lanes[laneCount++] = lane->child2;
+		}
+
+		b2WideNode* wide = m_wideNodes + entry.wideId;
+
+		for (int32 i = 0; i < 4; ++i)
+		{
+			if (i >= laneCount)
+			{
+				wide->lowerX[i] = FLT_MAX;
+				wide->lowerY[i] = FLT_MAX;
+				wide->upperX[i] = -FLT_MAX;
+				wide->upperY[i] = -FLT_MAX;
+				wide->child[i] = ~b2_nullNode;
+				wide->categoryBits[i] = 0;
+				continue;
+			}
+
+			const b2TreeNode* lane = m_nodes + lanes[i];
+			wide->lowerX[i] = lane->aabb.lowerBound.x;
+			wide->lowerY[i] = lane->aabb.lowerBound.y;
+			wide->upperX[i] = lane->aabb.upperBound.x;
+			wide->upperY[i] = lane->aabb.upperBound.y;
+			wide->categoryBits[i] = lane->categoryBits;
+
+			if (lane->IsLeaf())
+			{
+				wide->child[i] = ~lanes[i];
+			}
+			else
+			{
+				b2Assert(wideCount < m_wideCapacity);
+				wide->child[i] = wideCount;
+				stack.Push({ lanes[i], wideCount });
+				++wideCount;
+			}
+		}
+	}
+}
+
+void b2DynamicTree::RebuildTopDown()
+{
+	m_wideValid = false;
+	m_optimizeDebt = 0;
+	CancelRebuild();
+
+	int32* leaves = (int32*)b2Alloc(m_nodeCount * sizeof(int32));
+	int32 count = 0;
+
+	// Collect the leaves. Free the rest.
+	for (int32 i = 0; i < m_nodeCapacity; ++i)
+	{
+		if (m_nodes[i].height < 0)
+		{
+			// free node in pool
+			continue;
+		}
+
+		if (m_nodes[i].IsLeaf())
+		{
+			leaves[count++] = i;
+		}
+		else
+		{
+			FreeNode(i);
+		}
+	}
+
+	m_root = count > 0 ? BuildTopDown(leaves, count) : b2_nullNode;
+
+	b2Free(leaves);
+}
+
+int32 b2DynamicTree::Optimize(int32 nodeBudget)
+{
+	if (nodeBudget <= 0)
+	{
+		return 0;
+	}
+
+	if (m_rebuildLeaves == nullptr)
+	{
+		// Wait until about a quarter of the leaves have been reinserted.
+		int32 leafCount = (m_nodeCount + 1) / 2;
+		if (leafCount < 2 || 4 * m_optimizeDebt < leafCount)
+		{
+			return 0;
+		}
+
+		m_rebuildLeaves = (b2BuildLeaf*)b2Alloc(leafCount * sizeof(b2BuildLeaf));
+		m_rebuildSplits = (int32*)b2Alloc((leafCount - 1) * sizeof(int32));
+		m_rebuildRanges = (int32*)b2Alloc(2 * leafCount * sizeof(int32));
+
+		int32 count = 0;
+		for (int32 i = 0; i < m_nodeCapacity; ++i)
+		{
+			if (m_nodes[i].height == 0)
+			{
+				b2BuildLeaf& leaf = m_rebuildLeaves[count++];
+				leaf.aabb = m_nodes[i].aabb;
+				leaf.center = leaf.aabb.GetCenter();
+				leaf.nodeId = i;
+			}
+		}
+		b2Assert(count == leafCount);
+
+		m_rebuildLeafCount = count;
+		m_rebuildSplitCount = 0;
+		m_rebuildRanges[0] = 0;
+		m_rebuildRanges[1] = count;
+		m_rebuildRangeCount = 1;
+		m_optimizeDebt = 0;
+	}
+
+	// Same order as BuildTopDown: split a range, then go left first.
+	int32 work = 0;
+	while (m_rebuildRangeCount > 0 && work < nodeBudget)
+	{
+		--m_rebuildRangeCount;
+		int32 begin = m_rebuildRanges[2 * m_rebuildRangeCount];
+		int32 count = m_rebuildRanges[2 * m_rebuildRangeCount + 1];
+		if (count == 1)
+		{
+			continue;
+		}
+
+		int32 leftCount = b2SplitLeaves(m_rebuildLeaves + begin, count);
+		m_rebuildSplits[m_rebuildSplitCount++] = leftCount;
+		work += count;
+
+		int32* ranges = m_rebuildRanges + 2 * m_rebuildRangeCount;
+		ranges[0] = begin + leftCount;
+		ranges[1] = count - leftCount;
+		ranges[2] = begin;
+		ranges[3] = leftCount;
+		m_rebuildRangeCount += 2;
+	}
+
+	if (m_rebuildRangeCount == 0)
+	{
+		FinishRebuild();
+	}
+
+	return work;
+}
+
+void b2DynamicTree::CancelRebuild()
+{
+	b2Free(m_rebuildLeaves);
+	b2Free(m_rebuildSplits);
+	b2Free(m_rebuildRanges);
+	m_rebuildLeaves = nullptr;
+	m_rebuildSplits = nullptr;
+	m_rebuildRanges = nullptr;
+	m_rebuildLeafCount = 0;
+	m_rebuildSplitCount = 0;
+	m_rebuildRangeCount = 0;
+}
+
+// Replace the tree with the partition built by Optimize. A leaf of the snapshot that is
+// no longer a leaf was destroyed and drops out of the new tree. Current leaves missing
+// from the snapshot were created during the rebuild and are inserted afterwards.
+void b2DynamicTree::FinishRebuild()
+{
+	b2Assert(m_rebuildSplitCount == m_rebuildLeafCount - 1);
+
+	m_wideValid = false;
+
+	bool* used = (bool*)b2Alloc(m_nodeCapacity * sizeof(bool));
+	memset(used, 0, m_nodeCapacity * sizeof(bool));
+
+	for (int32 i = 0; i < m_rebuildLeafCount; ++i)
+	{
+		int32 nodeId = m_rebuildLeaves[i].nodeId;
+		if (m_nodes[nodeId].height == 0)
+		{
+			used[nodeId] = true;
+		}
+		else
+		{
+			m_rebuildLeaves[i].nodeId = b2_nullNode;
+		}
+	}
+
+	// Free the old internal nodes and gather the new leaves.
+	int32* created = (int32*)b2Alloc(m_nodeCapacity * sizeof(int32));
+	int32 createdCount = 0;
+	int32 capacity = m_nodeCapacity;
+	for (int32 i = 0; i < capacity; ++i)
+	{
+		if (m_nodes[i].height > 0)
+		{
+			FreeNode(i);
+		}
+		else if (m_nodes[i].height == 0 && used[i] == false)
+		{
+			created[createdCount++] = i;
+		}
+	}
+	m_root = b2_nullNode;
+
+	// Replay the splits. Each range is visited before and after its children, the
+	// second time to join their roots. Children that lost all their leaves are null.
+	struct Range
+	{
+		int32 begin;
+		int32 count;
+		bool joined;
+	};
+
+	b2GrowableStack<Range, 256> stack;
+	b2GrowableStack<int32, 256> roots;
+	stack.Push({ 0, m_rebuildLeafCount, false });
+
+	int32 splitIndex = 0;
+	while (stack.GetCount() > 0)
+	{
+		Range range = stack.Pop();
+
+		if (range.count == 1)
+		{
+			roots.Push(m_rebuildLeaves[range.begin].nodeId);
+			continue;
+		}
+
+		if (range.joined == false)
+		{
+			int32 leftCount = m_rebuildSplits[splitIndex++];
+			stack.Push({ range.begin, range.count, true });
+			stack.Push({ range.begin + leftCount, range.count - leftCount, false });
+			stack.Push({ range.begin, leftCount, false });
+			continue;
+		}
+
+		int32 child2 = roots.Pop();
+		int32 child1 = roots.Pop();
+		if (child1 == b2_nullNode || child2 == b2_nullNode)
+		{
+			roots.Push(child1 == b2_nullNode ? child2 : child1);
+			continue;
+		}
+
+		int32 nodeId = AllocateNode();
+		b2TreeNode* node = m_nodes + nodeId;
+		node->userData = nullptr;
+		node->moved = false;
+		node->child1 = child1;
+		node->child2 = child2;
+		node->aabb.Combine(m_nodes[child1].aabb, m_nodes[child2].aabb);
+		node->height = 1 + b2Max(m_nodes[child1].height, m_nodes[child2].height);
+		node->categoryBits = m_nodes[child1].categoryBits | m_nodes[child2].categoryBits;
+		m_nodes[child1].parent = nodeId;
+		m_nodes[child2].parent = nodeId;
+		roots.Push(nodeId);
+	}
+
+	b2Assert(splitIndex == m_rebuildSplitCount);
+	b2Assert(roots.GetCount() == 1);
+
+	m_root = roots.Pop();
+	if (m_root != b2_nullNode)
+	{
+		m_nodes[m_root].parent = b2_nullNode;
+	}
+
+	for (int32 i = 0; i < createdCount; ++i)
+	{
+		InsertLeaf(created[i]);
+	}
+
+	b2Free(created);
+	b2Free(used);
+	CancelRebuild();
+}
+
 void b2DynamicTree::ShiftOrigin(const b2Vec2& newOrigin)
 {
+	m_wideValid = false;
+
 	// Build array of leaves. Free the rest.
 	for (int32 i = 0; i < m_nodeCapacity; ++i)
 	{
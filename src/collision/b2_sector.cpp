@@ -14,6 +14,56 @@ void b2SectorObject::DetachProxy(const b2AABB& aabb)
   }
 }
 
+void b2SectorObject::DetachProxy(b2Sector* sector)
+{
+  for (auto& proxy : m_proxies)
+  {
+    if (proxy.attached && proxy.sector == sector)
+    {
+      sector->DestroyProxy(proxy.proxyId);
+      proxy.attached = false;
+      m_proxyCount--;
+      return;
+    }
+  }
+}
+
+void b2SectorObject::DetachProxy(b2Sector* sector, std::vector<b2SectorProxyOp>& ops)
+{
+  for (auto& proxy : m_proxies)
+  {
+    if (proxy.attached && proxy.sector == sector)
+    {
+      ops.push_back(b2SectorProxyOp{ sector, b2SectorProxyOp::Destroy, proxy.proxyId, b2AABB(), this });
+      proxy.attached = false;
+      m_proxyCount--;
+      return;
+    }
+  }
+}
+
+void b2SectorObject::MoveProxyAll(const b2AABB& aabb, const b2Vec2& displacement)
+{
+  for (auto& proxy : m_proxies)
+  {
+    if (proxy.attached)
+    {
+      proxy.sector->MoveProxy(proxy.proxyId, aabb, displacement);
+    }
+  }
+}
+
+void b2SectorObject::CountProxyMoves()
+{
+  for (auto& proxy : m_proxies)
+  {
+    if (proxy.attached)
+    {
+      proxy.sector->AddMoveCount();
+    }
+  }
+}
+
 void b2SectorObject::DetachProxy(int proxyId)
 {
   b2Assert(m_proxyCount >= 0);
@@ -45,11 +95,181 @@ void b2SectorObject::DetachProxyAll()
   }
 }
 
-b2Sector::b2Sector(int index, const b2AABB& bounds)
-  : m_index(index)
+void b2SectorSnapshot::Build(const b2DynamicTree& tree)
+{
+  nodes.clear();
+
+  if (tree.GetRoot() == b2_nullNode)
+  {
+    return;
+  }
+
+  // 带   ڽĵ ְ  skip ä.
+  b2GrowableStack<int32, 256> stack;
+  stack.Push(tree.GetRoot());
+
+  while (stack.GetCount() > 0)
+  {
+    int32 value = stack.Pop();
+
+    if (value < 0)
+    {
+      // Ʈ  ǥ 
+      nodes[-value - 1].skip = static_cast<int32>(nodes.size());
+      continue;
+    }
+
+    const b2TreeNode& node = tree.GetNode(value);
+    int32 index = static_cast<int32>(nodes.size());
+
+    if (node.IsLeaf())
+    {
+      nodes.push_back(Node{ 
+        node.aabb, reinterpret_cast<b2SectorObject*>(node.userData), value, index + 1, node.categoryBits });
+    }
+    else
+    {
+      nodes.push_back(Node{ node.aabb, nullptr, b2_nullNode, index + 1, node.categoryBits });
+      stack.Push(-index - 1);
+      stack.Push(node.child2);
+      stack.Push(node.child1);
+    }
+  }
+}
+
+int b2SectorSnapshot::Query(const b2AABB& aabb, std::vector<b2SectorObject*>& objects, uint16 maskBits) const
+{
+  int count = 0;
+  int32 index = 0;
+  int32 nodeCount = static_cast<int32>(nodes.size());
+
+  while (index < nodeCount)
+  {
+    const Node& node = nodes[index];
+
+    if ((node.categoryBits & maskBits) != 0 && b2TestOverlap(node.aabb, aabb))
+    {
+      if (node.object)
+      {
+        objects.push_back(node.object);
+        ++count;
+      }
+      ++index;
+    }
+    else
+    {
+      index = node.skip;
+    }
+  }
+
+  return count;
+}
+
+int b2SectorSnapshot::Query(const b2AABB& aabb, std::vector<int32>& lst, uint16 maskBits) const
+{
+  int count = 0;
+  int32 index = 0;
+  int32 nodeCount = static_cast<int32>(nodes.size());
+
+  while (index < nodeCount)
+  {
+    const Node& node = nodes[index];
+
+    if ((node.categoryBits & maskBits) != 0 && b2TestOverlap(node.aabb, aabb))
+    {
+      if (node.object)
+      {
+        lst.push_back(node.proxyId);
+        ++count;
+      }
+      ++index;
+    }
+    else
+    {
+      index = node.skip;
+    }
+  }
+
+  return count;
+}
+
+int b2SectorSnapshot::RayCast(const b2RayCastInput& input, std::vector<int32>& lst, uint16 maskBits) const
+{
+  b2Vec2 p1 = input.p1;
+  b2Vec2 p2 = input.p1 + input.maxFraction * (input.p2 - input.p1);
+  b2Vec2 r = p2 - p1;
+
+  if (r.LengthSquared() <= 0.0f)
+  {
+    return 0;
+  }
+
+  r.Normalize();
+
+  // v is perpendicular to the segment.
+  b2Vec2 v = b2Cross(1.0f, r);
+  b2Vec2 abs_v = b2Abs(v);
+
+  b2AABB segmentAABB;
+  segmentAABB.lowerBound = b2Min(p1, p2);
+  segmentAABB.upperBound = b2Max(p1, p2);
+
+  int count = 0;
+  int32 index = 0;
+  int32 nodeCount = static_cast<int32>(nodes.size());
+
+  while (index < nodeCount)
+  {
+    const Node& node = nodes[index];
+
+    // Separating axis for segment (Gino, p80).
+    bool overlap = (node.categoryBits & maskBits) != 0 && b2TestOverlap(node.aabb, segmentAABB);
+    if (overlap)
+    {
+      b2Vec2 c = node.aabb.GetCenter();
+      b2Vec2 h = node.aabb.GetExtents();
+      overlap = b2Abs(b2Dot(v, p1 - c)) - b2Dot(abs_v, h) <= 0.0f;
+    }
+
+    if (overlap)
+    {
+      if (node.object)
+      {
+        lst.push_back(node.proxyId);
+        ++count;
+      }
+      ++index;
+    }
+    else
+    {
+      index = node.skip;
+    }
+  }
+
+  return count;
+}
+
+b2Sector::b2Sector(int index, const b2AABB& bounds, b2DynamicTree* tree, const std::atomic<b2SectorPhase>* phase)
+  : m_phase(phase)
+  , m_index(index)
   , m_bounds(bounds)
+  , m_tree(tree)
+  , m_snapshot(nullptr)
+  , m_snapshotIndex(0)
+  , m_idleTicks(0)
+  , m_proxyCount(0)
+  , m_moveCount(0)
+  , m_reinsertCount(0)
+  , m_queryCount(0)
+  , m_candidateCount(0)
+  , m_lockWaitTime(0)
 {
-  m_tree = new b2DynamicTree();
+  if (m_tree == nullptr)
+  {
+    m_tree = new b2DynamicTree();
+  }
+
+  b2Assert(m_tree->GetRoot() == b2_nullNode);
 }
 
 b2Sector::~b2Sector()
@@ -57,20 +277,391 @@ b2Sector::~b2Sector()
   delete m_tree;
 }
 
-int32 b2Sector::CreateProxy(const b2AABB& aabb, void* userData)
+int32 b2Sector::CreateProxy(const b2AABB& aabb, void* userData, uint16 categoryBits)
 {
+  auto waitStart = std::chrono::steady_clock::now();
   rx::xlock xlock(m_lock);
-  return m_tree->CreateProxy(aabb, userData);
+  AddLockWait(waitStart);
+
+  ++m_proxyCount;
+  return m_tree->CreateProxy(aabb, userData, categoryBits);
 }
 
 void b2Sector::DestroyProxy(int32 proxyId)
 {
+  auto waitStart = std::chrono::steady_clock::now();
   rx::xlock xlock(m_lock);
+  AddLockWait(waitStart);
+
+  --m_proxyCount;
   return m_tree->DestroyProxy(proxyId);
 }
 
 bool b2Sector::MoveProxy(int32 proxyId, const b2AABB& aabb, const b2Vec2& displacement)
+{
+  m_moveCount.fetch_add(1, std::memory_order_relaxed);
+
+  // κ ̵ fat AABB ȿ Ƿ slock  ȮϿ xlock Ѵ.
+  {
+    rx::slock slock(m_lock);
+
+    if (m_tree->IsProxyFit(proxyId, aabb, displacement))
+    {
+      return false;
+    }
+  }
+
+  auto waitStart = std::chrono::steady_clock::now();
+  rx::xlock xlock(m_lock);
+  AddLockWait(waitStart);
+
+  bool reinserted = m_tree->MoveProxy(proxyId, aabb, displacement);
+  if (reinserted)
+  {
+    m_reinsertCount.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  return reinserted;
+}
+
+void b2Sector::GetMoveCounts(int& moveCount, int& reinsertCount, bool reset)
+{
+  if (reset)
+  {
+    moveCount = m_moveCount.exchange(0, std::memory_order_relaxed);
+    reinsertCount = m_reinsertCount.exchange(0, std::memory_order_relaxed);
+    return;
+  }
+
+  moveCount = m_moveCount.load(std::memory_order_relaxed);
+  reinsertCount = m_reinsertCount.load(std::memory_order_relaxed);
+}
+
+void b2Sector::GetQueryCounts(int& queryCount, int& candidateCount, bool reset)
+{
+  if (reset)
+  {
+    queryCount = m_queryCount.exchange(0, std::memory_order_relaxed);
+    candidateCount = m_candidateCount.exchange(0, std::memory_order_relaxed);
+    return;
+  }
+
+  queryCount = m_queryCount.load(std::memory_order_relaxed);
+  candidateCount = m_candidateCount.load(std::memory_order_relaxed);
+}
+
+int64_t b2Sector::GetLockWaitTime(bool reset)
+{
+  if (reset)
+  {
+    return m_lockWaitTime.exchange(0, std::memory_order_relaxed);
+  }
+
+  return m_lockWaitTime.load(std::memory_order_relaxed);
+}
+
+void b2Sector::GetTreeMetrics(int& proxyCount, int& treeHeight) const
+{
+  rx::slock slock(m_lock);
+
+  proxyCount = m_proxyCount;
+  treeHeight = m_tree ? m_tree->GetHeight() : 0;
+}
+
+// Ͻ userData b2SectorObject ٷ  ݹ
+struct b2SectorObjectQueryCallback
+{
+  b2SectorObjectQueryCallback(const b2DynamicTree* tree, std::vector<b2SectorObject*>& objects)
+    : m_tree(tree)
+    , m_objects(objects)
+  {
+  }
+
+  bool QueryCallback(int32 proxyId)
+  {
+    m_objects.push_back(reinterpret_cast<b2SectorObject*>(m_tree->GetUserData(proxyId)));
+    return true;
+  }
+
+  const b2DynamicTree* m_tree;
+  std::vector<b2SectorObject*>& m_objects;
+};
+
+int b2Sector::Query(const b2AABB& aabb, std::vector<int32>& lst, uint16 maskBits) const
+{
+  auto size = lst.size();
+
+  auto snapshot = m_snapshot.load(std::memory_order_acquire);
+  if (snapshot)
+  {
+    snapshot->Query(aabb, lst, maskBits);
+  }
+  else
+  {
+    std::optional<rx::slock> slock;
+    if (!IsReadPhase())
+    {
+      slock.emplace(m_lock);
+    }
+
+    m_tree->Query(aabb, lst, maskBits);
+  }
+
+  int count = static_cast<int>(lst.size() - size);
+  CountQuery(count);
+  return count;
+}
+
+int b2Sector::RayCast(const b2RayCastInput& input, std::vector<int32>& lst, uint16 maskBits) const
+{
+  auto size = lst.size();
+
+  auto snapshot = m_snapshot.load(std::memory_order_acquire);
+  if (snapshot)
+  {
+    snapshot->RayCast(input, lst, maskBits);
+  }
+  else
+  {
+    std::optional<rx::slock> slock;
+    if (!IsReadPhase())
+    {
+      slock.emplace(m_lock);
+    }
+
+    m_tree->RayCast(input, lst, maskBits);
+  }
+
+  int count = static_cast<int>(lst.size() - size);
+  CountQuery(count);
+  return count;
+}
+
+void b2Sector::PublishSnapshot()
+{
+  // д   ִ ۰ ƴ ٸ ۿ .
+  auto& snapshot = m_snapshots[m_snapshotIndex];
+
+  // slock
+  {
+    rx::slock slock(m_lock);
+    snapshot.Build(*m_tree);
+  }
+
+  m_snapshot.store(&snapshot, std::memory_order_release);
+  m_snapshotIndex = 1 - m_snapshotIndex;
+}
+
+int b2Sector::Query(const b2AABB& aabb, std::vector<b2SectorObject*>& objects, uint16 maskBits) const
+{
+  auto size = objects.size();
+
+  auto snapshot = m_snapshot.load(std::memory_order_acquire);
+  if (snapshot)
+  {
+    snapshot->Query(aabb, objects, maskBits);
+  }
+  else
+  {
+    std::optional<rx::slock> slock;
+    if (!IsReadPhase())
+    {
+      slock.emplace(m_lock);
+    }
+
+    b2SectorObjectQueryCallback cb(m_tree, objects);
+    m_tree->Query(&cb, aabb, maskBits);
+  }
+
+  int count = static_cast<int>(objects.size() - size);
+  CountQuery(count);
+  return count;
+}
+
+bool b2Sector::IsEmpty() const
+{
+  rx::slock slock(m_lock);
+  return m_tree->GetRoot() == b2_nullNode;
+}
+
+int b2Sector::CountIdleTicks()
+{
+  m_idleTicks = IsEmpty() ? m_idleTicks + 1 : 0;
+  return m_idleTicks;
+}
+
+b2DynamicTree* b2Sector::ReleaseTree()
+{
+  rx::xlock xlock(m_lock);
+
+  auto tree = m_tree;
+  m_tree = nullptr;
+  return tree;
+}
+
+void b2Sector::CopyTree(std::vector<b2TreeNode>& nodes) const
+{
+  nodes.clear();
+
+  rx::slock slock(m_lock);
+
+  if (m_tree->GetRoot() == b2_nullNode)
+  {
+    return;
+  }
+
+  struct Entry
+  {
+    int32 treeId;
+    int32 parent;
+    bool isChild1;
+  };
+
+  b2GrowableStack<Entry, 256> stack;
+  stack.Push({ m_tree->GetRoot(), b2_nullNode, false });
+
+  while (stack.GetCount() > 0)
+  {
+    Entry entry = stack.Pop();
+
+    int32 index = static_cast<int32>(nodes.size());
+    nodes.push_back(m_tree->GetNode(entry.treeId));
+
+    b2TreeNode& node = nodes.back();
+    node.parent = entry.parent;
+    node.moved = false;
+
+    if (entry.parent != b2_nullNode)
+    {
+      (entry.isChild1 ? nodes[entry.parent].child1 : nodes[entry.parent].child2) = index;
+    }
+
+    if (!node.IsLeaf())
+    {
+      stack.Push({ node.child2, index, false });
+      stack.Push({ node.child1, index, true });
+    }
+  }
+}
+
+void b2Sector::BuildWideNodes()
+{
+  rx::xlock xlock(m_lock);
+
+  if (!m_tree->HasWideNodes())
+  {
+    m_tree->BuildWideNodes();
+  }
+}
+
+int32 b2Sector::OptimizeTree(int32 nodeBudget)
+{
+  rx::xlock xlock(m_lock);
+
+  return m_tree->Optimize(nodeBudget);
+}
+
+void b2Sector::RestoreTree(const std::vector<b2TreeNode>& nodes)
 {
   rx::xlock xlock(m_lock);
-  return m_tree->MoveProxy(proxyId, aabb, displacement);
-}
\ No newline at end of file
+
+  b2Assert(m_tree->GetRoot() == b2_nullNode);
+
+  int32 count = static_cast<int32>(nodes.size());
+  m_tree->Restore(nodes.data(), count, count > 0 ? 0 : b2_nullNode);
+
+  m_proxyCount = 0;
+  for (auto& node : nodes)
+  {
+    m_proxyCount += node.IsLeaf() ? 1 : 0;
+  }
+}
+
+std::size_t b2Sector::GetMemorySize() const
+{
+  rx::slock slock(m_lock);
+
+  std::size_t size = sizeof(b2Sector);
+
+  if (m_tree)
+  {
+    size += sizeof(b2DynamicTree) + m_tree->GetNodeCapacity() * sizeof(b2TreeNode);
+  }
+
+  for (auto& snapshot : m_snapshots)
+  {
+    size += snapshot.nodes.capacity() * sizeof(b2SectorSnapshot::Node);
+  }
+
+  return size;
+}
+
+void b2Sector::ApplyProxyOps(const b2SectorProxyOp* ops, int count)
+{
+  auto waitStart = std::chrono::steady_clock::now();
+  rx::xlock xlock(m_lock);
+  AddLockWait(waitStart);
+
+  for (int i = 0; i < count; ++i)
+  {
+    const b2SectorProxyOp& op = ops[i];
+    b2Assert(op.sector == this);
+
+    switch (op.type)
+    {
+    case b2SectorProxyOp::Destroy:
+      --m_proxyCount;
+      m_tree->DestroyProxy(op.proxyId);
+      break;
+    case b2SectorProxyOp::Move:
+      m_moveCount.fetch_add(1, std::memory_order_relaxed);
+
+      if (m_tree->MoveProxy(op.proxyId, op.aabb, b2Vec2_zero))
+      {
+        m_reinsertCount.fetch_add(1, std::memory_order_relaxed);
+      }
+      break;
+    case b2SectorProxyOp::Create:
+    {
+      int runEnd = i + 1;
+      while (runEnd < count && ops[runEnd].type == b2SectorProxyOp::Create)
+      {
+        ++runEnd;
+      }
+
+      if (runEnd - i >= b2_minBulkProxyCount)
+      {
+        CreateProxies(ops + i, runEnd - i);
+        i = runEnd - 1;
+        break;
+      }
+
+      ++m_proxyCount;
+      auto proxyId = m_tree->CreateProxy(op.aabb, (void*)op.object, op.object->GetFilter().categoryBits);
+      op.object->AttachProxy(this, proxyId);
+      break;
+    }
+    }
+  }
+}
+
+void b2Sector::CreateProxies(const b2SectorProxyOp* ops, int count)
+{
+  std::vector<b2TreeProxyDef> defs(count);
+  std::vector<int32> proxyIds(count);
+
+  for (int i = 0; i < count; ++i)
+  {
+    defs[i].aabb = ops[i].aabb;
+    defs[i].userData = (void*)ops[i].object;
+    defs[i].categoryBits = ops[i].object->GetFilter().categoryBits;
+  }
+
+  m_tree->CreateProxies(defs.data(), count, proxyIds.data());
+  m_proxyCount += count;
+
+  for (int i = 0; i < count; ++i)
+  {
+    ops[i].object->AttachProxy(this, proxyIds[i]);
+  }
+}
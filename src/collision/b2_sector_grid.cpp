@@ -1,133 +1,334 @@
 #include "box2d/b2_sector_grid.h"
+#include "box2d/b2_chain_shape.h"
+#include "box2d/b2_distance.h"
+#include "box2d/b2_edge_shape.h"
+#include "box2d/b2_time_of_impact.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <new>
 
-constexpr b2ObjectId InvalidObjectId = -1;
+constexpr uint32 NullObjectSlot = UINT32_MAX;
 
 b2SectorGrid::b2SectorGrid(const b2SectorSettings& settings)
   : m_settings(settings)
-  , m_objectIdSequence(1)     // 0 is invalid id
+  , m_freeObjectSlot(NullObjectSlot)
+  , m_evictedSectorCount(0)
+  , m_phase(b2SectorPhase::Idle)
+  , m_queryCount(0)
+  , m_candidateCount(0)
+  , m_hitCount(0)
 {
   b2Assert(m_settings.bounds.upperBound.x > m_settings.bounds.lowerBound.x);
   b2Assert(m_settings.bounds.upperBound.y > m_settings.bounds.lowerBound.y);
   b2Assert(m_settings.sectorSize >= 1);
   b2Assert(m_settings.bounds.GetExtents().x >= m_settings.sectorSize / 2);
   b2Assert(m_settings.bounds.GetExtents().y >= m_settings.sectorSize / 2);
+  b2Assert(m_settings.levelCount >= 1);
 
-  auto extend = b2Vec2(m_settings.sectorSize, m_settings.sectorSize);
-  extend *= 3; // have 3 or 4 more sectors around the original map bounds
+  m_levelCount = b2Max(m_settings.levelCount, 1);
+  m_levels.reset(new Level[m_levelCount]);
 
-  m_sectorBoundsExtended.lowerBound = m_settings.bounds.lowerBound - extend;
-  m_sectorBoundsExtended.upperBound = m_settings.bounds.upperBound + extend;
+  int indexBase = 0;
 
-  auto area = m_sectorBoundsExtended.GetExtents();
-  area *= 2;  
+  for (int level = 0; level < m_levelCount; ++level)
+  {
+    Level& lv = m_levels[level];
+    lv.sectorSize = m_settings.sectorSize * static_cast<float>(1 << level);
+
+    auto extend = b2Vec2(lv.sectorSize, lv.sectorSize);
+    extend *= 3; // have 3 or 4 more sectors around the original map bounds
+
+    lv.boundsExtended.lowerBound = m_settings.bounds.lowerBound - extend;
+    lv.boundsExtended.upperBound = m_settings.bounds.upperBound + extend;
+
+    auto area = lv.boundsExtended.GetExtents();
+    area *= 2;  
+
+    lv.sectorCountX = static_cast<int>(area.x / lv.sectorSize);
+    lv.sectorCountY = static_cast<int>(area.y / lv.sectorSize);
+
+    //  ũ 2  Ȯؼ  Ƿ 
+    //  ϳ Ͱ  ȮǾ ִ. 
+
+    b2Assert(lv.sectorCountX >= 2);
+    b2Assert(lv.sectorCountY >= 2);
+
+    lv.indexBase = indexBase;
+    indexBase += lv.sectorCountX * lv.sectorCountY;
 
-  m_sectorCountX = static_cast<int>(area.x / m_settings.sectorSize);
-  m_sectorCountY = static_cast<int>(area.y / m_settings.sectorSize);
+    lv.objectCount.store(0, std::memory_order_relaxed);
 
-  //  ũ 2  Ȯؼ  Ƿ 
-  //  ϳ Ͱ  ȮǾ ִ. 
+    if (m_settings.useDenseSectors)
+    {
+      int sectorCount = lv.sectorCountX * lv.sectorCountY;
+      lv.denseSectors.reset(new std::atomic<b2Sector*>[sectorCount]);
+
+      for (int iy = 0; iy < lv.sectorCountY; ++iy)
+      {
+        for (int ix = 0; ix < lv.sectorCountX; ++ix)
+        {
+          auto sector = m_settings.preallocateSectors ? CreateSector(level, ix, iy) : nullptr;
+          lv.denseSectors[iy * lv.sectorCountX + ix].store(sector, std::memory_order_relaxed);
 
-  b2Assert(m_sectorCountX >= 2);
-  b2Assert(m_sectorCountY >= 2);
+          if (sector)
+          {
+            m_denseResidents.push_back(sector);
+          }
+        }
+      }
+    }
+  }
 }
 
 b2SectorGrid::~b2SectorGrid()
 {
+  if (m_settings.useDenseSectors)
+  {
+    for (int level = 0; level < m_levelCount; ++level)
+    {
+      const Level& lv = m_levels[level];
+      int sectorCount = lv.sectorCountX * lv.sectorCountY;
+
+      for (int i = 0; i < sectorCount; ++i)
+      {
+        delete lv.denseSectors[i].load(std::memory_order_relaxed);
+      }
+    }
+  }
+
   for (auto& kv : m_sectors)
   {
     delete kv.second;
   }
 
-  for (auto& kv : m_objects)
+  for (auto& slot : m_objectSlots)
   {
-    delete kv.second;
+    if (slot.object)
+    {
+      DestroyObject(slot.object);
+    }
+  }
+
+  for (auto& retired : m_retiredObjects)
+  {
+    for (auto obj : retired)
+    {
+      DestroyObject(obj);
+    }
+  }
+
+  // ø ϴ Ʈ   Ŀ Ѵ.
+  for (auto shapeTemplate : m_shapeTemplates)
+  {
+    FreeShape(shapeTemplate->shape);
+    shapeTemplate->~b2SectorShapeTemplate();
+    m_allocator.Free(shapeTemplate, sizeof(b2SectorShapeTemplate));
+  }
+
+  for (auto& retired : m_retiredSectors)
+  {
+    for (auto sector : retired)
+    {
+      delete sector;
+    }
+  }
+
+  for (auto tree : m_treePool)
+  {
+    delete tree;
   }
 
   m_sectors.clear();
-  m_objects.clear();
+  m_objectSlots.clear();
 }
 
 std::pair<b2ObjectId, b2Result::Code> b2SectorGrid::Spawn(
   b2Shape* shape, const b2Filter& filter, b2Transform& tf, void* userData)
 {
   b2Assert(shape);
+
+  return SpawnObject(shape, shape, nullptr, filter, tf, userData);
+}
+
+std::pair<b2ObjectId, b2Result::Code> b2SectorGrid::Spawn(
+  const b2Shape& shape, const b2Filter& filter, const b2Transform& tf, void* userData)
+{
+  return SpawnObject(&shape, nullptr, nullptr, filter, tf, userData);
+}
+
+std::pair<b2ObjectId, b2Result::Code> b2SectorGrid::Spawn(
+  b2ShapeTemplateId shapeTemplate, const b2Filter& filter, const b2Transform& tf, void* userData)
+{
+  auto found = GetShapeTemplate(shapeTemplate);
+  if (found == nullptr)
+  {
+    return std::pair(b2_nullObjectId, b2Result::Fail_Invalid_Shape_Template);
+  }
+
+  return SpawnObject(found->shape, nullptr, found, filter, tf, userData);
+}
+
+b2ShapeTemplateId b2SectorGrid::RegisterShapeTemplate(const b2Shape& shape)
+{
+  CheckWritePhase();
+
+  b2Assert(shape.GetChildCount() == 1);
+
+  rx::xlock xlock(m_lock);
+
+  void* mem = m_allocator.Allocate(sizeof(b2SectorShapeTemplate));
+  auto shapeTemplate = new (mem) b2SectorShapeTemplate();
+
+  shapeTemplate->shape = shape.Clone(&m_allocator);
+  shape.ComputeAABB(&shapeTemplate->localAABB, b2Transform(b2Vec2(0.0f, 0.0f), b2Rot(0.0f)), 0);
+  shapeTemplate->radius = 0.5f * GetShapeDiameter(&shape);
+  shapeTemplate->level = GetLevelFor(&shape);
+
+  m_shapeTemplates.push_back(shapeTemplate);
+
+  return static_cast<b2ShapeTemplateId>(m_shapeTemplates.size() - 1);
+}
+
+const b2SectorShapeTemplate* b2SectorGrid::GetShapeTemplate(b2ShapeTemplateId shapeTemplate)
+{
+  rx::slock slock(m_lock);
+
+  if (shapeTemplate < 0 || shapeTemplate >= static_cast<int>(m_shapeTemplates.size()))
+  {
+    return nullptr;
+  }
+
+  return m_shapeTemplates[shapeTemplate];
+}
+
+std::pair<b2ObjectId, b2Result::Code> b2SectorGrid::SpawnObject(
+  const b2Shape* shape, b2Shape* ownedShape, const b2SectorShapeTemplate* shapeTemplate, 
+  const b2Filter& filter, const b2Transform& tf, void* userData)
+{
+  CheckWritePhase();
+
   b2Assert(shape->GetChildCount() == 1); // ڽ ϳ 縸 
 
   if (shape->GetChildCount() > 1)
   {
-    return std::pair(InvalidObjectId, b2Result::Fail_Too_Many_Shape_Child_Count);
+    return std::pair(b2_nullObjectId, b2Result::Fail_Too_Many_Shape_Child_Count);
   }
 
   b2AABB aabb;
-  shape->ComputeAABB(&aabb, tf, 0);
+  int level;
 
-  auto obj = new b2SectorObject(AcquireObjectId(), shape, filter, tf, userData);
+  if (shapeTemplate)
+  {
+    shapeTemplate->ComputeAABB(&aabb, tf);
+    level = shapeTemplate->level;
+  }
+  else
+  {
+    shape->ComputeAABB(&aabb, tf, 0);
+    level = GetLevelFor(shape);
+  }
 
   // Get overlapping sectors 
 
-  int ix = GetSectorIndexX(aabb.GetCenter().x);
-  int iy = GetSectorIndexX(aabb.GetCenter().y);
+  b2SectorRange range;
+  if (!GetSectorRange(level, aabb, range))
+  {
+    return std::pair(b2_nullObjectId, b2Result::Fail_Invalid_Object_Position);
+  }
 
-  if (!CheckIndexBounds(ix, iy))
+  if (!CheckProxyCount(range))
   {
-    return std::pair(InvalidObjectId, b2Result::Fail_Invalid_Object_Position);
+    return std::pair(b2_nullObjectId, b2Result::Fail_Too_Large_Object);
   }
 
-  // Ensure neighboring sectors 
-  EnsureSector(ix-1, iy-1); EnsureSector(ix, iy-1); EnsureSector(ix+1, iy-1);
-  EnsureSector(ix-1, iy);   EnsureSector(ix, iy);   EnsureSector(ix+1, iy);
-  EnsureSector(ix-1, iy+1); EnsureSector(ix, iy+1); EnsureSector(ix+1, iy+1); 
+  b2SectorObject* obj = nullptr;
+
+  // Ϳ ֱ  ڵ ؾ  b2ObjectId  ´.
+  // Ǯ Ҵ free list  ̹Ƿ ڵ  xlock ȿ Ѵ.
+  {
+    rx::xlock xlock(m_lock);
 
-  // ʹ  Ҹ Ƿ Ʒ ϴ. 
-  int cnt = ApplyNeighbors(ix, iy, [this, &aabb, obj](b2Sector* sector) {
-    if (sector->IsOverlapping(aabb))
+    void* mem = m_allocator.Allocate(sizeof(b2SectorObject));
+
+    if (shapeTemplate)
     {
-      auto proxyId = sector->CreateProxy(aabb, (void*)obj);
-      obj->AttachProxy(sector, proxyId);
-      return true;
+      obj = new (mem) b2SectorObject(
+        b2_nullObjectId, shapeTemplate->shape, filter, tf, userData, b2SectorObject::e_sharedShape, shapeTemplate);
+    }
+    else if (ownedShape)
+    {
+      obj = new (mem) b2SectorObject(b2_nullObjectId, ownedShape, filter, tf, userData);
+    }
+    else
+    {
+      obj = new (mem) b2SectorObject(
+        b2_nullObjectId, shape->Clone(&m_allocator), filter, tf, userData, b2SectorObject::e_pooledShape);
     }
 
-    return false;
+    obj->SetObjectId(AcquireObjectId(obj));
+  }
+
+  obj->SetLevel(level);
+  obj->SetRange(range);
+  obj->SetFatAABB(ComputeFatAABB(aabb, b2Vec2_zero));
+
+  EnsureRange(level, range);
+
+  // Ʒ ׸   ͸ . EvictSectors ͸  Spawn, Move 
+  // ÿ ȣ ʴ´ٴ ̹Ƿ EnsureRange  ʹ  ȣ    ִ.
+  int cnt = ApplyRange(level, range, [obj](b2Sector* sector) {
+    auto proxyId = sector->CreateProxy(obj->GetFatAABB(), (void*)obj, obj->GetFilter().categoryBits);
+    obj->AttachProxy(sector, proxyId);
+    return true;
     });
 
   b2Assert(cnt == obj->GetProxyCount());
 
-  // keep object
-  {
-    rx::xlock xlock(m_lock);
-    m_objects.insert(ObjectMap::value_type(obj->GetObjectId(), obj));
-  }
+  m_levels[level].objectCount.fetch_add(1, std::memory_order_relaxed);
 
   return std::pair(obj->GetObjectId(), b2Result::Success);
 }
 
 void b2SectorGrid::Despawn(b2ObjectId oid)
 {
+  CheckWritePhase();
+
   // Remove from Sectors
 
   // slock
   {
     rx::slock slock(m_lock);
 
-    auto iter = m_objects.find(oid);
-    if (iter != m_objects.end())
+    auto obj = FindObject(oid);
+    if (obj)
     {
-      auto obj = iter->second;
       obj->DetachProxyAll();
+      m_levels[obj->GetLevel()].objectCount.fetch_sub(1, std::memory_order_relaxed);
 
       // remove
       {
         rx::xlock xlock(m_lock);
-        m_objects.erase(oid);
-      }
+        ReleaseObjectId(oid);
 
-      delete obj;
+        //   Ʈ ų  Ƿ   Խ Ŀ .
+        if (m_settings.useSectorSnapshots)
+        {
+          m_retiredObjects[0].push_back(obj);
+          return;
+        }
+
+        DestroyObject(obj);
+      }
     }
   }
 }
 
 void b2SectorGrid::Move(b2ObjectId oid, const b2Vec2& position, const b2Rot& rotation)
 {
+  CheckWritePhase();
+
   //  Ʈ   忡 ѹ ȣѴٰ  
 
   // b2SectorObject ãƼ position, rotation tf  Ŀ 
@@ -138,12 +339,7 @@ void b2SectorGrid::Move(b2ObjectId oid, const b2Vec2& position, const b2Rot& rot
   // slock
   {
     rx::slock slock(m_lock);
-
-    auto iter = m_objects.find(oid);
-    if (iter != m_objects.end())
-    {
-      obj = iter->second;
-    }
+    obj = FindObject(oid);
   }
 
   if (obj == nullptr)
@@ -151,103 +347,2420 @@ void b2SectorGrid::Move(b2ObjectId oid, const b2Vec2& position, const b2Rot& rot
     return;
   }
 
+  //  ƽ ̵  ̵ Ѵ.
+  b2Vec2 displacement = position - obj->GetTransform().p;
+
   b2Transform tf(position, rotation);
   obj->UpdateTransfom(tf);
 
   b2AABB aabb;
-  obj->GetShape()->ComputeAABB(&aabb, tf, 0);
+  obj->ComputeAABB(&aabb, tf);
 
-  int ix = GetSectorIndexX(aabb.GetCenter().x);
-  int iy = GetSectorIndexX(aabb.GetCenter().y);
+  //  ȸص  ϳ  Spawn Ƿ ٲ ʴ´.
+  int level = obj->GetLevel();
 
-  b2Assert(CheckIndexBounds(ix, iy));
+  b2SectorRange range;
+  bool inside = GetSectorRange(level, aabb, range);
+  b2Assert(inside);
 
-  if (!CheckIndexBounds(ix, iy))
+  if (!inside || !CheckProxyCount(range))
   {
     return;
   }
 
-  // Ensure neighboring sectors 
-  EnsureSector(ix - 1, iy - 1); EnsureSector(ix, iy - 1); EnsureSector(ix + 1, iy - 1);
-  EnsureSector(ix - 1, iy);     EnsureSector(ix, iy);     EnsureSector(ix + 1, iy);
-  EnsureSector(ix - 1, iy + 1); EnsureSector(ix, iy + 1); EnsureSector(ix + 1, iy + 1);
+  //  ̵ fat AABB   Ʈ ״ д.
+  bool fatChanged = UpdateFatAABB(obj, aabb, displacement);
+  const b2AABB& fatAABB = obj->GetFatAABB();
+
+  // κ ƽ  ͵ ȿ ̹Ƿ Ͻø ű.
+  if (range == obj->GetRange())
+  {
+    if (fatChanged)
+    {
+      obj->MoveProxyAll(fatAABB, b2Vec2_zero);
+    }
+    else
+    {
+      obj->CountProxyMoves();
+    }
+    return;
+  }
 
+  //  ٲ ͵鸸  .
   // slock
   {
     rx::slock slock(m_lock);
-    obj->DetachProxy(aabb);
+
+    ApplyRangeDiff(level, obj->GetRange(), range, [&fatAABB, fatChanged, obj](b2Sector* sector, b2SectorProxyOp::Type type) {
+      switch (type)
+      {
+      case b2SectorProxyOp::Destroy:
+        obj->DetachProxy(sector);
+        break;
+      case b2SectorProxyOp::Move:
+      {
+        auto proxyId = obj->GetProxyIdBy(sector);
+        b2Assert(proxyId >= 0);
+
+        if (fatChanged)
+        {
+          sector->MoveProxy(proxyId, fatAABB, b2Vec2_zero);
+        }
+        else
+        {
+          sector->AddMoveCount();
+        }
+        break;
+      }
+      case b2SectorProxyOp::Create:
+      {
+        auto proxyId = sector->CreateProxy(fatAABB, (void*)obj, obj->GetFilter().categoryBits);
+        obj->AttachProxy(sector, proxyId);
+        break;
+      }
+      }
+      });
   }
 
-  // ġ attach    ͵鿡 ߰.
-  int cnt = ApplyNeighbors(ix, iy, [this, &aabb, obj](b2Sector* sector) {
-    if (sector->IsOverlapping(aabb))
+  obj->SetRange(range);
+}
+
+void b2SectorGrid::MoveBatch(const b2SectorMove* moves, int count)
+{
+  CheckWritePhase();
+
+  // Move   Ʈ  忡 ̵Ѵٰ 
+
+  // Ʈ     ͺ Ͽ 
+  // ͸ xlock ѹ  Ѵ. 
+
+  std::vector<b2SectorProxyOp> ops;
+  ops.reserve(count * 2);
+
+  // óϴ  Ʈ Despawn ʵ 
+  rx::slock slock(m_lock);
+
+  for (int i = 0; i < count; ++i)
+  {
+    const b2SectorMove& move = moves[i];
+
+    auto obj = FindObject(move.oid);
+    if (obj == nullptr)
+    {
+      continue;
+    }
+
+    b2Vec2 displacement = move.position - obj->GetTransform().p;
+
+    b2Transform tf(move.position, move.rotation);
+    obj->UpdateTransfom(tf);
+
+    b2AABB aabb;
+    obj->ComputeAABB(&aabb, tf);
+
+    int level = obj->GetLevel();
+
+    b2SectorRange range;
+    bool inside = GetSectorRange(level, aabb, range);
+    b2Assert(inside);
+
+    if (!inside || !CheckProxyCount(range))
     {
-      if (obj->IsAttached(sector))
+      continue;
+    }
+
+    bool fatChanged = UpdateFatAABB(obj, aabb, displacement);
+    const b2AABB& fatAABB = obj->GetFatAABB();
+
+    //   Move ´.  ʹ ٷ   Ϳ attach ڸ .
+    ApplyRangeDiff(level, obj->GetRange(), range, [&fatAABB, fatChanged, obj, &ops](b2Sector* sector, b2SectorProxyOp::Type type) {
+      switch (type)
+      {
+      case b2SectorProxyOp::Destroy:
+        obj->DetachProxy(sector, ops);
+        break;
+      case b2SectorProxyOp::Move:
       {
         auto proxyId = obj->GetProxyIdBy(sector);
         b2Assert(proxyId >= 0);
-        sector->MoveProxy(proxyId, aabb, b2Vec2());
-        return true;
+
+        if (fatChanged)
+        {
+          ops.push_back(b2SectorProxyOp{ sector, b2SectorProxyOp::Move, proxyId, fatAABB, obj });
+        }
+        else
+        {
+          sector->AddMoveCount();
+        }
+        break;
       }
-      // else
-      auto proxyId = sector->CreateProxy(aabb, (void*)obj);
-      obj->AttachProxy(sector, proxyId);
-      return true;
-    }
+      case b2SectorProxyOp::Create:
+        ops.push_back(b2SectorProxyOp{ sector, b2SectorProxyOp::Create, b2_nullNode, fatAABB, obj });
+        break;
+      }
+      });
 
-    return false;
-    });
+    obj->SetRange(range);
+  }
+
+  ApplyProxyOps(ops);
 }
 
-void b2SectorGrid::EnsureSector(int ix, int iy)
+void b2SectorGrid::ApplyProxyOps(std::vector<b2SectorProxyOp>& ops)
 {
-  // Spawn Move üũϹǷ     Ѵ. 
+  std::stable_sort(ops.begin(), ops.end(), [](const b2SectorProxyOp& a, const b2SectorProxyOp& b) {
+    if (a.sector->GetIndex() != b.sector->GetIndex())
+    {
+      return a.sector->GetIndex() < b.sector->GetIndex();
+    }
+    return a.type < b.type;
+    });
 
-  rx::slock slock(m_lock);
+  std::size_t begin = 0;
 
-  auto sector = GetSector(ix, iy);
-  if (sector == nullptr)
+  while (begin < ops.size())
   {
-    b2AABB bounds; 
-    bounds.lowerBound.x = m_sectorBoundsExtended.lowerBound.x + ix * m_settings.sectorSize;
-    bounds.lowerBound.y = m_sectorBoundsExtended.lowerBound.y + iy * m_settings.sectorSize;
-    bounds.upperBound.x = m_sectorBoundsExtended.lowerBound.x + (ix+1) * m_settings.sectorSize;
-    bounds.upperBound.y = m_sectorBoundsExtended.lowerBound.y + (iy+1) * m_settings.sectorSize;
+    std::size_t end = begin + 1;
 
-    auto sectorIndex = GetSectorIndexFrom(ix, iy);
-    sector = new b2Sector(sectorIndex, bounds);
+    while (end < ops.size() && ops[end].sector == ops[begin].sector)
+    {
+      ++end;
+    }
 
-    rx::xlock xlock(m_lock);
-    m_sectors.insert(SectorMap::value_type(sectorIndex, sector));
+    ops[begin].sector->ApplyProxyOps(&ops[begin], static_cast<int>(end - begin));
+    begin = end;
   }
 }
 
-int b2SectorGrid::AcquireObjectId()
+int b2SectorGrid::QueryObjects(const b2SectorCollider& collider, b2SectorQueryScratch& scratch)
 {
-  // xlock
+  CheckReadPhase();
+
+  auto& objects = scratch.objects;
+  objects.clear();
+
+  b2AABB aabb;
+  collider.GetShape()->ComputeAABB(&aabb, collider.GetTransform(), 0);
+
+  if (IsLockFreeRead())
   {
-    rx::xlock xlock(m_lock);
+    //  Ű Ʈ Խ     ʰ, Read ܰ迡 ƹ͵ ٲ ʴ´.
+    CollectObjects(aabb, objects, GetMaskBits(collider.GetFilter()));
+    return FilterObjects(collider, objects);
+  }
+
+  rx::slock slock(m_lock);
+
+  CollectObjects(aabb, objects, GetMaskBits(collider.GetFilter()));
+  return FilterObjects(collider, objects);
+}
+
+int b2SectorGrid::FilterObjects(const b2SectorCollider& collider, std::vector<b2SectorObject*>& objects)
+{
+  auto candidateCount = objects.size();
 
-    if (!m_idQueue.empty())
+  // detailed collision filtering
+  auto hitEnd = std::remove_if(objects.begin(), objects.end(), [this, &collider](const b2SectorObject* obj) {
+    if (!ShouldCollide(collider.GetFilter(), obj->GetFilter()))
     {
-      int id = m_idQueue.front();
-      m_idQueue.pop();
-      return id;
+      return true;
     }
+
+    return !b2TestOverlap(
+      collider.GetShape(), 0, obj->GetShape(), 0, collider.GetTransform(), obj->GetTransform()
+    );
+    });
+  objects.erase(hitEnd, objects.end());
+
+  CountQuery(candidateCount, objects.size());
+
+  return static_cast<int>(objects.size());
+}
+
+int b2SectorGrid::QuerySweepObjects(
+  const b2Shape* shape, const b2Filter& filter, 
+  const b2Transform& xfStart, const b2Transform& xfEnd, b2SectorQueryScratch& scratch)
+{
+  CheckReadPhase();
+
+  b2Assert(shape->GetChildCount() == 1);
+
+  auto& objects = scratch.objects;
+  auto& hits = scratch.hits;
+  objects.clear();
+  hits.clear();
+
+  b2AABB aabbStart, aabbEnd;
+  shape->ComputeAABB(&aabbStart, xfStart, 0);
+  shape->ComputeAABB(&aabbEnd, xfEnd, 0);
+
+  b2AABB sweptAABB;
+  sweptAABB.Combine(aabbStart, aabbEnd);
+
+  // ȸϸ ߰ ڼ  AABB   Ƿ    ´.
+  if (xfStart.q.s != xfEnd.q.s || xfStart.q.c != xfEnd.q.c)
+  {
+    float radius = 0.5f * GetShapeDiameter(shape);
+    b2Vec2 r(radius, radius);
+
+    sweptAABB.lowerBound = b2Min(sweptAABB.lowerBound, b2Min(xfStart.p, xfEnd.p) - r);
+    sweptAABB.upperBound = b2Max(sweptAABB.upperBound, b2Max(xfStart.p, xfEnd.p) + r);
   }
 
-  if (m_objectIdSequence < INT32_MAX)
+  if (IsLockFreeRead())
   {
-    return ++m_objectIdSequence;
+    CollectObjects(sweptAABB, objects, GetMaskBits(filter));
   }
   else
   {
-    throw std::exception("used all of the object ids");
+    rx::slock slock(m_lock);
+    CollectObjects(sweptAABB, objects, GetMaskBits(filter));
+  }
+
+  b2TOIInput input;
+  input.proxyA.Set(shape, 0);
+  input.sweepA.localCenter.SetZero();
+  input.sweepA.c0 = xfStart.p;
+  input.sweepA.c = xfEnd.p;
+  input.sweepA.a0 = xfStart.q.GetAngle();
+  input.sweepA.a = xfEnd.q.GetAngle();
+  input.sweepA.alpha0 = 0.0f;
+  input.tMax = 1.0f;
+
+  for (auto obj : objects)
+  {
+    if (!ShouldCollide(filter, obj->GetFilter()))
+    {
+      continue;
+    }
+
+    // Ʈ  ʴ  .
+    const b2Transform& xf = obj->GetTransform();
+
+    input.proxyB.Set(obj->GetShape(), 0);
+    input.sweepB.localCenter.SetZero();
+    input.sweepB.c0 = xf.p;
+    input.sweepB.c = xf.p;
+    input.sweepB.a0 = xf.q.GetAngle();
+    input.sweepB.a = input.sweepB.a0;
+    input.sweepB.alpha0 = 0.0f;
+
+    b2TOIOutput output;
+    b2TimeOfImpact(&output, &input);
+
+    switch (output.state)
+    {
+    case b2TOIOutput::e_overlapped:
+      hits.push_back(b2SectorSweepHit<b2SectorObject*>{ obj, 0.0f });
+      break;
+    case b2TOIOutput::e_touching:
+      hits.push_back(b2SectorSweepHit<b2SectorObject*>{ obj, output.t });
+      break;
+    case b2TOIOutput::e_failed:
+    {
+      // ݺ Ƚ ѱ   Ҵٴ  ƴϰ output.t  ִٰ Ȯε  ̴.
+      // b2World::SolveTOIó     ġ     浹 Ѵ.
+      b2DistanceInput distanceInput;
+      distanceInput.proxyA = input.proxyA;
+      distanceInput.proxyB = input.proxyB;
+      distanceInput.transformA = xfEnd;
+      distanceInput.transformB = xf;
+      distanceInput.useRadii = true;
+
+      b2SimplexCache cache;
+      cache.count = 0;
+      b2DistanceOutput distanceOutput;
+      b2Distance(&distanceOutput, &cache, &distanceInput);
+
+      if (distanceOutput.distance <= b2_linearSlop)
+      {
+        hits.push_back(b2SectorSweepHit<b2SectorObject*>{ obj, output.t });
+      }
+      break;
+    }
+    default:
+      break;
+    }
   }
+
+  // objects b2ObjectId ̹Ƿ stable_sort  toi b2ObjectId  Ѵ.
+  std::stable_sort(hits.begin(), hits.end(), 
+    [](const b2SectorSweepHit<b2SectorObject*>& a, const b2SectorSweepHit<b2SectorObject*>& b) {
+      return a.toi < b.toi;
+    });
+
+  CountQuery(objects.size(), hits.size());
+
+  return static_cast<int>(hits.size());
 }
 
-void b2SectorGrid::ReleaseObjectId(int id)
+int b2SectorGrid::QueryObjects(const b2AABB& aabb, b2SectorQueryScratch& scratch)
 {
-  rx::xlock xlock(m_lock);
-  m_idQueue.push(id);
+  CheckReadPhase();
+
+  scratch.objects.clear();
+
+  if (IsLockFreeRead())
+  {
+    CollectObjects(aabb, scratch.objects);
+    return static_cast<int>(scratch.objects.size());
+  }
+
+  rx::slock slock(m_lock);
+  CollectObjects(aabb, scratch.objects);
+
+  return static_cast<int>(scratch.objects.size());
+}
+
+void b2SectorGrid::RayCast(
+  const b2Vec2& p1, const b2Vec2& p2, const b2Filter& filter, const b2SectorRayCastCallback& callback)
+{
+  CheckReadPhase();
+
+  b2Vec2 d = p2 - p1;
+  if (d.LengthSquared() <= 0.0f)
+  {
+    return;
+  }
+
+  float maxFraction = 1.0f;
+  bool terminated = false;
+  uint16 maskBits = GetMaskBits(filter);
+  std::size_t candidateCount = 0;
+
+  // εģ Ʈ ϹǷ ª. 帶 ۸ Ͽ ̸ Ҵ ʴ´.
+  // callback ȿ ٽ RayCast ҷ ǵ ̹ ̴ visitedBegin ڸ .
+  static thread_local std::vector<const b2SectorObject*> visited;
+  const std::size_t visitedBegin = visited.size();
+
+  auto proxyCallback = [&](const b2RayCastInput& input, b2SectorObject* obj) -> float {
+    ++candidateCount;
+
+    if (!ShouldCollide(filter, obj->GetFilter()))
+    {
+      return -1.0f;
+    }
+
+    b2RayCastOutput output;
+    if (!obj->GetShape()->RayCast(&output, input, obj->GetTransform(), 0))
+    {
+      return -1.0f;
+    }
+
+    //  Ϳ ģ Ʈ ͸ Ͻð ִ. 
+    //  Ʈ  Ͻ  ٸ  Ƿ εģ Ʈ  Ѵ.
+    if (std::find(visited.begin() + visitedBegin, visited.end(), obj) != visited.end())
+    {
+      return -1.0f;
+    }
+
+    visited.push_back(obj);
+
+    b2Vec2 point = p1 + output.fraction * d;
+    float value = callback(obj, point, output.normal, output.fraction);
+
+    if (value == 0.0f)
+    {
+      terminated = true;
+      return 0.0f;
+    }
+
+    if (value < 0.0f)
+    {
+      return -1.0f;
+    }
+
+    maxFraction = b2Min(maxFraction, value);
+    return maxFraction;
+  };
+
+  auto rayCastLevels = [&]() {
+    for (int level = 0; level < m_levelCount && !terminated; ++level)
+    {
+      const Level& lv = m_levels[level];
+
+      if (lv.objectCount.load(std::memory_order_relaxed) == 0)
+      {
+        continue;
+      }
+
+      const b2Vec2 origin = lv.boundsExtended.lowerBound;
+      const float size = lv.sectorSize;
+
+      // ̸  ׸  ڸ (slab).
+      float tMin = 0.0f;
+      float tMax = maxFraction;
+      bool inside = true;
+
+      for (int axis = 0; axis < 2 && inside; ++axis)
+      {
+        float p = axis == 0 ? p1.x : p1.y;
+        float dir = axis == 0 ? d.x : d.y;
+        float lower = axis == 0 ? origin.x : origin.y;
+        float upper = lower + size * (axis == 0 ? lv.sectorCountX : lv.sectorCountY);
+
+        if (dir == 0.0f)
+        {
+          inside = lower <= p && p <= upper;
+          continue;
+        }
+
+        float t1 = (lower - p) / dir;
+        float t2 = (upper - p) / dir;
+        tMin = b2Max(tMin, b2Min(t1, t2));
+        tMax = b2Min(tMax, b2Max(t1, t2));
+        inside = tMin <= tMax;
+      }
+
+      if (!inside)
+      {
+        continue;
+      }
+
+      b2Vec2 start = p1 + tMin * d;
+      int ix = b2Clamp(static_cast<int>(std::floor((start.x - origin.x) / size)), 0, lv.sectorCountX - 1);
+      int iy = b2Clamp(static_cast<int>(std::floor((start.y - origin.y) / size)), 0, lv.sectorCountY - 1);
+
+      // Amanatides-Woo. tNext   踦  fraction
+      int stepX = d.x > 0.0f ? 1 : (d.x < 0.0f ? -1 : 0);
+      int stepY = d.y > 0.0f ? 1 : (d.y < 0.0f ? -1 : 0);
+
+      float tDeltaX = stepX != 0 ? size / b2Abs(d.x) : FLT_MAX;
+      float tDeltaY = stepY != 0 ? size / b2Abs(d.y) : FLT_MAX;
+
+      float tNextX = stepX != 0 ? (origin.x + (ix + (stepX > 0 ? 1 : 0)) * size - p1.x) / d.x : FLT_MAX;
+      float tNextY = stepY != 0 ? (origin.y + (iy + (stepY > 0 ? 1 : 0)) * size - p1.y) / d.y : FLT_MAX;
+
+      for (;;)
+      {
+        b2Sector* sector = GetSector(level, ix, iy);
+        if (sector)
+        {
+          b2RayCastInput input;
+          input.p1 = p1;
+          input.p2 = p2;
+          input.maxFraction = maxFraction;
+
+          sector->RayCast(input, proxyCallback, maskBits);
+
+          if (terminated)
+          {
+            return;
+          }
+        }
+
+        // ߸  ʸ ʹ 湮 ʴ´.
+        if (b2Min(tNextX, tNextY) > maxFraction)
+        {
+          break;
+        }
+
+        if (tNextX < tNextY)
+        {
+          ix += stepX;
+          tNextX += tDeltaX;
+        }
+        else
+        {
+          iy += stepY;
+          tNextY += tDeltaY;
+        }
+
+        if (ix < 0 || ix >= lv.sectorCountX || iy < 0 || iy >= lv.sectorCountY)
+        {
+          break;
+        }
+      }
+    }
+  };
+
+  if (IsLockFreeRead())
+  {
+    rayCastLevels();
+  }
+  else
+  {
+    rx::slock slock(m_lock);
+    rayCastLevels();
+  }
+
+  CountQuery(candidateCount, visited.size() - visitedBegin);
+  visited.resize(visitedBegin);
+}
+
+bool b2SectorGrid::RayCastClosest(const b2Vec2& p1, const b2Vec2& p2, const b2Filter& filter, b2SectorRayCastHit& hit)
+{
+  bool found = false;
+
+  RayCast(p1, p2, filter, [&hit, &found](b2SectorObject* object, const b2Vec2& point, const b2Vec2& normal, float fraction) {
+    // ̸ ڸǷ ߿ ȣɼ .
+    hit = b2SectorRayCastHit{ object, point, normal, fraction };
+    found = true;
+    return fraction;
+    });
+
+  return found;
+}
+
+int b2SectorGrid::QueryNearestObjects(
+  const b2Vec2& point, int k, float radius, const b2Filter& filter, b2SectorQueryScratch& scratch)
+{
+  CheckReadPhase();
+
+  scratch.nearest.clear();
+
+  // CollectNearest ã   ־ Ѵ.
+  if (k <= 0 || radius < 0.0f)
+  {
+    return 0;
+  }
+
+  //  0   Ÿ.
+  b2CircleShape circle;
+  circle.m_radius = 0.0f;
+  circle.m_p = point;
+
+  b2Transform xf;
+  xf.SetIdentity();
+
+  if (IsLockFreeRead())
+  {
+    CollectNearest(&circle, xf, nullptr, k, radius, filter, scratch);
+  }
+  else
+  {
+    rx::slock slock(m_lock);
+    CollectNearest(&circle, xf, nullptr, k, radius, filter, scratch);
+  }
+
+  return static_cast<int>(scratch.nearest.size());
+}
+
+int b2SectorGrid::QueryNearestObjects(
+  b2ObjectId oid, int k, float radius, const b2Filter& filter, b2SectorQueryScratch& scratch)
+{
+  CheckReadPhase();
+
+  scratch.nearest.clear();
+
+  if (k <= 0 || radius < 0.0f)
+  {
+    return 0;
+  }
+
+  std::optional<rx::slock> slock;
+  if (!IsReadPhase())
+  {
+    slock.emplace(m_lock);
+  }
+
+  const b2SectorObject* obj = FindObject(oid);
+  if (obj == nullptr)
+  {
+    return 0;
+  }
+
+  CollectNearest(obj->GetShape(), obj->GetTransform(), obj, k, radius, filter, scratch);
+
+  return static_cast<int>(scratch.nearest.size());
+}
+
+void b2SectorGrid::CollectNearest(
+  const b2Shape* shape, const b2Transform& xf, const b2SectorObject* exclude, 
+  int k, float radius, const b2Filter& filter, b2SectorQueryScratch& scratch)
+{
+  b2Assert(k > 0 && radius >= 0.0f);
+
+  auto& objects = scratch.objects;
+  auto& nearest = scratch.nearest;
+  nearest.clear();
+
+  //    nearest    տ ִ ̴.
+  const bool bounded = k < INT_MAX;
+  const uint16 maskBits = GetMaskBits(filter);
+  std::size_t candidateCount = 0;
+
+  auto byDistance = [](const b2SectorNearest<b2SectorObject*>& a, const b2SectorNearest<b2SectorObject*>& b) {
+    return a.distance < b.distance || (a.distance == b.distance && a.id->GetObjectId() < b.id->GetObjectId());
+  };
+
+  // ̺  Ʈ    .
+  auto getSearchDistance = [&]() {
+    return static_cast<int>(nearest.size()) < k ? radius : nearest.front().distance;
+  };
+
+  b2AABB aabb;
+  shape->ComputeAABB(&aabb, xf, 0);
+
+  b2DistanceInput input;
+  input.proxyA.Set(shape, 0);
+  input.transformA = xf;
+  input.useRadii = true;
+
+  auto visit = [&](b2Sector* sector) {
+    float searchDistance = getSearchDistance();
+
+    b2AABB searchAABB;
+    searchAABB.lowerBound = aabb.lowerBound - b2Vec2(searchDistance, searchDistance);
+    searchAABB.upperBound = aabb.upperBound + b2Vec2(searchDistance, searchDistance);
+
+    if (!sector->IsOverlapping(searchAABB))
+    {
+      return;
+    }
+
+    objects.clear();
+    candidateCount += sector->Query(searchAABB, objects, maskBits);
+
+    for (auto obj : objects)
+    {
+      if (obj == exclude || !ShouldCollide(filter, obj->GetFilter()))
+      {
+        continue;
+      }
+
+      // fat AABB Ÿ shape Ÿ .
+      if (GetDistance(aabb, obj->GetFatAABB()) > getSearchDistance())
+      {
+        continue;
+      }
+
+      //  Ϳ ģ Ʈ.      Ѵ.
+      if (bounded && std::find_if(nearest.begin(), nearest.end(), 
+        [obj](const b2SectorNearest<b2SectorObject*>& n) { return n.id == obj; }) != nearest.end())
+      {
+        continue;
+      }
+
+      input.proxyB.Set(obj->GetShape(), 0);
+      input.transformB = obj->GetTransform();
+
+      b2SimplexCache cache;
+      cache.count = 0;
+
+      b2DistanceOutput output;
+      b2Distance(&output, &cache, &input);
+
+      if (output.distance > getSearchDistance())
+      {
+        continue;
+      }
+
+      if (!bounded)
+      {
+        nearest.push_back(b2SectorNearest<b2SectorObject*>{ obj, output.distance });
+        continue;
+      }
+
+      if (static_cast<int>(nearest.size()) == k)
+      {
+        std::pop_heap(nearest.begin(), nearest.end(), byDistance);
+        nearest.pop_back();
+      }
+
+      nearest.push_back(b2SectorNearest<b2SectorObject*>{ obj, output.distance });
+      std::push_heap(nearest.begin(), nearest.end(), byDistance);
+    }
+  };
+
+  for (int level = 0; level < m_levelCount; ++level)
+  {
+    const Level& lv = m_levels[level];
+
+    if (lv.objectCount.load(std::memory_order_relaxed) == 0)
+    {
+      continue;
+    }
+
+    const b2Vec2 origin = lv.boundsExtended.lowerBound;
+    const float size = lv.sectorSize;
+
+    b2SectorRange range;
+    GetSectorRange(level, aabb, range);
+
+    for (int ring = 0; ; ++ring)
+    {
+      int x0 = range.ix0 - ring;
+      int y0 = range.iy0 - ring;
+      int x1 = range.ix1 + ring;
+      int y1 = range.iy1 + ring;
+
+      //   湮   Ʈ   Ÿ  ʴ.
+      if (ring > 0)
+      {
+        float gap = b2_maxFloat;
+
+        if (x0 + 1 > 0)
+        {
+          gap = b2Min(gap, aabb.lowerBound.x - (origin.x + (x0 + 1) * size));
+        }
+        if (x1 - 1 < lv.sectorCountX - 1)
+        {
+          gap = b2Min(gap, origin.x + x1 * size - aabb.upperBound.x);
+        }
+        if (y0 + 1 > 0)
+        {
+          gap = b2Min(gap, aabb.lowerBound.y - (origin.y + (y0 + 1) * size));
+        }
+        if (y1 - 1 < lv.sectorCountY - 1)
+        {
+          gap = b2Min(gap, origin.y + y1 * size - aabb.upperBound.y);
+        }
+
+        // ׸ ü 湮߰ų  Ͱ  ִ.
+        if (gap == b2_maxFloat || b2Max(gap, 0.0f) > getSearchDistance())
+        {
+          break;
+        }
+      }
+
+      for (int iy = b2Max(y0, 0); iy <= b2Min(y1, lv.sectorCountY - 1); ++iy)
+      {
+        if (ring == 0 || iy == y0 || iy == y1)
+        {
+          for (int ix = b2Max(x0, 0); ix <= b2Min(x1, lv.sectorCountX - 1); ++ix)
+          {
+            if (b2Sector* sector = GetSector(level, ix, iy))
+            {
+              visit(sector);
+            }
+          }
+
+          continue;
+        }
+
+        //    
+        b2Sector* sector = x0 >= 0 ? GetSector(level, x0, iy) : nullptr;
+        if (sector)
+        {
+          visit(sector);
+        }
+
+        sector = x1 < lv.sectorCountX ? GetSector(level, x1, iy) : nullptr;
+        if (sector)
+        {
+          visit(sector);
+        }
+      }
+    }
+  }
+
+  std::sort(nearest.begin(), nearest.end(), byDistance);
+
+  if (!bounded)
+  {
+    nearest.erase(std::unique(nearest.begin(), nearest.end(), 
+      [](const b2SectorNearest<b2SectorObject*>& a, const b2SectorNearest<b2SectorObject*>& b) {
+        return a.id == b.id;
+      }), nearest.end());
+  }
+
+  CountQuery(candidateCount, nearest.size());
+}
+
+void b2SectorGrid::FindAllPairs(
+  const b2Filter& filterA, const b2Filter& filterB, 
+  int workerCount, const b2SectorTaskExecutor& executor, b2SectorPairBatch& batch, 
+  const b2SectorPairCallback& callback)
+{
+  CheckReadPhase();
+
+  if (!executor || workerCount < 1)
+  {
+    workerCount = 1;
+  }
+
+  batch.workers.resize(workerCount);
+  batch.sectors.clear();
+
+  ForEachSector([&batch](b2Sector* sector) {
+    batch.sectors.push_back(sector);
+    });
+
+  //    ̺   ޶ ʰ Ѵ.
+  std::sort(batch.sectors.begin(), batch.sectors.end(), [](const b2Sector* a, const b2Sector* b) {
+    return a->GetIndex() < b->GetIndex();
+    });
+
+  int count = static_cast<int>(batch.sectors.size());
+
+  auto task = [this, &filterA, &filterB, count, workerCount, &batch](int workerIndex) {
+    auto& worker = batch.workers[workerIndex];
+    worker.pairs.clear();
+
+    int begin = static_cast<int>(static_cast<int64_t>(count) * workerIndex / workerCount);
+    int end = static_cast<int>(static_cast<int64_t>(count) * (workerIndex + 1) / workerCount);
+
+    if (IsLockFreeRead())
+    {
+      for (int i = begin; i < end; ++i)
+      {
+        FindPairsInSector(batch.sectors[i], filterA, filterB, worker);
+      }
+      return;
+    }
+
+    //  ͵ EvictSectors     Ƿ   ͸   ִ.
+    rx::slock slock(m_lock);
+
+    for (int i = begin; i < end; ++i)
+    {
+      FindPairsInSector(batch.sectors[i], filterA, filterB, worker);
+    }
+  };
+
+  if (executor && workerCount > 1)
+  {
+    executor(workerCount, task);
+  }
+  else
+  {
+    task(0);
+  }
+
+  // Ŀ   ̹Ƿ Ŀ  ȣϸ ȴ.
+  for (auto& worker : batch.workers)
+  {
+    for (auto& pair : worker.pairs)
+    {
+      callback(pair.first, pair.second);
+    }
+  }
+}
+
+void b2SectorGrid::FindAllPairs(const b2Filter& filterA, const b2Filter& filterB, const b2SectorPairCallback& callback)
+{
+  static thread_local b2SectorPairBatch batch;
+
+  FindAllPairs(filterA, filterB, 1, b2SectorTaskExecutor(), batch, callback);
+}
+
+void b2SectorGrid::FindPairsInSector(
+  b2Sector* sector, const b2Filter& filterA, const b2Filter& filterB, b2SectorPairBatch::Worker& worker)
+{
+  int level, sx, sy;
+  GetSectorCoord(sector->GetIndex(), level, sx, sy);
+
+  auto& objects = worker.scratch.objects;
+  auto& candidates = worker.candidates;
+
+  b2AABB everything;
+  everything.lowerBound.Set(-b2_maxFloat, -b2_maxFloat);
+  everything.upperBound.Set(b2_maxFloat, b2_maxFloat);
+
+  // a, b  ϳ filterA, ٸ ϳ filterB 浹ؾ Ѵ.
+  uint16 maskBits = GetMaskBits(filterA) | GetMaskBits(filterB);
+
+  objects.clear();
+  sector->Query(everything, objects, maskBits);
+
+  for (auto a : objects)
+  {
+    b2AABB aabb;
+    a->ComputeAABB(&aabb, a->GetTransform());
+
+    //     Ʈ  ִ ù Ϳ Ѵ.
+    const b2SectorRange& rangeA = a->GetRange();
+
+    candidates.clear();
+    sector->Query(aabb, candidates, maskBits);
+
+    for (auto b : candidates)
+    {
+      if (b->GetObjectId() <= a->GetObjectId())
+      {
+        continue;
+      }
+
+      const b2SectorRange& rangeB = b->GetRange();
+      if (b2Max(rangeA.ix0, rangeB.ix0) != sx || b2Max(rangeA.iy0, rangeB.iy0) != sy)
+      {
+        continue;
+      }
+
+      AddPair(a, b, filterA, filterB, worker.pairs);
+    }
+
+    //  ٸ  ū  Ʈ ù Ϳ   ˻Ѵ.
+    if (level == 0 || rangeA.ix0 != sx || rangeA.iy0 != sy)
+    {
+      continue;
+    }
+
+    candidates.clear();
+
+    for (int fine = 0; fine < level; ++fine)
+    {
+      if (m_levels[fine].objectCount.load(std::memory_order_relaxed) == 0)
+      {
+        continue;
+      }
+
+      b2SectorRange range;
+      GetSectorRange(fine, aabb, range);
+
+      ApplyRange(fine, range, [&aabb, &candidates, maskBits](b2Sector* s) {
+        s->Query(aabb, candidates, maskBits);
+        return true;
+        });
+    }
+
+    //    Ϳ ģ Ʈ
+    std::sort(candidates.begin(), candidates.end());
+    candidates.erase(std::unique(candidates.begin(), candidates.end()), candidates.end());
+
+    for (auto b : candidates)
+    {
+      AddPair(a, b, filterA, filterB, worker.pairs);
+    }
+  }
+}
+
+void b2SectorGrid::AddPair(
+  b2SectorObject* a, b2SectorObject* b, const b2Filter& filterA, const b2Filter& filterB, 
+  std::vector<std::pair<b2SectorObject*, b2SectorObject*>>& pairs)
+{
+  if (a->GetObjectId() > b->GetObjectId())
+  {
+    std::swap(a, b);
+  }
+
+  bool ab = ShouldCollide(filterA, a->GetFilter()) && ShouldCollide(filterB, b->GetFilter());
+  bool ba = !ab && ShouldCollide(filterA, b->GetFilter()) && ShouldCollide(filterB, a->GetFilter());
+
+  if (!ab && !ba)
+  {
+    return;
+  }
+
+  if (!b2TestOverlap(a->GetShape(), 0, b->GetShape(), 0, a->GetTransform(), b->GetTransform()))
+  {
+    return;
+  }
+
+  if (ab)
+  {
+    pairs.emplace_back(a, b);
+  }
+  else
+  {
+    pairs.emplace_back(b, a);
+  }
+}
+
+void b2SectorGrid::CollectObjects(const b2AABB& aabb, std::vector<b2SectorObject*>& objects, uint16 maskBits)
+{
+  for (int level = 0; level < m_levelCount; ++level)
+  {
+    if (m_levels[level].objectCount.load(std::memory_order_relaxed) == 0)
+    {
+      continue;
+    }
+
+    //   ߶󳻹Ƿ ͺ ū aabb ˻  ִ.
+    b2SectorRange range;
+    GetSectorRange(level, aabb, range);
+
+    ApplyRange(level, range, [&aabb, &objects, maskBits](b2Sector* sector) {
+      if (sector->IsOverlapping(aabb))
+      {
+        sector->Query(aabb, objects, maskBits);
+        return true;
+      }
+
+      return false;
+      });
+  }
+
+  //  Ϳ ģ Ʈ ͸ Ͻð Ƿ   ߺ .
+  // Ʈ  ȣ ϴ  ÿ Ǵ  浹ϹǷ  ʴ´.
+  std::sort(objects.begin(), objects.end(), [](const b2SectorObject* a, const b2SectorObject* b) {
+    return a->GetObjectId() < b->GetObjectId();
+    });
+  objects.erase(std::unique(objects.begin(), objects.end()), objects.end());
+}
+
+void b2SectorGrid::PublishSnapshots()
+{
+  CheckWritePhase();
+
+  b2Assert(m_settings.useSectorSnapshots);
+
+  ForEachSector([](b2Sector* sector) {
+    sector->PublishSnapshot();
+    });
+
+  //    Despawn Ʈ    Ű ʴ´.
+  std::vector<b2SectorObject*> released;
+
+  // xlock
+  {
+    rx::xlock xlock(m_lock);
+    released.swap(m_retiredObjects[1]);
+    m_retiredObjects[1].swap(m_retiredObjects[0]);
+
+    for (auto obj : released)
+    {
+      DestroyObject(obj);
+    }
+  }
+}
+
+void b2SectorGrid::BeginWrite()
+{
+  b2Assert(m_settings.useFramePhases);
+  b2Assert(m_phase.load(std::memory_order_relaxed) == b2SectorPhase::Idle);
+
+  m_phase.store(b2SectorPhase::Write, std::memory_order_release);
+}
+
+void b2SectorGrid::EndWrite()
+{
+  b2Assert(m_phase.load(std::memory_order_relaxed) == b2SectorPhase::Write);
+
+  m_phase.store(b2SectorPhase::Idle, std::memory_order_release);
+
+  //   Ʈ wide 带 ٽ  ϹǷ  Ѵ.
+  if (m_settings.treeOptimizeBudget > 0)
+  {
+    int32 budget = m_settings.treeOptimizeBudget;
+    ForEachSector([budget](b2Sector* sector) { sector->OptimizeTree(budget); });
+  }
+
+  // ٲ  ʹ wide 尡  Ƿ ٽ  ʴ´.
+  if (m_settings.useWideTrees)
+  {
+    ForEachSector([](b2Sector* sector) { sector->BuildWideNodes(); });
+  }
+
+  if (m_settings.useSectorSnapshots)
+  {
+    PublishSnapshots();
+  }
+}
+
+void b2SectorGrid::BeginRead()
+{
+  b2Assert(m_settings.useFramePhases);
+  b2Assert(m_phase.load(std::memory_order_relaxed) == b2SectorPhase::Idle);
+
+  m_phase.store(b2SectorPhase::Read, std::memory_order_release);
+}
+
+void b2SectorGrid::EndRead()
+{
+  b2Assert(m_phase.load(std::memory_order_relaxed) == b2SectorPhase::Read);
+
+  m_phase.store(b2SectorPhase::Idle, std::memory_order_release);
+}
+
+void b2SectorGrid::EnsureSector(int level, int ix, int iy)
+{
+  // Spawn Move üũϹǷ     Ѵ. 
+
+  if (m_settings.useDenseSectors)
+  {
+    const Level& lv = m_levels[level];
+    auto& slot = lv.denseSectors[iy * lv.sectorCountX + ix];
+
+    if (slot.load(std::memory_order_acquire) == nullptr)
+    {
+      auto sector = CreateSector(level, ix, iy);
+
+      // ٸ 尡  Խ  ʹ .
+      b2Sector* expected = nullptr;
+      if (!slot.compare_exchange_strong(expected, sector, std::memory_order_acq_rel))
+      {
+        DestroySector(sector);
+        return;
+      }
+
+      rx::xlock xlock(m_lock);
+      m_denseResidents.push_back(sector);
+    }
+    return;
+  }
+
+  rx::slock slock(m_lock);
+
+  auto sector = GetSector(level, ix, iy);
+  if (sector == nullptr)
+  {
+    sector = CreateSector(level, ix, iy);
+
+    rx::xlock xlock(m_lock);
+    if (!m_sectors.insert(SectorMap::value_type(GetSectorIndexFrom(level, ix, iy), sector)).second)
+    {
+      DestroySector(sector);
+    }
+  }
+}
+
+b2Sector* b2SectorGrid::CreateSector(int level, int ix, int iy)
+{
+  const Level& lv = m_levels[level];
+
+  b2AABB bounds; 
+  bounds.lowerBound.x = lv.boundsExtended.lowerBound.x + ix * lv.sectorSize;
+  bounds.lowerBound.y = lv.boundsExtended.lowerBound.y + iy * lv.sectorSize;
+  bounds.upperBound.x = lv.boundsExtended.lowerBound.x + (ix+1) * lv.sectorSize;
+  bounds.upperBound.y = lv.boundsExtended.lowerBound.y + (iy+1) * lv.sectorSize;
+
+  b2DynamicTree* tree = nullptr;
+
+  if (m_settings.sectorTreePoolSize > 0)
+  {
+    rx::xlock xlock(m_lock);
+
+    if (!m_treePool.empty())
+    {
+      tree = m_treePool.back();
+      m_treePool.pop_back();
+    }
+  }
+
+  return new b2Sector(
+    GetSectorIndexFrom(level, ix, iy), bounds, tree, m_settings.useFramePhases ? &m_phase : nullptr);
+}
+
+void b2SectorGrid::DestroySector(b2Sector* sector)
+{
+  auto tree = sector->ReleaseTree();
+  delete sector;
+
+  // xlock
+  {
+    rx::xlock xlock(m_lock);
+
+    if (static_cast<int>(m_treePool.size()) < m_settings.sectorTreePoolSize)
+    {
+      m_treePool.push_back(tree);
+      return;
+    }
+  }
+
+  delete tree;
+}
+
+int b2SectorGrid::EvictSectors()
+{
+  CheckWritePhase();
+
+  if (m_settings.sectorEvictTicks <= 0)
+  {
+    return 0;
+  }
+
+  // Spawn, Move   ͸  ۿ  ʹ ÿ ȣ ʴ´ٰ .
+  //    ׸ slock  ͸ Ƿ xlock ȿ  ʹ ٷ   ִ.
+
+  std::vector<b2Sector*> released;
+  int evictCount = 0;
+
+  rx::xlock xlock(m_lock);
+
+  auto evict = [this, &released](b2Sector* sector) {
+    if (m_settings.useSectorSnapshots)
+    {
+      //     ͸    ִ.
+      m_retiredSectors[0].push_back(sector);
+    }
+    else
+    {
+      released.push_back(sector);
+    }
+  };
+
+  if (m_settings.useSectorSnapshots)
+  {
+    released.swap(m_retiredSectors[1]);
+    m_retiredSectors[1].swap(m_retiredSectors[0]);
+  }
+
+  if (m_settings.useDenseSectors)
+  {
+    for (std::size_t i = 0; i < m_denseResidents.size(); )
+    {
+      auto sector = m_denseResidents[i];
+
+      if (sector->CountIdleTicks() >= m_settings.sectorEvictTicks)
+      {
+        GetDenseSlot(sector->GetIndex()).store(nullptr, std::memory_order_release);
+
+        m_denseResidents[i] = m_denseResidents.back();
+        m_denseResidents.pop_back();
+
+        evict(sector);
+        ++evictCount;
+        continue;
+      }
+
+      ++i;
+    }
+  }
+  else
+  {
+    for (auto iter = m_sectors.begin(); iter != m_sectors.end(); )
+    {
+      auto sector = iter->second;
+
+      if (sector->CountIdleTicks() >= m_settings.sectorEvictTicks)
+      {
+        iter = m_sectors.erase(iter);
+
+        evict(sector);
+        ++evictCount;
+        continue;
+      }
+
+      ++iter;
+    }
+  }
+
+  m_evictedSectorCount += evictCount;
+
+  for (auto sector : released)
+  {
+    DestroySector(sector);
+  }
+
+  return evictCount;
+}
+
+void b2SectorGrid::GetStats(b2SectorGridStats& stats, bool resetCounters)
+{
+  //   ۴ Ѵ.
+  auto sectors = std::move(stats.sectors);
+  sectors.clear();
+
+  stats = b2SectorGridStats();
+  stats.sectors = std::move(sectors);
+
+  rx::slock slock(m_lock);
+
+  for (int level = 0; level < m_levelCount; ++level)
+  {
+    const Level& lv = m_levels[level];
+    stats.levels.push_back(b2SectorLevelStats{ 
+      lv.sectorSize, lv.sectorCountX, lv.sectorCountY, lv.boundsExtended, lv.objectCount.load(std::memory_order_relaxed) });
+  }
+
+  // 0 0 ĭ, n floor(log2(n)) + 1 ĭ
+  auto getLogBucket = [](int n) {
+    int bucket = 0;
+    for (; n > 0 && bucket < b2SectorGridStats::HistogramSize - 1; n >>= 1)
+    {
+      ++bucket;
+    }
+    return bucket;
+  };
+
+  ForEachSector([this, &stats, &getLogBucket, resetCounters](b2Sector* sector) {
+    stats.residentSectorCount++;
+    stats.sectorMemory += sector->GetMemorySize();
+
+    b2SectorStats sectorStats;
+    sectorStats.index = sector->GetIndex();
+    GetSectorCoord(sectorStats.index, sectorStats.level, sectorStats.ix, sectorStats.iy);
+    sectorStats.bounds = sector->GetBounds();
+    sector->GetTreeMetrics(sectorStats.proxyCount, sectorStats.treeHeight);
+    sector->GetMoveCounts(sectorStats.moveCount, sectorStats.reinsertCount, resetCounters);
+    sector->GetQueryCounts(sectorStats.queryCount, sectorStats.candidateCount, resetCounters);
+    sectorStats.lockWaitTime = sector->GetLockWaitTime(resetCounters);
+
+    stats.proxyCount += sectorStats.proxyCount;
+    stats.moveCount += sectorStats.moveCount;
+    stats.reinsertCount += sectorStats.reinsertCount;
+    stats.lockWaitTime += sectorStats.lockWaitTime;
+
+    stats.proxyHistogram[getLogBucket(sectorStats.proxyCount)]++;
+    stats.treeHeightHistogram[b2Min(sectorStats.treeHeight, b2SectorGridStats::HistogramSize - 1)]++;
+
+    stats.sectors.push_back(sectorStats);
+    });
+
+  if (resetCounters)
+  {
+    stats.queryCount = m_queryCount.exchange(0, std::memory_order_relaxed);
+    stats.candidateCount = m_candidateCount.exchange(0, std::memory_order_relaxed);
+    stats.hitCount = m_hitCount.exchange(0, std::memory_order_relaxed);
+  }
+  else
+  {
+    stats.queryCount = m_queryCount.load(std::memory_order_relaxed);
+    stats.candidateCount = m_candidateCount.load(std::memory_order_relaxed);
+    stats.hitCount = m_hitCount.load(std::memory_order_relaxed);
+  }
+
+  for (auto& retired : m_retiredSectors)
+  {
+    for (auto sector : retired)
+    {
+      stats.sectorMemory += sector->GetMemorySize();
+    }
+  }
+
+  for (auto tree : m_treePool)
+  {
+    stats.sectorMemory += sizeof(b2DynamicTree) + tree->GetNodeCapacity() * sizeof(b2TreeNode);
+  }
+
+  if (m_settings.useDenseSectors)
+  {
+    for (int level = 0; level < m_levelCount; ++level)
+    {
+      const Level& lv = m_levels[level];
+      stats.sectorMemory += lv.sectorCountX * lv.sectorCountY * sizeof(std::atomic<b2Sector*>);
+    }
+
+    stats.sectorMemory += m_denseResidents.capacity() * sizeof(b2Sector*);
+  }
+  else
+  {
+    // Ŷ 迭  ϳ   
+    stats.sectorMemory += m_sectors.bucket_count() * sizeof(void*);
+    stats.sectorMemory += m_sectors.size() * (sizeof(SectorMap::value_type) + sizeof(void*));
+  }
+
+  stats.pooledTreeCount = static_cast<int>(m_treePool.size());
+  stats.evictedSectorCount = m_evictedSectorCount;
+}
+
+void b2SectorGridStats::GetHeatmap(int level, b2SectorHeatValue value, b2SectorHeatmap& heatmap) const
+{
+  b2Assert(0 <= level && level < static_cast<int>(levels.size()));
+
+  const b2SectorLevelStats& lv = levels[level];
+
+  heatmap.level = level;
+  heatmap.width = lv.sectorCountX;
+  heatmap.height = lv.sectorCountY;
+  heatmap.bounds = lv.bounds;
+  heatmap.sectorSize = lv.sectorSize;
+  heatmap.maxValue = 0.0f;
+  heatmap.cells.assign(static_cast<std::size_t>(lv.sectorCountX) * lv.sectorCountY, 0.0f);
+
+  for (auto& sector : sectors)
+  {
+    if (sector.level != level)
+    {
+      continue;
+    }
+
+    float v = 0.0f;
+
+    switch (value)
+    {
+    case b2SectorHeatValue::ProxyCount:
+      v = static_cast<float>(sector.proxyCount);
+      break;
+    case b2SectorHeatValue::TreeHeight:
+      v = static_cast<float>(sector.treeHeight);
+      break;
+    case b2SectorHeatValue::MoveCount:
+      v = static_cast<float>(sector.moveCount);
+      break;
+    case b2SectorHeatValue::ReinsertCount:
+      v = static_cast<float>(sector.reinsertCount);
+      break;
+    case b2SectorHeatValue::QueryCount:
+      v = static_cast<float>(sector.queryCount);
+      break;
+    case b2SectorHeatValue::CandidateCount:
+      v = static_cast<float>(sector.candidateCount);
+      break;
+    case b2SectorHeatValue::LockWaitTime:
+      v = static_cast<float>(sector.lockWaitTime);
+      break;
+    }
+
+    heatmap.cells[sector.iy * heatmap.width + sector.ix] = v;
+    heatmap.maxValue = b2Max(heatmap.maxValue, v);
+  }
+}
+
+void b2SectorHeatmap::WriteCsv(std::string& out) const
+{
+  char buf[32];
+
+  for (int iy = height - 1; iy >= 0; --iy)
+  {
+    for (int ix = 0; ix < width; ++ix)
+    {
+      snprintf(buf, sizeof(buf), ix == 0 ? "%g" : ",%g", GetValue(ix, iy));
+      out += buf;
+    }
+
+    out += '\n';
+  }
+}
+
+// Save  ó ("B2SG")  
+constexpr uint32 SaveMagic = 0x47533242;
+constexpr uint32 SaveVersion = 3;   // 2: useWideTrees, 3: treeOptimizeBudget
+
+// Save out ڿ  ״ δ
+struct b2SectorWriter
+{
+  template <typename T>
+  void Write(const T& value)
+  {
+    auto p = reinterpret_cast<const uint8_t*>(&value);
+    out.insert(out.end(), p, p + sizeof(T));
+  }
+
+  void Write(bool value)
+  {
+    Write(static_cast<uint8>(value ? 1 : 0));
+  }
+
+  std::vector<uint8_t>& out;
+};
+
+struct b2SectorReader
+{
+  //  Ͱ ڶ false
+  template <typename T>
+  bool Read(T& value)
+  {
+    if (static_cast<std::size_t>(end - p) < sizeof(T))
+    {
+      return false;
+    }
+
+    memcpy(&value, p, sizeof(T));
+    p += sizeof(T);
+    return true;
+  }
+
+  // NaN̳ Ѵ    ߸Ƿ ߸ ͷ .
+  bool Read(float& value)
+  {
+    return Read<float>(value) && b2IsValid(value);
+  }
+
+  bool Read(bool& value)
+  {
+    uint8 v;
+    if (!Read(v) || v > 1)
+    {
+      return false;
+    }
+
+    value = v != 0;
+    return true;
+  }
+
+  bool Read(b2Vec2& value)
+  {
+    return Read(value.x) && Read(value.y);
+  }
+
+  bool Read(b2AABB& value)
+  {
+    return Read(value.lowerBound) && Read(value.upperBound) && value.IsValid();
+  }
+
+  bool Read(b2Transform& value)
+  {
+    return Read(value.p) && Read(value.q.s) && Read(value.q.c);
+  }
+
+  //  ϳ elementSize Ʈ ̻ count  Ϳ   ִ 
+  bool CanHold(uint32 count, std::size_t elementSize) const
+  {
+    return count <= static_cast<std::size_t>(end - p) / elementSize;
+  }
+
+  const uint8_t* p;
+  const uint8_t* end;
+};
+
+// Load  shape  д. ø ϰų Ǯ Ѵ.
+struct b2SectorShapeBuffer
+{
+  b2CircleShape circle;
+  b2EdgeShape edge;
+  b2PolygonShape polygon;
+  b2ChainShape chain;
+};
+
+static void WriteShape(b2SectorWriter& writer, const b2Shape* shape)
+{
+  writer.Write(static_cast<uint8>(shape->m_type));
+  writer.Write(shape->m_radius);
+
+  switch (shape->m_type)
+  {
+  case b2Shape::e_circle:
+    writer.Write(static_cast<const b2CircleShape*>(shape)->m_p);
+    break;
+  case b2Shape::e_edge:
+  {
+    auto edge = static_cast<const b2EdgeShape*>(shape);
+    writer.Write(edge->m_vertex0);
+    writer.Write(edge->m_vertex1);
+    writer.Write(edge->m_vertex2);
+    writer.Write(edge->m_vertex3);
+    writer.Write(edge->m_oneSided);
+    break;
+  }
+  case b2Shape::e_polygon:
+  {
+    auto polygon = static_cast<const b2PolygonShape*>(shape);
+    writer.Write(polygon->m_count);
+    for (int32 i = 0; i < polygon->m_count; ++i)
+    {
+      writer.Write(polygon->m_vertices[i]);
+      writer.Write(polygon->m_normals[i]);
+    }
+    writer.Write(polygon->m_centroid);
+    break;
+  }
+  case b2Shape::e_chain:
+  {
+    // ڽ ϳ üθ Ʈ   ִ.
+    auto chain = static_cast<const b2ChainShape*>(shape);
+    b2Assert(chain->m_count == 2);
+    writer.Write(chain->m_vertices[0]);
+    writer.Write(chain->m_vertices[1]);
+    writer.Write(chain->m_prevVertex);
+    writer.Write(chain->m_nextVertex);
+    break;
+  }
+  default:
+    b2Assert(false);
+    break;
+  }
+}
+
+// WriteShape  shape buffer д´. ߸ ͸ nullptr
+static const b2Shape* ReadShape(b2SectorReader& reader, b2SectorShapeBuffer& buffer)
+{
+  uint8 type;
+  float radius;
+
+  if (!reader.Read(type) || !reader.Read(radius) || radius < 0.0f)
+  {
+    return nullptr;
+  }
+
+  switch (type)
+  {
+  case b2Shape::e_circle:
+  {
+    b2CircleShape& circle = buffer.circle;
+    circle.m_radius = radius;
+    return reader.Read(circle.m_p) ? &circle : nullptr;
+  }
+  case b2Shape::e_edge:
+  {
+    b2EdgeShape& edge = buffer.edge;
+    edge.m_radius = radius;
+    bool valid =
+      reader.Read(edge.m_vertex0) && reader.Read(edge.m_vertex1) &&
+      reader.Read(edge.m_vertex2) && reader.Read(edge.m_vertex3) &&
+      reader.Read(edge.m_oneSided);
+    return valid ? &edge : nullptr;
+  }
+  case b2Shape::e_polygon:
+  {
+    b2PolygonShape& polygon = buffer.polygon;
+    polygon.m_radius = radius;
+
+    if (!reader.Read(polygon.m_count) || polygon.m_count < 3 || polygon.m_count > b2_maxPolygonVertices)
+    {
+      return nullptr;
+    }
+
+    for (int32 i = 0; i < polygon.m_count; ++i)
+    {
+      if (!reader.Read(polygon.m_vertices[i]) || !reader.Read(polygon.m_normals[i]))
+      {
+        return nullptr;
+      }
+    }
+
+    return reader.Read(polygon.m_centroid) ? &polygon : nullptr;
+  }
+  case b2Shape::e_chain:
+  {
+    b2Vec2 vertices[2];
+    b2Vec2 prevVertex, nextVertex;
+
+    if (!reader.Read(vertices[0]) || !reader.Read(vertices[1]) ||
+        !reader.Read(prevVertex) || !reader.Read(nextVertex))
+    {
+      return nullptr;
+    }
+
+    // CreateChain ʹ   assertθ ´.
+    if (b2DistanceSquared(vertices[0], vertices[1]) <= b2_linearSlop * b2_linearSlop)
+    {
+      return nullptr;
+    }
+
+    b2ChainShape& chain = buffer.chain;
+    chain.Clear();
+    chain.CreateChain(vertices, 2, prevVertex, nextVertex);
+    chain.m_radius = radius;
+    return &chain;
+  }
+  default:
+    return nullptr;
+  }
+}
+
+//   д´.  assert ɸ ̸ false
+static bool ReadSettings(b2SectorReader& reader, b2SectorSettings& settings)
+{
+  uint32 magic, version;
+  if (!reader.Read(magic) || magic != SaveMagic || !reader.Read(version) || version < 1 || version > SaveVersion)
+  {
+    return false;
+  }
+
+  bool valid =
+    reader.Read(settings.bounds) &&
+    reader.Read(settings.sectorSize) &&
+    reader.Read(settings.useDenseSectors) &&
+    reader.Read(settings.preallocateSectors) &&
+    reader.Read(settings.useSectorSnapshots) &&
+    reader.Read(settings.levelCount) &&
+    reader.Read(settings.sectorEvictTicks) &&
+    reader.Read(settings.sectorTreePoolSize) &&
+    reader.Read(settings.proxyExtension) &&
+    reader.Read(settings.useFramePhases) &&
+    (version < 2 || reader.Read(settings.useWideTrees)) &&
+    (version < 3 || reader.Read(settings.treeOptimizeBudget));
+
+  //  l  ũⰡ sectorSize * 2^l ̹Ƿ   Ѵ.
+  return valid &&
+    settings.sectorSize >= 1.0f &&
+    settings.bounds.GetExtents().x >= settings.sectorSize / 2 &&
+    settings.bounds.GetExtents().y >= settings.sectorSize / 2 &&
+    settings.levelCount >= 1 && settings.levelCount <= 16 &&
+    settings.sectorEvictTicks >= 0 &&
+    settings.sectorTreePoolSize >= 0 &&
+    settings.proxyExtension >= 0.0f &&
+    settings.treeOptimizeBudget >= 0;
+}
+
+void b2SectorGrid::Save(std::vector<uint8_t>& out, const b2SectorUserDataSaver& saver, bool includeTrees)
+{
+  CheckReadPhase();
+
+  std::optional<rx::slock> slock;
+  if (!IsReadPhase())
+  {
+    slock.emplace(m_lock);
+  }
+
+  b2SectorWriter writer{ out };
+
+  writer.Write(SaveMagic);
+  writer.Write(SaveVersion);
+
+  writer.Write(m_settings.bounds);
+  writer.Write(m_settings.sectorSize);
+  writer.Write(m_settings.useDenseSectors);
+  writer.Write(m_settings.preallocateSectors);
+  writer.Write(m_settings.useSectorSnapshots);
+  writer.Write(m_settings.levelCount);
+  writer.Write(m_settings.sectorEvictTicks);
+  writer.Write(m_settings.sectorTreePoolSize);
+  writer.Write(m_settings.proxyExtension);
+  writer.Write(m_settings.useFramePhases);
+  writer.Write(m_settings.useWideTrees);
+  writer.Write(m_settings.treeOptimizeBudget);
+
+  std::unordered_map<const b2SectorShapeTemplate*, int32> templateIds;
+
+  writer.Write(static_cast<int32>(m_shapeTemplates.size()));
+  for (std::size_t i = 0; i < m_shapeTemplates.size(); ++i)
+  {
+    WriteShape(writer, m_shapeTemplates[i]->shape);
+    templateIds[m_shapeTemplates[i]] = static_cast<int32>(i);
+  }
+
+  //  Ե   ؾ Load Ŀ  ڵ  ȿ̰ 
+  //  Spawn ڵ鵵 .
+  writer.Write(static_cast<uint32>(m_objectSlots.size()));
+  writer.Write(m_freeObjectSlot);
+
+  for (auto& slot : m_objectSlots)
+  {
+    writer.Write(slot.generation);
+    writer.Write(slot.nextFree);
+    writer.Write(slot.object != nullptr);
+  }
+
+  for (auto& slot : m_objectSlots)
+  {
+    const b2SectorObject* obj = slot.object;
+    if (obj == nullptr)
+    {
+      continue;
+    }
+
+    if (obj->GetShapeTemplate())
+    {
+      writer.Write(templateIds[obj->GetShapeTemplate()]);
+    }
+    else
+    {
+      writer.Write(static_cast<int32>(-1));
+      WriteShape(writer, obj->GetShape());
+    }
+
+    writer.Write(obj->GetFilter());
+    writer.Write(obj->GetTransform());
+    writer.Write(static_cast<uint64_t>(saver(obj->GetUserData())));
+  }
+
+  writer.Write(includeTrees);
+
+  if (!includeTrees)
+  {
+    return;
+  }
+
+  //  ε  Ἥ  ¸  Ͱ  Ѵ.
+  std::vector<b2Sector*> sectors;
+  ForEachSector([&sectors](b2Sector* sector) { sectors.push_back(sector); });
+
+  std::sort(sectors.begin(), sectors.end(), [](const b2Sector* a, const b2Sector* b) {
+    return a->GetIndex() < b->GetIndex();
+    });
+
+  std::vector<b2TreeNode> nodes;
+
+  for (auto sector : sectors)
+  {
+    sector->CopyTree(nodes);
+    if (nodes.empty())
+    {
+      continue;
+    }
+
+    writer.Write(static_cast<int32>(sector->GetIndex()));
+    writer.Write(static_cast<int32>(nodes.size()));
+
+    // θ   AABB, , īװ Load ٽ Ѵ.
+    for (auto& node : nodes)
+    {
+      writer.Write(node.child1);
+
+      if (node.IsLeaf())
+      {
+        auto obj = static_cast<const b2SectorObject*>(node.userData);
+        writer.Write(b2GetObjectIndex(obj->GetObjectId()));
+        writer.Write(node.aabb);
+      }
+      else
+      {
+        writer.Write(node.child2);
+      }
+    }
+  }
+
+  writer.Write(static_cast<int32>(-1));
+}
+
+b2Result::Code b2SectorGrid::LoadSettings(const uint8_t* data, std::size_t size, b2SectorSettings& settings)
+{
+  b2SectorReader reader{ data, data + size };
+  return ReadSettings(reader, settings) ? b2Result::Success : b2Result::Fail_Invalid_Data;
+}
+
+b2Result::Code b2SectorGrid::Load(const uint8_t* data, std::size_t size, const b2SectorUserDataLoader& loader)
+{
+  CheckWritePhase();
+
+  b2SectorReader reader{ data, data + size };
+
+  b2SectorSettings saved;
+  if (!ReadSettings(reader, saved))
+  {
+    return b2Result::Fail_Invalid_Data;
+  }
+
+  rx::xlock xlock(m_lock);
+
+  if (!m_shapeTemplates.empty() || !m_objectSlots.empty())
+  {
+    return b2Result::Fail_Grid_Not_Empty;
+  }
+
+  b2SectorShapeBuffer buffer;
+
+  int32 templateCount;
+  if (!reader.Read(templateCount) || templateCount < 0)
+  {
+    return b2Result::Fail_Invalid_Data;
+  }
+
+  for (int32 i = 0; i < templateCount; ++i)
+  {
+    auto shape = ReadShape(reader, buffer);
+    if (shape == nullptr)
+    {
+      return b2Result::Fail_Invalid_Data;
+    }
+
+    RegisterShapeTemplate(*shape);
+  }
+
+  //  ,   , Ʈ  9 Ʈ.
+  uint32 slotCount, freeSlot;
+  if (!reader.Read(slotCount) || !reader.Read(freeSlot) || !reader.CanHold(slotCount, 9))
+  {
+    return b2Result::Fail_Invalid_Data;
+  }
+
+  m_objectSlots.resize(slotCount, ObjectSlot{ nullptr, 1, NullObjectSlot });
+  std::vector<bool> hasObject(slotCount);
+
+  for (uint32 i = 0; i < slotCount; ++i)
+  {
+    ObjectSlot& slot = m_objectSlots[i];
+    bool used;
+
+    if (!reader.Read(slot.generation) || slot.generation == 0 ||
+        !reader.Read(slot.nextFree) || (slot.nextFree != NullObjectSlot && slot.nextFree >= slotCount) ||
+        !reader.Read(used))
+    {
+      return b2Result::Fail_Invalid_Data;
+    }
+
+    hasObject[i] = used;
+  }
+
+  //     Ե    AcquireObjectId    ʴ´.
+  uint32 freeCount = static_cast<uint32>(std::count(hasObject.begin(), hasObject.end(), false));
+  uint32 visited = 0;
+
+  for (uint32 index = freeSlot; index != NullObjectSlot; index = m_objectSlots[index].nextFree)
+  {
+    if (index >= slotCount || hasObject[index] || visited == freeCount)
+    {
+      return b2Result::Fail_Invalid_Data;
+    }
+
+    ++visited;
+  }
+
+  if (visited != freeCount)
+  {
+    return b2Result::Fail_Invalid_Data;
+  }
+
+  m_freeObjectSlot = freeSlot;
+
+  for (uint32 index = 0; index < slotCount; ++index)
+  {
+    if (!hasObject[index])
+    {
+      continue;
+    }
+
+    int32 templateId;
+    if (!reader.Read(templateId) || templateId < -1 || templateId >= templateCount)
+    {
+      return b2Result::Fail_Invalid_Data;
+    }
+
+    const b2SectorShapeTemplate* shapeTemplate = templateId >= 0 ? m_shapeTemplates[templateId] : nullptr;
+    const b2Shape* shape = shapeTemplate ? shapeTemplate->shape : ReadShape(reader, buffer);
+
+    b2Filter filter;
+    b2Transform tf;
+    uint64_t key;
+
+    if (shape == nullptr || !reader.Read(filter) || !reader.Read(tf) || !reader.Read(key))
+    {
+      return b2Result::Fail_Invalid_Data;
+    }
+
+    void* userData = loader(key);
+    if (userData == nullptr)
+    {
+      return b2Result::Fail_Invalid_Data;
+    }
+
+    b2ObjectId oid = b2MakeObjectId(index, m_objectSlots[index].generation);
+
+    auto loaded = LoadObject(oid, shape, shapeTemplate, filter, tf, userData);
+    if (loaded.second != b2Result::Success)
+    {
+      return loaded.second;
+    }
+  }
+
+  bool hasTrees;
+  if (!reader.Read(hasTrees))
+  {
+    return b2Result::Fail_Invalid_Data;
+  }
+
+  //  ġ ٲ Ʈ   Ƿ  ʹ  ʴ´.
+  bool sameLayout =
+    saved.bounds.lowerBound == m_settings.bounds.lowerBound &&
+    saved.bounds.upperBound == m_settings.bounds.upperBound &&
+    saved.sectorSize == m_settings.sectorSize &&
+    saved.levelCount == m_settings.levelCount &&
+    saved.proxyExtension == m_settings.proxyExtension;
+
+  if (hasTrees && sameLayout)
+  {
+    auto code = LoadTrees(reader);
+    if (code != b2Result::Success)
+    {
+      return code;
+    }
+  }
+
+  // Ʈ  Ʈ ͺ  Ͻø .
+  std::vector<b2SectorProxyOp> ops;
+
+  for (auto& slot : m_objectSlots)
+  {
+    b2SectorObject* obj = slot.object;
+    if (obj == nullptr)
+    {
+      continue;
+    }
+
+    const b2SectorRange& range = obj->GetRange();
+
+    if (obj->GetProxyCount() > 0)
+    {
+      if (obj->GetProxyCount() != (range.ix1 - range.ix0 + 1) * (range.iy1 - range.iy0 + 1))
+      {
+        return b2Result::Fail_Invalid_Data;
+      }
+      continue;
+    }
+
+    EnsureRange(obj->GetLevel(), range);
+
+    ApplyRange(obj->GetLevel(), range, [obj, &ops](b2Sector* sector) {
+      ops.push_back(b2SectorProxyOp{ sector, b2SectorProxyOp::Create, b2_nullNode, obj->GetFatAABB(), obj });
+      return true;
+      });
+  }
+
+  ApplyProxyOps(ops);
+
+  return b2Result::Success;
+}
+
+std::pair<b2SectorObject*, b2Result::Code> b2SectorGrid::LoadObject(
+  b2ObjectId oid, const b2Shape* shape, const b2SectorShapeTemplate* shapeTemplate, 
+  const b2Filter& filter, const b2Transform& tf, void* userData)
+{
+  if (shape->GetChildCount() > 1)
+  {
+    return std::pair(nullptr, b2Result::Fail_Too_Many_Shape_Child_Count);
+  }
+
+  b2AABB aabb;
+  int level;
+
+  if (shapeTemplate)
+  {
+    shapeTemplate->ComputeAABB(&aabb, tf);
+    level = shapeTemplate->level;
+  }
+  else
+  {
+    shape->ComputeAABB(&aabb, tf, 0);
+    level = GetLevelFor(shape);
+  }
+
+  //  ǥ ʹ ũ  ε int Ƿ  Ÿ.
+  b2SectorRange range;
+  if (!m_levels[level].boundsExtended.Contains(aabb) || !GetSectorRange(level, aabb, range))
+  {
+    return std::pair(nullptr, b2Result::Fail_Invalid_Object_Position);
+  }
+
+  if (!CheckProxyCount(range))
+  {
+    return std::pair(nullptr, b2Result::Fail_Too_Large_Object);
+  }
+
+  void* mem = m_allocator.Allocate(sizeof(b2SectorObject));
+  b2SectorObject* obj;
+
+  if (shapeTemplate)
+  {
+    obj = new (mem) b2SectorObject(
+      oid, shapeTemplate->shape, filter, tf, userData, b2SectorObject::e_sharedShape, shapeTemplate);
+  }
+  else
+  {
+    obj = new (mem) b2SectorObject(
+      oid, shape->Clone(&m_allocator), filter, tf, userData, b2SectorObject::e_pooledShape);
+  }
+
+  m_objectSlots[b2GetObjectIndex(oid)].object = obj;
+
+  obj->SetLevel(level);
+  obj->SetRange(range);
+  obj->SetFatAABB(ComputeFatAABB(aabb, b2Vec2_zero));
+
+  m_levels[level].objectCount.fetch_add(1, std::memory_order_relaxed);
+
+  return std::pair(obj, b2Result::Success);
+}
+
+b2Result::Code b2SectorGrid::LoadTrees(b2SectorReader& reader)
+{
+  const Level& last = m_levels[m_levelCount - 1];
+  int sectorIndexEnd = last.indexBase + last.sectorCountX * last.sectorCountY;
+
+  std::vector<b2TreeNode> nodes;
+  std::vector<b2SectorObject*> leaves;
+
+  for (;;)
+  {
+    int32 sectorIndex;
+    if (!reader.Read(sectorIndex) || sectorIndex < -1 || sectorIndex >= sectorIndexEnd)
+    {
+      return b2Result::Fail_Invalid_Data;
+    }
+
+    if (sectorIndex == -1)
+    {
+      return b2Result::Success;
+    }
+
+    int level, ix, iy;
+    GetSectorCoord(sectorIndex, level, ix, iy);
+
+    //   child1, child2 8 Ʈ.
+    int32 nodeCount;
+    if (!reader.Read(nodeCount) || nodeCount < 1 || !reader.CanHold(static_cast<uint32>(nodeCount), 8))
+    {
+      return b2Result::Fail_Invalid_Data;
+    }
+
+    b2TreeNode empty = {};
+    empty.parent = b2_nullNode;
+    empty.child2 = b2_nullNode;
+    nodes.assign(nodeCount, empty);
+
+    for (int32 i = 0; i < nodeCount; ++i)
+    {
+      b2TreeNode& node = nodes[i];
+
+      if (!reader.Read(node.child1))
+      {
+        return b2Result::Fail_Invalid_Data;
+      }
+
+      if (node.IsLeaf())
+      {
+        uint32 slot;
+        if (!reader.Read(slot) || !reader.Read(node.aabb) || slot >= m_objectSlots.size())
+        {
+          return b2Result::Fail_Invalid_Data;
+        }
+
+        b2SectorObject* obj = m_objectSlots[slot].object;
+        if (obj == nullptr || obj->GetLevel() != level || !obj->GetRange().Contains(ix, iy))
+        {
+          return b2Result::Fail_Invalid_Data;
+        }
+
+        // fat AABB shape    Ʈ ģ.
+        b2AABB aabb;
+        obj->ComputeAABB(&aabb, obj->GetTransform());
+        if (!node.aabb.Contains(aabb))
+        {
+          return b2Result::Fail_Invalid_Data;
+        }
+
+        node.userData = obj;
+        node.height = 0;
+        node.categoryBits = obj->GetFilter().categoryBits;
+        continue;
+      }
+
+      //  켱 ̹Ƿ ڽ ڿ ְ θ ϳ̴.
+      if (!reader.Read(node.child2) ||
+          node.child1 <= i || node.child1 >= nodeCount ||
+          node.child2 <= i || node.child2 >= nodeCount ||
+          node.child1 == node.child2 ||
+          nodes[node.child1].parent != b2_nullNode || nodes[node.child2].parent != b2_nullNode)
+      {
+        return b2Result::Fail_Invalid_Data;
+      }
+
+      nodes[node.child1].parent = i;
+      nodes[node.child2].parent = i;
+    }
+
+    for (int32 i = 1; i < nodeCount; ++i)
+    {
+      if (nodes[i].parent == b2_nullNode)
+      {
+        return b2Result::Fail_Invalid_Data;
+      }
+    }
+
+    // ڽ θ𺸴 ڿ Ƿ ڿ  带 ä.
+    for (int32 i = nodeCount - 1; i >= 0; --i)
+    {
+      b2TreeNode& node = nodes[i];
+      if (node.IsLeaf())
+      {
+        continue;
+      }
+
+      const b2TreeNode& child1 = nodes[node.child1];
+      const b2TreeNode& child2 = nodes[node.child2];
+
+      node.aabb.Combine(child1.aabb, child2.aabb);
+      node.height = 1 + b2Max(child1.height, child2.height);
+      node.categoryBits = child1.categoryBits | child2.categoryBits;
+    }
+
+    EnsureSector(level, ix, iy);
+
+    b2Sector* sector = GetSector(level, ix, iy);
+    if (!sector->IsEmpty())
+    {
+      return b2Result::Fail_Invalid_Data;
+    }
+
+    //  Ʈ ͸ Ͻð ϳ̴.
+    leaves.clear();
+    for (auto& node : nodes)
+    {
+      if (node.IsLeaf())
+      {
+        leaves.push_back(static_cast<b2SectorObject*>(node.userData));
+      }
+    }
+
+    std::sort(leaves.begin(), leaves.end());
+    if (std::adjacent_find(leaves.begin(), leaves.end()) != leaves.end())
+    {
+      return b2Result::Fail_Invalid_Data;
+    }
+
+    sector->RestoreTree(nodes);
+
+    for (int32 i = 0; i < nodeCount; ++i)
+    {
+      const b2TreeNode& node = nodes[i];
+      if (!node.IsLeaf())
+      {
+        continue;
+      }
+
+      auto obj = static_cast<b2SectorObject*>(node.userData);
+      obj->AttachProxy(sector, i);
+
+      // Ʈ Ͻô   fat AABB .
+      if (obj->GetProxyCount() == 1)
+      {
+        obj->SetFatAABB(node.aabb);
+      }
+      else if (!(obj->GetFatAABB().lowerBound == node.aabb.lowerBound && obj->GetFatAABB().upperBound == node.aabb.upperBound))
+      {
+        return b2Result::Fail_Invalid_Data;
+      }
+    }
+  }
+}
+
+b2AABB b2SectorGrid::ComputeFatAABB(const b2AABB& aabb, const b2Vec2& displacement) const
+{
+  b2Vec2 r(m_settings.proxyExtension, m_settings.proxyExtension);
+
+  b2AABB fatAABB;
+  fatAABB.lowerBound = aabb.lowerBound - r;
+  fatAABB.upperBound = aabb.upperBound + r;
+
+  // ̵  ø
+  b2Vec2 d = b2_aabbMultiplier * displacement;
+
+  if (d.x < 0.0f)
+  {
+    fatAABB.lowerBound.x += d.x;
+  }
+  else
+  {
+    fatAABB.upperBound.x += d.x;
+  }
+
+  if (d.y < 0.0f)
+  {
+    fatAABB.lowerBound.y += d.y;
+  }
+  else
+  {
+    fatAABB.upperBound.y += d.y;
+  }
+
+  return fatAABB;
+}
+
+bool b2SectorGrid::UpdateFatAABB(b2SectorObject* obj, const b2AABB& aabb, const b2Vec2& displacement) const
+{
+  b2Vec2 r(m_settings.proxyExtension, m_settings.proxyExtension);
+  b2AABB fatAABB = ComputeFatAABB(aabb, displacement);
+
+  const b2AABB& current = obj->GetFatAABB();
+
+  if (current.Contains(aabb))
+  {
+    //  Ʈ fat AABB ʹ ũ  ʵ δ.
+    b2AABB hugeAABB;
+    hugeAABB.lowerBound = fatAABB.lowerBound - 4.0f * r;
+    hugeAABB.upperBound = fatAABB.upperBound + 4.0f * r;
+
+    if (hugeAABB.Contains(current))
+    {
+      return false;
+    }
+  }
+
+  obj->SetFatAABB(fatAABB);
+  return true;
+}
+
+float b2SectorGrid::GetShapeDiameter(const b2Shape* shape)
+{
+  //   AABB    Ÿ  ϸ 
+  //  ȸص AABB    ʴ´.
+  b2AABB local;
+  shape->ComputeAABB(&local, b2Transform(b2Vec2(0.0f, 0.0f), b2Rot(0.0f)), 0);
+
+  b2Vec2 corner(
+    b2Max(b2Abs(local.lowerBound.x), b2Abs(local.upperBound.x)),
+    b2Max(b2Abs(local.lowerBound.y), b2Abs(local.upperBound.y)));
+
+  return 2.0f * corner.Length();
+}
+
+float b2SectorGrid::GetDistance(const b2AABB& a, const b2AABB& b)
+{
+  b2Vec2 d = b2Max(b2Max(a.lowerBound - b.upperBound, b.lowerBound - a.upperBound), b2Vec2_zero);
+  return d.Length();
+}
+
+int b2SectorGrid::GetLevelFor(const b2Shape* shape) const
+{
+  float diameter = GetShapeDiameter(shape);
+
+  for (int level = 0; level < m_levelCount; ++level)
+  {
+    if (diameter <= m_levels[level].sectorSize)
+    {
+      return level;
+    }
+  }
+
+  //  ū  ְ   Spawn, Move ȮѴ.
+  return m_levelCount - 1;
+}
+
+bool b2SectorGrid::GetSectorRange(int level, const b2AABB& aabb, b2SectorRange& range) const
+{
+  const Level& lv = m_levels[level];
+  const b2Vec2& origin = lv.boundsExtended.lowerBound;
+
+  range.ix0 = static_cast<int>(std::floor((aabb.lowerBound.x - origin.x) / lv.sectorSize));
+  range.iy0 = static_cast<int>(std::floor((aabb.lowerBound.y - origin.y) / lv.sectorSize));
+  range.ix1 = static_cast<int>(std::floor((aabb.upperBound.x - origin.x) / lv.sectorSize));
+  range.iy1 = static_cast<int>(std::floor((aabb.upperBound.y - origin.y) / lv.sectorSize));
+
+  bool inside =
+    range.ix0 >= 0 && range.ix1 < lv.sectorCountX &&
+    range.iy0 >= 0 && range.iy1 < lv.sectorCountY;
+
+  range.ix0 = b2Max(range.ix0, 0);
+  range.iy0 = b2Max(range.iy0, 0);
+  range.ix1 = b2Min(range.ix1, lv.sectorCountX - 1);
+  range.iy1 = b2Min(range.iy1, lv.sectorCountY - 1);
+
+  return inside;
+}
+
+b2ObjectId b2SectorGrid::AcquireObjectId(b2SectorObject* obj)
+{
+  uint32 index = m_freeObjectSlot;
+
+  if (index != NullObjectSlot)
+  {
+    m_freeObjectSlot = m_objectSlots[index].nextFree;
+  }
+  else
+  {
+    b2Assert(m_objectSlots.size() < NullObjectSlot);
+
+    index = static_cast<uint32>(m_objectSlots.size());
+    m_objectSlots.push_back(ObjectSlot{ nullptr, 1, NullObjectSlot });
+  }
+
+  ObjectSlot& slot = m_objectSlots[index];
+  slot.object = obj;
+  slot.nextFree = NullObjectSlot;
+
+  return b2MakeObjectId(index, slot.generation);
+}
+
+void b2SectorGrid::DestroyObject(b2SectorObject* obj)
+{
+  // Ǯ Ҵ shape b2SectorObject  ʴ´.
+  if (obj->GetShapeStorage() == b2SectorObject::e_pooledShape)
+  {
+    FreeShape(const_cast<b2Shape*>(obj->GetShape()));
+  }
+
+  obj->~b2SectorObject();
+  m_allocator.Free(obj, sizeof(b2SectorObject));
+}
+
+void b2SectorGrid::FreeShape(b2Shape* shape)
+{
+  switch (shape->m_type)
+  {
+  case b2Shape::e_circle:
+    static_cast<b2CircleShape*>(shape)->~b2CircleShape();
+    m_allocator.Free(shape, sizeof(b2CircleShape));
+    break;
+  case b2Shape::e_edge:
+    static_cast<b2EdgeShape*>(shape)->~b2EdgeShape();
+    m_allocator.Free(shape, sizeof(b2EdgeShape));
+    break;
+  case b2Shape::e_polygon:
+    static_cast<b2PolygonShape*>(shape)->~b2PolygonShape();
+    m_allocator.Free(shape, sizeof(b2PolygonShape));
+    break;
+  case b2Shape::e_chain:
+    static_cast<b2ChainShape*>(shape)->~b2ChainShape();
+    m_allocator.Free(shape, sizeof(b2ChainShape));
+    break;
+  default:
+    b2Assert(false);
+    break;
+  }
+}
+
+void b2SectorGrid::ReleaseObjectId(b2ObjectId oid)
+{
+  uint32 index = b2GetObjectIndex(oid);
+  ObjectSlot& slot = m_objectSlots[index];
+  b2Assert(slot.generation == b2GetObjectGeneration(oid));
+
+  // 밡   Ƶ 0 ǳʶڴ.
+  slot.object = nullptr;
+  slot.generation = slot.generation == UINT32_MAX ? 1 : slot.generation + 1;
+  slot.nextFree = m_freeObjectSlot;
+  m_freeObjectSlot = index;
 }
@@ -0,0 +1,134 @@
+// MIT License
+
+// Copyright (c) 2020 Erin Catto
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#ifndef B2_WIDE_NODE_H
+#define B2_WIDE_NODE_H
+
+#include "box2d/b2_dynamic_tree.h"
+
+// The SIMD lane tests of b2WideNode. This is internal so that the intrinsics
+// headers stay out of the public API.
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define B2_WIDE_SSE2
+#include <emmintrin.h>
+#elif (defined(__ARM_NEON) && defined(__aarch64__)) || defined(_M_ARM64)
+#define B2_WIDE_NEON
+#include <arm_neon.h>
+#endif
+
+/// Get a bit per lane of node whose box overlaps aabb.
+inline int32 b2WideOverlapLanes(const b2WideNode& node, const b2AABB& aabb)
+{
+#if defined(B2_WIDE_SSE2)
+	__m128 lx = _mm_loadu_ps(node.lowerX);
+	__m128 ly = _mm_loadu_ps(node.lowerY);
+	__m128 ux = _mm_loadu_ps(node.upperX);
+	__m128 uy = _mm_loadu_ps(node.upperY);
+
+	__m128 m = _mm_and_ps(
+		_mm_and_ps(_mm_cmple_ps(lx, _mm_set1_ps(aabb.upperBound.x)), _mm_cmple_ps(ly, _mm_set1_ps(aabb.upperBound.y))),
+		_mm_and_ps(_mm_cmpge_ps(ux, _mm_set1_ps(aabb.lowerBound.x)), _mm_cmpge_ps(uy, _mm_set1_ps(aabb.lowerBound.y))));
+
+	return _mm_movemask_ps(m);
+#elif defined(B2_WIDE_NEON)
+	uint32x4_t m = vandq_u32(
+		vandq_u32(vcleq_f32(vld1q_f32(node.lowerX), vdupq_n_f32(aabb.upperBound.x)), vcleq_f32(vld1q_f32(node.lowerY), vdupq_n_f32(aabb.upperBound.y))),
+		vandq_u32(vcgeq_f32(vld1q_f32(node.upperX), vdupq_n_f32(aabb.lowerBound.x)), vcgeq_f32(vld1q_f32(node.upperY), vdupq_n_f32(aabb.lowerBound.y))));
+
+	static const uint32 laneBits[4] = { 1, 2, 4, 8 };
+	uint32x4_t bits = vld1q_u32(laneBits);
+	return int32(vaddvq_u32(vandq_u32(m, bits)));
+#else
+	int32 mask = 0;
+	for (int32 i = 0; i < 4; ++i)
+	{
+		if (node.lowerX[i] <= aabb.upperBound.x && node.lowerY[i] <= aabb.upperBound.y &&
+			node.upperX[i] >= aabb.lowerBound.x && node.upperY[i] >= aabb.lowerBound.y)
+		{
+			mask |= 1 << i;
+		}
+	}
+	return mask;
+#endif
+}
+
+/// Get a bit per lane of node whose box is not separated from the segment through p1
+/// along the axis v. This is the separating axis test of b2DynamicTree::RayCast.
+inline int32 b2WideSegmentAxisLanes(const b2WideNode& node, const b2Vec2& p1, const b2Vec2& v, const b2Vec2& abs_v)
+{
+#if defined(B2_WIDE_SSE2)
+	__m128 half = _mm_set1_ps(0.5f);
+	__m128 lx = _mm_loadu_ps(node.lowerX);
+	__m128 ly = _mm_loadu_ps(node.lowerY);
+	__m128 ux = _mm_loadu_ps(node.upperX);
+	__m128 uy = _mm_loadu_ps(node.upperY);
+
+	__m128 cx = _mm_mul_ps(_mm_add_ps(lx, ux), half);
+	__m128 cy = _mm_mul_ps(_mm_add_ps(ly, uy), half);
+	__m128 hx = _mm_mul_ps(_mm_sub_ps(ux, lx), half);
+	__m128 hy = _mm_mul_ps(_mm_sub_ps(uy, ly), half);
+
+	// |dot(v, p1 - c)| <= dot(|v|, h)
+	__m128 d = _mm_add_ps(
+		_mm_mul_ps(_mm_set1_ps(v.x), _mm_sub_ps(_mm_set1_ps(p1.x), cx)),
+		_mm_mul_ps(_mm_set1_ps(v.y), _mm_sub_ps(_mm_set1_ps(p1.y), cy)));
+	d = _mm_andnot_ps(_mm_set1_ps(-0.0f), d);
+	__m128 e = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(abs_v.x), hx), _mm_mul_ps(_mm_set1_ps(abs_v.y), hy));
+
+	return _mm_movemask_ps(_mm_cmple_ps(d, e));
+#elif defined(B2_WIDE_NEON)
+	float32x4_t half = vdupq_n_f32(0.5f);
+	float32x4_t lx = vld1q_f32(node.lowerX);
+	float32x4_t ly = vld1q_f32(node.lowerY);
+	float32x4_t ux = vld1q_f32(node.upperX);
+	float32x4_t uy = vld1q_f32(node.upperY);
+
+	float32x4_t cx = vmulq_f32(vaddq_f32(lx, ux), half);
+	float32x4_t cy = vmulq_f32(vaddq_f32(ly, uy), half);
+	float32x4_t hx = vmulq_f32(vsubq_f32(ux, lx), half);
+	float32x4_t hy = vmulq_f32(vsubq_f32(uy, ly), half);
+
+	float32x4_t d = vaddq_f32(
+		vmulq_f32(vdupq_n_f32(v.x), vsubq_f32(vdupq_n_f32(p1.x), cx)),
+		vmulq_f32(vdupq_n_f32(v.y), vsubq_f32(vdupq_n_f32(p1.y), cy)));
+	float32x4_t e = vaddq_f32(vmulq_f32(vdupq_n_f32(abs_v.x), hx), vmulq_f32(vdupq_n_f32(abs_v.y), hy));
+
+	static const uint32 laneBits[4] = { 1, 2, 4, 8 };
+	uint32x4_t bits = vld1q_u32(laneBits);
+	return int32(vaddvq_u32(vandq_u32(vcleq_f32(vabsq_f32(d), e), bits)));
+#else
+	int32 mask = 0;
+	for (int32 i = 0; i < 4; ++i)
+	{
+		b2Vec2 c(0.5f * (node.lowerX[i] + node.upperX[i]), 0.5f * (node.lowerY[i] + node.upperY[i]));
+		b2Vec2 h(0.5f * (node.upperX[i] - node.lowerX[i]), 0.5f * (node.upperY[i] - node.lowerY[i]));
+		if (b2Abs(b2Dot(v, p1 - c)) <= b2Dot(abs_v, h))
+		{
+			mask |= 1 << i;
+		}
+	}
+	return mask;
+#endif
+}
+
+#endif
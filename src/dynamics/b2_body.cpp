@@ -121,6 +121,9 @@ void b2Body::SetType(b2BodyType type)
 		return;
 	}
 
+	// Static proxies live in their own broad-phase tree.
+	bool moveProxies = (m_type == b2_staticBody) != (type == b2_staticBody);
+
 	m_type = type;
 
 	ResetMassData();
@@ -150,8 +153,20 @@ void b2Body::SetType(b2BodyType type)
 	}
 	m_contactList = nullptr;
 
-	// Touch the proxies so that new contacts will be created (when appropriate)
 	b2BroadPhase* broadPhase = &m_world->m_contactManager.m_broadPhase;
+	if (moveProxies && (m_flags & e_enabledFlag))
+	{
+		// New proxies in the other tree are buffered like touched ones.
+		for (b2Fixture* f = m_fixtureList; f; f = f->m_next)
+		{
+			f->DestroyProxies(broadPhase);
+		}
+
+		CreateProxies(m_fixtureList, nullptr);
+		return;
+	}
+
+	// Touch the proxies so that new contacts will be created (when appropriate)
 	for (b2Fixture* f = m_fixtureList; f; f = f->m_next)
 	{
 		int32 proxyCount = f->m_proxyCount;
@@ -176,18 +191,18 @@ b2Fixture* b2Body::CreateFixture(const b2FixtureDef* def)
 	b2Fixture* fixture = new (memory) b2Fixture;
 	fixture->Create(allocator, this, def);
 
-	if (m_flags & e_enabledFlag)
-	{
-		b2BroadPhase* broadPhase = &m_world->m_contactManager.m_broadPhase;
-		fixture->CreateProxies(broadPhase, m_xf);
-	}
-
 	fixture->m_next = m_fixtureList;
 	m_fixtureList = fixture;
 	++m_fixtureCount;
 
 	fixture->m_body = this;
 
+	// A chain shape with many children gets its proxies in one batch.
+	if (m_flags & e_enabledFlag)
+	{
+		CreateProxies(fixture, fixture->m_next);
+	}
+
 	// Adjust mass properties if needed.
 	if (fixture->m_density > 0.0f)
 	{
@@ -201,6 +216,56 @@ b2Fixture* b2Body::CreateFixture(const b2FixtureDef* def)
 	return fixture;
 }
 
+void b2Body::CreateFixtures(const b2FixtureDef* defs, int32 count, b2Fixture** fixtures)
+{
+	b2Assert(m_world->IsLocked() == false);
+	if (m_world->IsLocked() == true)
+	{
+		return;
+	}
+
+	b2BlockAllocator* allocator = &m_world->m_blockAllocator;
+
+	b2Fixture* oldList = m_fixtureList;
+	bool hasDensity = false;
+
+	for (int32 i = 0; i < count; ++i)
+	{
+		void* memory = allocator->Allocate(sizeof(b2Fixture));
+		b2Fixture* fixture = new (memory) b2Fixture;
+		fixture->Create(allocator, this, defs + i);
+
+		fixture->m_next = m_fixtureList;
+		m_fixtureList = fixture;
+		++m_fixtureCount;
+
+		fixture->m_body = this;
+
+		hasDensity = hasDensity || fixture->m_density > 0.0f;
+
+		if (fixtures)
+		{
+			fixtures[i] = fixture;
+		}
+	}
+
+	// The new fixtures are at the front of the list.
+	if (m_flags & e_enabledFlag)
+	{
+		CreateProxies(m_fixtureList, oldList);
+	}
+
+	// Adjust mass properties if needed.
+	if (hasDensity)
+	{
+		ResetMassData();
+	}
+
+	// Let the world know we have new fixtures. This will cause new contacts
+	// to be created at the beginning of the next time step.
+	m_world->m_newContacts = true;
+}
+
 b2Fixture* b2Body::CreateFixture(const b2Shape* shape, float density)
 {
 	b2FixtureDef def;
@@ -439,6 +504,50 @@ void b2Body::SetTransform(const b2Vec2& position, float angle)
 	m_world->m_newContacts = true;
 }
 
+void b2Body::CreateProxies(b2Fixture* first, b2Fixture* last)
+{
+	b2BroadPhase* broadPhase = &m_world->m_contactManager.m_broadPhase;
+
+	int32 count = 0;
+	for (b2Fixture* f = first; f != last; f = f->m_next)
+	{
+		count += f->m_shape->GetChildCount();
+	}
+
+	if (count < b2_minBulkProxyCount)
+	{
+		for (b2Fixture* f = first; f != last; f = f->m_next)
+		{
+			f->CreateProxies(broadPhase, m_xf);
+		}
+		return;
+	}
+
+	b2TreeProxyDef* defs = (b2TreeProxyDef*)b2Alloc(count * sizeof(b2TreeProxyDef));
+	int32* proxyIds = (int32*)b2Alloc(count * sizeof(int32));
+
+	int32 index = 0;
+	for (b2Fixture* f = first; f != last; f = f->m_next)
+	{
+		index += f->InitProxies(m_xf, defs + index);
+	}
+
+	b2BroadPhase::ProxyType type = m_type == b2_staticBody ? b2BroadPhase::e_staticProxy : b2BroadPhase::e_movableProxy;
+	broadPhase->CreateProxies(defs, count, proxyIds, type);
+
+	index = 0;
+	for (b2Fixture* f = first; f != last; f = f->m_next)
+	{
+		for (int32 i = 0; i < f->m_proxyCount; ++i)
+		{
+			f->m_proxies[i].proxyId = proxyIds[index++];
+		}
+	}
+
+	b2Free(proxyIds);
+	b2Free(defs);
+}
+
 void b2Body::SynchronizeFixtures()
 {
 	b2BroadPhase* broadPhase = &m_world->m_contactManager.m_broadPhase;
@@ -477,11 +586,7 @@ void b2Body::SetEnabled(bool flag)
 		m_flags |= e_enabledFlag;
 
 		// Create all proxies.
-		b2BroadPhase* broadPhase = &m_world->m_contactManager.m_broadPhase;
-		for (b2Fixture* f = m_fixtureList; f; f = f->m_next)
-		{
-			f->CreateProxies(broadPhase, m_xf);
-		}
+		CreateProxies(m_fixtureList, nullptr);
 
 		// Contacts are created at the beginning of the next
 		m_world->m_newContacts = true;
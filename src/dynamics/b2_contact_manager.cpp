@@ -200,11 +200,15 @@ void b2ContactManager::AddPair(void* proxyUserDataA, void* proxyUserDataB)
 
 	// TODO_ERIN use a hash table to remove a potential bottleneck when both
 	// bodies have a lot of contacts.
-	// Does a contact already exist?
-	b2ContactEdge* edge = bodyB->GetContactList();
+	// Does a contact already exist? Static ground touches many bodies, so search
+	// the contact list of the other body.
+	b2Body* searchBody = bodyB->GetType() == b2_staticBody ? bodyA : bodyB;
+	b2Body* otherBody = searchBody == bodyB ? bodyA : bodyB;
+
+	b2ContactEdge* edge = searchBody->GetContactList();
 	while (edge)
 	{
-		if (edge->other == bodyA)
+		if (edge->other == otherBody)
 		{
 			b2Fixture* fA = edge->contact->GetFixtureA();
 			b2Fixture* fB = edge->contact->GetFixtureB();
@@ -130,16 +130,40 @@ void b2Fixture::CreateProxies(b2BroadPhase* broadPhase, const b2Transform& xf)
 	// Create proxies in the broad-phase.
 	m_proxyCount = m_shape->GetChildCount();
 
+	// Static bodies keep their proxies in the static tree.
+	b2BroadPhase::ProxyType type = m_body->GetType() == b2_staticBody ? b2BroadPhase::e_staticProxy : b2BroadPhase::e_movableProxy;
 	for (int32 i = 0; i < m_proxyCount; ++i)
 	{
 		b2FixtureProxy* proxy = m_proxies + i;
 		m_shape->ComputeAABB(&proxy->aabb, xf, i);
-		proxy->proxyId = broadPhase->CreateProxy(proxy->aabb, proxy);
+		proxy->proxyId = broadPhase->CreateProxy(proxy->aabb, proxy, type);
 		proxy->fixture = this;
 		proxy->childIndex = i;
 	}
 }
 
+int32 b2Fixture::InitProxies(const b2Transform& xf, b2TreeProxyDef* defs)
+{
+	b2Assert(m_proxyCount == 0);
+
+	m_proxyCount = m_shape->GetChildCount();
+
+	for (int32 i = 0; i < m_proxyCount; ++i)
+	{
+		b2FixtureProxy* proxy = m_proxies + i;
+		m_shape->ComputeAABB(&proxy->aabb, xf, i);
+		proxy->proxyId = b2BroadPhase::e_nullProxy;
+		proxy->fixture = this;
+		proxy->childIndex = i;
+
+		defs[i].aabb = proxy->aabb;
+		defs[i].userData = proxy;
+		defs[i].categoryBits = 0xFFFF;
+	}
+
+	return m_proxyCount;
+}
+
 void b2Fixture::DestroyProxies(b2BroadPhase* broadPhase)
 {
 	// Destroy proxies in the broad-phase.
@@ -54,6 +54,7 @@ b2World::b2World(const b2Vec2& gravity)
 	m_warmStarting = true;
 	m_continuousPhysics = true;
 	m_subStepping = false;
+	m_treeOptimizeBudget = 0;
 
 	m_stepComplete = true;
 
@@ -107,6 +108,11 @@ void b2World::SetContactListener(b2ContactListener* listener)
 	m_contactManager.m_contactListener = listener;
 }
 
+void b2World::SetTaskExecutor(b2TaskExecutor* executor)
+{
+	m_contactManager.m_broadPhase.SetTaskExecutor(executor);
+}
+
 void b2World::SetDebugDraw(b2Draw* debugDraw)
 {
 	m_debugDraw = debugDraw;
@@ -577,6 +583,7 @@ void b2World::Solve(const b2TimeStep& step)
 
 		// Look for new contacts.
 		m_contactManager.FindNewContacts();
+		m_contactManager.m_broadPhase.Optimize(m_treeOptimizeBudget);
 		m_profile.broadphase = timer.GetMilliseconds();
 	}
 }
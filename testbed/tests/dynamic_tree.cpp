@@ -58,6 +58,8 @@ public:
 		m_rayCastInput.maxFraction = 1.0f;
 
 		m_automated = false;
+		m_useWideNodes = false;
+		m_queryTime = 0.0f;
 	}
 
 	static Test* Create()
@@ -86,8 +88,16 @@ public:
 			}
 		}
 
+		// The wide nodes are rebuilt only after the tree has changed.
+		if (m_useWideNodes && m_tree.HasWideNodes() == false)
+		{
+			m_tree.BuildWideNodes();
+		}
+
+		b2Timer timer;
 		Query();
 		RayCast();
+		m_queryTime = 0.9f * m_queryTime + 0.1f * timer.GetMilliseconds();
 
 		for (int32 i = 0; i < e_actorCount; ++i)
 		{
@@ -135,6 +145,10 @@ public:
 			m_textLine += m_textIncrement;
 		}
 
+		g_debugDraw.DrawString(5, m_textLine, "wide nodes (w) = %s, query + ray cast = %.3f ms",
+			m_useWideNodes ? "on" : "off", m_queryTime);
+		m_textLine += m_textIncrement;
+
 		g_debugDraw.Flush();
 
 		++m_stepCount;
@@ -159,6 +173,14 @@ public:
 		case GLFW_KEY_M:
 			MoveProxy();
 			break;
+
+		case GLFW_KEY_W:
+			m_useWideNodes = !m_useWideNodes;
+			if (m_useWideNodes == false)
+			{
+				m_tree.ClearWideNodes();
+			}
+			break;
 		}
 	}
 
@@ -357,6 +379,8 @@ private:
 	Actor m_actors[e_actorCount];
 	int32 m_stepCount;
 	bool m_automated;
+	bool m_useWideNodes;
+	float m_queryTime;
 };
 
 static int testIndex = RegisterTest("Collision", "Dynamic Tree", DynamicTree::Create);
@@ -440,12 +440,19 @@ public:
 
 		m_paused = settings.m_pause;
 
+		if (m_showHeatmap)
+		{
+			DrawHeatmap();
+		}
+
 		DrawGrids();
 		DrawActors();
 		DrawProjectiles();
 		DrawMouseOBB();
 
 		g_debugDraw.DrawString(b2Vec2(0, 0), m_coord.c_str());
+		g_debugDraw.DrawString(5, m_textLine, "Heatmap of proxies per sector (h)");
+		m_textLine += m_textIncrement;
 		g_debugDraw.Flush();
 
     std::this_thread::sleep_for(std::chrono::milliseconds(10));
@@ -467,6 +474,47 @@ public:
     m_coord = buf;
 	}
 
+	void Keyboard(int key) override
+	{
+		if (key == GLFW_KEY_H)
+		{
+			m_showHeatmap = !m_showHeatmap;
+		}
+	}
+
+	// ͺ Ͻ   ĥѴ.  30 ܸ 
+	void DrawHeatmap()
+	{
+		if (m_stepCount++ % 30 == 0)
+		{
+			m_grid->GetStats(m_stats, true);
+			m_stats.GetHeatmap(0, b2SectorHeatValue::ProxyCount, m_heatmap);
+		}
+
+		if (m_heatmap.maxValue <= 0.0f)
+		{
+			return;
+		}
+
+		for (int iy = 0; iy < m_heatmap.height; ++iy)
+		{
+			for (int ix = 0; ix < m_heatmap.width; ++ix)
+			{
+				float heat = m_heatmap.GetValue(ix, iy) / m_heatmap.maxValue;
+				if (heat <= 0.0f)
+				{
+					continue;
+				}
+
+				b2Vec2 lower = m_heatmap.bounds.lowerBound + b2Vec2(ix * m_heatmap.sectorSize, iy * m_heatmap.sectorSize);
+				b2Vec2 upper = lower + b2Vec2(m_heatmap.sectorSize, m_heatmap.sectorSize);
+
+				b2Vec2 vs[4] = { lower, b2Vec2(upper.x, lower.y), upper, b2Vec2(lower.x, upper.y) };
+				g_debugDraw.DrawSolidPolygon(vs, 4, b2Color(heat, 0.2f, 1.0f - heat));
+			}
+		}
+	}
+
 	void DrawMouseOBB()
 	{
 		b2Vec2 vs[4];
@@ -630,6 +678,9 @@ private:
 	std::string m_coord;
 	bool m_paused = false;
 	bool m_stop = false;
+	bool m_showHeatmap = false;
+	b2SectorGridStats m_stats;
+	b2SectorHeatmap m_heatmap;
 	std::vector<std::thread> m_threads;
 };
 
@@ -0,0 +1,608 @@
+#include "test.h"
+#include "settings.h"
+#include <box2d/b2_sector_grid.h>
+#include <thread>
+
+//  ̵ /  ϸ   b2SectorGrid Ͽ ð Ѵ.
+class SectorGridBenchmark : public Test
+{
+public:
+
+	enum
+	{
+		e_objectCount = 20000,
+		e_queryStride = 10,
+		e_workerCount = 4
+	};
+
+	struct Variant
+	{
+		const char* name;
+		b2SectorGrid* grid;
+		bool moveBatch;
+		bool queryBatch;
+		bool framePhases;
+		std::vector<b2ObjectId> objectIds;
+		float moveTime;
+		float queryTime;
+	};
+
+	SectorGridBenchmark()
+		: m_measureCount(0)
+	{
+		m_settings.bounds.lowerBound.Set(-20000.0f, -20000.0f);
+		m_settings.bounds.upperBound.Set(20000.0f, 20000.0f);
+		m_settings.sectorSize = 1000.0f;
+
+		srand(888);
+
+		m_ids.resize(e_objectCount);
+		m_positions.resize(e_objectCount);
+		m_velocities.resize(e_objectCount);
+
+		for (int32 i = 0; i < e_objectCount; ++i)
+		{
+			m_ids[i] = i + 1;
+			m_positions[i].Set(
+				RandomFloat(m_settings.bounds.lowerBound.x, m_settings.bounds.upperBound.x),
+				RandomFloat(m_settings.bounds.lowerBound.y, m_settings.bounds.upperBound.y));
+			m_velocities[i].Set(RandomFloat(-30.0f, 30.0f), RandomFloat(-30.0f, 30.0f));
+		}
+
+		b2SectorSettings mapSettings = m_settings;
+		AddVariant("sector map", mapSettings);
+
+		b2SectorSettings denseSettings = m_settings;
+		denseSettings.useDenseSectors = true;
+		AddVariant("dense sectors", denseSettings);
+
+		b2SectorSettings preallocSettings = denseSettings;
+		preallocSettings.preallocateSectors = true;
+		AddVariant("dense sectors (preallocated)", preallocSettings);
+
+		AddVariant("dense sectors + MoveBatch / QueryBatch", denseSettings, true, true);
+
+		b2SectorSettings phaseSettings = denseSettings;
+		phaseSettings.useFramePhases = true;
+		AddVariant("dense sectors + frame phases", phaseSettings);
+
+		b2SectorSettings wideSettings = phaseSettings;
+		wideSettings.useWideTrees = true;
+		AddVariant("dense sectors + frame phases + wide trees", wideSettings);
+	}
+
+	~SectorGridBenchmark()
+	{
+		for (auto& variant : m_variants)
+		{
+			delete variant.grid;
+		}
+	}
+
+	static Test* Create()
+	{
+		return new SectorGridBenchmark;
+	}
+
+	void AddVariant(const char* name, const b2SectorSettings& settings, bool moveBatch = false, bool queryBatch = false)
+	{
+		Variant variant;
+		variant.name = name;
+		variant.grid = new b2SectorGrid(settings);
+		variant.moveBatch = moveBatch;
+		variant.queryBatch = queryBatch;
+		variant.framePhases = settings.useFramePhases;
+		variant.objectIds.resize(e_objectCount);
+		variant.moveTime = 0.0f;
+		variant.queryTime = 0.0f;
+
+		for (int32 i = 0; i < e_objectCount; ++i)
+		{
+			auto box = new b2PolygonShape();
+			box->SetAsBox(20.0f, 20.0f);
+
+			b2Transform xf(m_positions[i], b2Rot(0.0f));
+			auto res = variant.grid->Spawn(box, b2Filter(), xf, &m_ids[i]);
+			variant.objectIds[i] = res.first;
+		}
+
+		m_variants.push_back(variant);
+	}
+
+	//    ġ ǵ ġ  Ѵ.
+	void UpdatePositions()
+	{
+		const b2AABB& bounds = m_settings.bounds;
+
+		for (int32 i = 0; i < e_objectCount; ++i)
+		{
+			b2Vec2 p = m_positions[i] + m_velocities[i];
+
+			if (p.x < bounds.lowerBound.x || p.x > bounds.upperBound.x)
+			{
+				m_velocities[i].x = -m_velocities[i].x;
+			}
+
+			if (p.y < bounds.lowerBound.y || p.y > bounds.upperBound.y)
+			{
+				m_velocities[i].y = -m_velocities[i].y;
+			}
+
+			m_positions[i] += m_velocities[i];
+		}
+	}
+
+	// Ŀ 带 ϳ  
+	static void RunWorkers(int workerCount, const std::function<void(int)>& task)
+	{
+		std::vector<std::thread> threads;
+
+		for (int i = 0; i < workerCount; ++i)
+		{
+			threads.emplace_back(task, i);
+		}
+
+		for (auto& thread : threads)
+		{
+			thread.join();
+		}
+	}
+
+	void Measure(Variant& variant)
+	{
+		b2Rot rot(0.0f);
+
+		// EndWrite wide 带 Ƿ ̵ ð ִ´.
+		b2Timer timer;
+		if (variant.framePhases)
+		{
+			variant.grid->BeginWrite();
+		}
+
+		if (variant.moveBatch)
+		{
+			m_moves.resize(e_objectCount);
+
+			for (int32 i = 0; i < e_objectCount; ++i)
+			{
+				m_moves[i] = b2SectorMove{ variant.objectIds[i], m_positions[i], rot };
+			}
+
+			variant.grid->MoveBatch(m_moves.data(), e_objectCount);
+		}
+		else
+		{
+			for (int32 i = 0; i < e_objectCount; ++i)
+			{
+				variant.grid->Move(variant.objectIds[i], m_positions[i], rot);
+			}
+		}
+
+		if (variant.framePhases)
+		{
+			variant.grid->EndWrite();
+		}
+		variant.moveTime += timer.GetMilliseconds();
+
+		b2CircleShape circle;
+		circle.m_radius = 100.0f;
+
+		m_colliders.clear();
+		for (int32 i = 0; i < e_objectCount; i += e_queryStride)
+		{
+			m_colliders.push_back(b2SectorCollider(&circle, b2Filter(), b2Transform(m_positions[i], rot)));
+		}
+
+		timer.Reset();
+		if (variant.framePhases)
+		{
+			variant.grid->BeginRead();
+		}
+
+		if (variant.queryBatch)
+		{
+			variant.grid->QueryBatch(m_colliders.data(), static_cast<int>(m_colliders.size()), 
+				e_workerCount, RunWorkers, m_queryBatch);
+		}
+		else
+		{
+			std::vector<int> lst;
+
+			for (auto& collider : m_colliders)
+			{
+				lst.clear();
+				variant.grid->Query(collider, lst);
+			}
+		}
+
+		if (variant.framePhases)
+		{
+			variant.grid->EndRead();
+		}
+		variant.queryTime += timer.GetMilliseconds();
+	}
+
+	void Step(Settings& settings) override
+	{
+		if (settings.m_pause == false || settings.m_singleStep)
+		{
+			settings.m_singleStep = 0;
+
+			UpdatePositions();
+
+			for (auto& variant : m_variants)
+			{
+				Measure(variant);
+			}
+
+			++m_measureCount;
+		}
+
+		g_debugDraw.DrawString(5, m_textLine, "objects = %d, queries per step = %d, steps = %d",
+			e_objectCount, e_objectCount / e_queryStride, m_measureCount);
+		m_textLine += m_textIncrement;
+
+		int32 measureCount = b2Max(m_measureCount, 1);
+
+		for (auto& variant : m_variants)
+		{
+			g_debugDraw.DrawString(5, m_textLine, "%s: move = %.3f ms, query = %.3f ms",
+				variant.name, variant.moveTime / measureCount, variant.queryTime / measureCount);
+			m_textLine += m_textIncrement;
+		}
+	}
+
+private:
+	b2SectorSettings m_settings;
+	std::vector<Variant> m_variants;
+	std::vector<int> m_ids;
+	std::vector<b2Vec2> m_positions;
+	std::vector<b2Vec2> m_velocities;
+	std::vector<b2SectorMove> m_moves;
+	std::vector<b2SectorCollider> m_colliders;
+	b2SectorQueryBatch<int> m_queryBatch;
+	int32 m_measureCount;
+};
+
+static int testIndex = RegisterTest("Benchmark", "Sector Grid", SectorGridBenchmark::Create);
+
+//  尡  Move ϴ  б   ٲ     ð .
+//  Ʈ д  Խõ  д 츦 Ѵ.
+class SectorGridReaders : public Test
+{
+public:
+
+	enum
+	{
+		e_objectCount = 20000,
+		e_queryCount = 20000,
+		e_readerCaseCount = 4
+	};
+
+	struct Case
+	{
+		int readerCount;
+		float lockedTime;
+		float snapshotTime;
+		int32 measureCount;
+	};
+
+	SectorGridReaders()
+		: m_caseIndex(0)
+		, m_snapshotTurn(false)
+		, m_tick(0)
+	{
+		b2SectorSettings settings;
+		settings.bounds.lowerBound.Set(-20000.0f, -20000.0f);
+		settings.bounds.upperBound.Set(20000.0f, 20000.0f);
+		settings.sectorSize = 1000.0f;
+		settings.useDenseSectors = true;
+
+		m_lockedGrid = new b2SectorGrid(settings);
+
+		settings.useSectorSnapshots = true;
+		m_snapshotGrid = new b2SectorGrid(settings);
+
+		srand(888);
+
+		m_ids.resize(e_objectCount);
+		m_positions.resize(e_objectCount);
+		m_lockedObjectIds.resize(e_objectCount);
+		m_snapshotObjectIds.resize(e_objectCount);
+
+		for (int32 i = 0; i < e_objectCount; ++i)
+		{
+			m_ids[i] = i + 1;
+			m_positions[i].Set(
+				RandomFloat(settings.bounds.lowerBound.x, settings.bounds.upperBound.x),
+				RandomFloat(settings.bounds.lowerBound.y, settings.bounds.upperBound.y));
+
+			m_lockedObjectIds[i] = Spawn(m_lockedGrid, i);
+			m_snapshotObjectIds[i] = Spawn(m_snapshotGrid, i);
+		}
+
+		m_snapshotGrid->PublishSnapshots();
+
+		int readerCounts[e_readerCaseCount] = { 1, 4, 16, 64 };
+
+		for (int32 i = 0; i < e_readerCaseCount; ++i)
+		{
+			m_cases[i] = Case{ readerCounts[i], 0.0f, 0.0f, 0 };
+		}
+	}
+
+	~SectorGridReaders()
+	{
+		delete m_lockedGrid;
+		delete m_snapshotGrid;
+	}
+
+	static Test* Create()
+	{
+		return new SectorGridReaders;
+	}
+
+	b2ObjectId Spawn(b2SectorGrid* grid, int32 index)
+	{
+		auto box = new b2PolygonShape();
+		box->SetAsBox(20.0f, 20.0f);
+
+		b2Transform xf(m_positions[index], b2Rot(0.0f));
+		return grid->Spawn(box, b2Filter(), xf, &m_ids[index]).first;
+	}
+
+	float Measure(b2SectorGrid* grid, const std::vector<b2ObjectId>& objectIds, int readerCount)
+	{
+		std::atomic<bool> stop(false);
+		int32 tick = m_tick;
+
+		//   Ʈ ݾ 
+		std::thread writer([this, grid, &objectIds, &stop, tick]() {
+			int32 i = 0;
+			b2Vec2 offset(tick % 2 == 0 ? 5.0f : 0.0f, 0.0f);
+
+			while (!stop.load(std::memory_order_relaxed))
+			{
+				grid->Move(objectIds[i], m_positions[i] + offset, b2Rot(0.0f));
+				i = (i + 1) % e_objectCount;
+			}
+			});
+
+		b2Timer timer;
+
+		std::vector<std::thread> readers;
+		int queryPerReader = e_queryCount / readerCount;
+
+		for (int r = 0; r < readerCount; ++r)
+		{
+			readers.emplace_back([this, grid, r, queryPerReader]() {
+				std::vector<int> lst;
+
+				for (int q = 0; q < queryPerReader; ++q)
+				{
+					int32 index = ((r * queryPerReader + q) * 7919) % e_objectCount;
+
+					lst.clear();
+					grid->QueryCircle(m_positions[index], 100.0f, b2Filter(), lst);
+				}
+				});
+		}
+
+		for (auto& reader : readers)
+		{
+			reader.join();
+		}
+
+		float time = timer.GetMilliseconds();
+
+		stop = true;
+		writer.join();
+
+		return time;
+	}
+
+	void Step(Settings& settings) override
+	{
+		if (settings.m_pause == false || settings.m_singleStep)
+		{
+			settings.m_singleStep = 0;
+
+			//  ܿ  쾿  
+			Case& c = m_cases[m_caseIndex];
+
+			if (m_snapshotTurn)
+			{
+				c.snapshotTime += Measure(m_snapshotGrid, m_snapshotObjectIds, c.readerCount);
+				m_snapshotGrid->PublishSnapshots();
+
+				++c.measureCount;
+				m_caseIndex = (m_caseIndex + 1) % e_readerCaseCount;
+				++m_tick;
+			}
+			else
+			{
+				c.lockedTime += Measure(m_lockedGrid, m_lockedObjectIds, c.readerCount);
+			}
+
+			m_snapshotTurn = !m_snapshotTurn;
+		}
+
+		g_debugDraw.DrawString(5, m_textLine, "objects = %d, queries per measure = %d, concurrent writer = 1",
+			e_objectCount, e_queryCount);
+		m_textLine += m_textIncrement;
+
+		for (int32 i = 0; i < e_readerCaseCount; ++i)
+		{
+			const Case& c = m_cases[i];
+			int32 measureCount = b2Max(c.measureCount, 1);
+
+			g_debugDraw.DrawString(5, m_textLine, "readers = %d: locked = %.3f ms, snapshot = %.3f ms",
+				c.readerCount, c.lockedTime / measureCount, c.snapshotTime / measureCount);
+			m_textLine += m_textIncrement;
+		}
+	}
+
+private:
+	b2SectorGrid* m_lockedGrid;
+	b2SectorGrid* m_snapshotGrid;
+	std::vector<int> m_ids;
+	std::vector<b2Vec2> m_positions;
+	std::vector<b2ObjectId> m_lockedObjectIds;
+	std::vector<b2ObjectId> m_snapshotObjectIds;
+	Case m_cases[e_readerCaseCount];
+	int32 m_caseIndex;
+	bool m_snapshotTurn;
+	int32 m_tick;
+};
+
+static int readersTestIndex = RegisterTest("Benchmark", "Sector Grid Readers", SectorGridReaders::Create);
+
+//  ƽ Move  Ʈ   ̵ º . 
+// ڸ,  ȿ ݾ ̵,  ȿ  ӵ  ̵,  ƽ  踦 Ѵ ̵ Ѵ.
+class SectorGridMoveBenchmark : public Test
+{
+public:
+
+	enum
+	{
+		e_objectCount = 20000,
+		e_caseCount = 4
+	};
+
+	struct Case
+	{
+		const char* name;
+		b2SectorGrid* grid;
+		std::vector<b2ObjectId> objectIds;
+		float moveTime;
+		float reinsertRate;
+	};
+
+	SectorGridMoveBenchmark()
+		: m_measureCount(0)
+	{
+		b2SectorSettings settings;
+		settings.bounds.lowerBound.Set(-20000.0f, -20000.0f);
+		settings.bounds.upperBound.Set(20000.0f, 20000.0f);
+		settings.sectorSize = 1000.0f;
+		settings.useDenseSectors = true;
+		settings.proxyExtension = 20.0f;
+
+		srand(888);
+
+		m_ids.resize(e_objectCount);
+		m_positions.resize(e_objectCount);
+
+		for (int32 i = 0; i < e_objectCount; ++i)
+		{
+			m_ids[i] = i + 1;
+
+			//  迡   ξ ڸ,  ̵ ͸  ʰ Ѵ
+			float x = 1000.0f * static_cast<float>(rand() % 38 - 19) + 500.0f;
+			float y = 1000.0f * static_cast<float>(rand() % 38 - 19) + 500.0f;
+			m_positions[i].Set(x + RandomFloat(-200.0f, 200.0f), y + RandomFloat(-200.0f, 200.0f));
+		}
+
+		const char* names[e_caseCount] = { "stationary", "slow moving", "fast moving", "sector crossing" };
+
+		for (int32 c = 0; c < e_caseCount; ++c)
+		{
+			Case& cs = m_cases[c];
+			cs.name = names[c];
+			cs.grid = new b2SectorGrid(settings);
+			cs.objectIds.resize(e_objectCount);
+			cs.moveTime = 0.0f;
+			cs.reinsertRate = 0.0f;
+
+			for (int32 i = 0; i < e_objectCount; ++i)
+			{
+				auto box = new b2PolygonShape();
+				box->SetAsBox(20.0f, 20.0f);
+
+				b2Transform xf(m_positions[i], b2Rot(0.0f));
+				cs.objectIds[i] = cs.grid->Spawn(box, b2Filter(), xf, &m_ids[i]).first;
+			}
+		}
+	}
+
+	~SectorGridMoveBenchmark()
+	{
+		for (auto& cs : m_cases)
+		{
+			delete cs.grid;
+		}
+	}
+
+	static Test* Create()
+	{
+		return new SectorGridMoveBenchmark;
+	}
+
+	// ƽ case ´ Ʈ i ġ
+	b2Vec2 GetPosition(int32 c, int32 i) const
+	{
+		bool odd = (m_measureCount % 2) != 0;
+
+		switch (c)
+		{
+		case 1:
+			return m_positions[i] + b2Vec2(odd ? 0.5f : 0.0f, odd ? 0.0f : 0.5f);
+		case 2:
+		{
+			// ƽ 8   պ
+			int32 t = m_measureCount % 100;
+			return m_positions[i] + b2Vec2(8.0f * static_cast<float>(t < 50 ? t : 100 - t) - 200.0f, 0.0f);
+		}
+		case 3:
+			return m_positions[i] + b2Vec2(odd ? 600.0f : 0.0f, 0.0f);
+		default:
+			return m_positions[i];
+		}
+	}
+
+	void Step(Settings& settings) override
+	{
+		if (settings.m_pause == false || settings.m_singleStep)
+		{
+			settings.m_singleStep = 0;
+
+			++m_measureCount;
+
+			for (int32 c = 0; c < e_caseCount; ++c)
+			{
+				Case& cs = m_cases[c];
+
+				b2Timer timer;
+				for (int32 i = 0; i < e_objectCount; ++i)
+				{
+					cs.grid->Move(cs.objectIds[i], GetPosition(c, i), b2Rot(0.0f));
+				}
+				cs.moveTime += timer.GetMilliseconds();
+
+				cs.grid->GetStats(m_stats, true);
+				cs.reinsertRate = m_stats.moveCount > 0 ? static_cast<float>(m_stats.reinsertCount) / m_stats.moveCount : 0.0f;
+			}
+		}
+
+		g_debugDraw.DrawString(5, m_textLine, "objects = %d, steps = %d", e_objectCount, m_measureCount);
+		m_textLine += m_textIncrement;
+
+		int32 measureCount = b2Max(m_measureCount, 1);
+
+		for (auto& cs : m_cases)
+		{
+			g_debugDraw.DrawString(5, m_textLine, "%s: move = %.3f ms, reinsert rate = %.2f", 
+				cs.name, cs.moveTime / measureCount, cs.reinsertRate);
+			m_textLine += m_textIncrement;
+		}
+	}
+
+private:
+	Case m_cases[e_caseCount];
+	std::vector<int> m_ids;
+	std::vector<b2Vec2> m_positions;
+	b2SectorGridStats m_stats;
+	int32 m_measureCount;
+};
+
+static int moveTestIndex = RegisterTest("Benchmark", "Sector Grid Move", SectorGridMoveBenchmark::Create);
@@ -23,6 +23,29 @@
 #include "box2d/box2d.h"
 #include "doctest.h"
 #include <stdio.h>
+#include <algorithm>
+#include <thread>
+#include <vector>
+
+// A linear congruential generator gives the same numbers on every platform.
+static float RandomFloat(uint32& seed, float lo, float hi)
+{
+	seed = seed * 1664525u + 1013904223u;
+	return lo + (hi - lo) * float(seed >> 8) / float(1u << 24);
+}
+
+// A box with its lower corner in [-range, range] and extents in [minSize, maxSize].
+static b2AABB RandomAABB(uint32& seed, float range, float minSize, float maxSize)
+{
+	b2AABB aabb;
+	float x = RandomFloat(seed, -range, range);
+	float y = RandomFloat(seed, -range, range);
+	aabb.lowerBound.Set(x, y);
+	float w = RandomFloat(seed, minSize, maxSize);
+	float h = RandomFloat(seed, minSize, maxSize);
+	aabb.upperBound.Set(x + w, y + h);
+	return aabb;
+}
 
 // Unit tests for collision algorithms
 DOCTEST_TEST_CASE("collision test")
@@ -78,4 +101,498 @@ DOCTEST_TEST_CASE("collision test")
 		CHECK(b2Abs(massData2.mass - mass) < 20.0f * (absTol + relTol * mass));
 		CHECK(b2Abs(massData2.I - inertia) < 40.0f * (absTol + relTol * inertia));
 	}
+
+	SUBCASE("dynamic tree category masks")
+	{
+		b2DynamicTree tree;
+
+		int32 proxies[64];
+		for (int32 i = 0; i < 64; ++i)
+		{
+			b2AABB aabb;
+			aabb.lowerBound.Set(2.0f * i, 0.0f);
+			aabb.upperBound.Set(2.0f * i + 1.0f, 1.0f);
+			proxies[i] = tree.CreateProxy(aabb, nullptr, uint16(1 << (i % 3)));
+		}
+
+		// Remove and re-insert to exercise the rotations.
+		for (int32 i = 0; i < 64; i += 4)
+		{
+			tree.DestroyProxy(proxies[i]);
+		}
+
+		tree.Validate();
+
+		b2AABB everything;
+		everything.lowerBound.Set(-10.0f, -10.0f);
+		everything.upperBound.Set(200.0f, 10.0f);
+
+		std::vector<int32> all;
+		tree.Query(everything, all);
+		CHECK(all.size() == 48);
+
+		std::vector<int32> masked;
+		tree.Query(everything, masked, 0x0002);
+
+		int32 expected = 0;
+		for (int32 proxyId : all)
+		{
+			expected += tree.GetNode(proxyId).categoryBits == 0x0002 ? 1 : 0;
+		}
+
+		CHECK(int32(masked.size()) == expected);
+
+		for (int32 proxyId : masked)
+		{
+			CHECK(tree.GetNode(proxyId).categoryBits == 0x0002);
+		}
+
+		std::vector<int32> none;
+		tree.Query(everything, none, 0x0008);
+		CHECK(none.empty());
+	}
+
+	SUBCASE("dynamic tree wide nodes")
+	{
+		b2DynamicTree tree;
+
+		uint32 seed = 4242;
+		std::vector<int32> proxies;
+		for (int32 i = 0; i < 1000; ++i)
+		{
+			b2AABB aabb = RandomAABB(seed, 100.0f, 0.1f, 4.0f);
+			proxies.push_back(tree.CreateProxy(aabb, nullptr, uint16(1 << (i % 4))));
+		}
+
+		// Closest hit, as in b2World::RayCast.
+		struct ClosestCallback
+		{
+			float RayCastCallback(const b2RayCastInput& input, int32 proxyId)
+			{
+				b2RayCastOutput output;
+				if (tree->GetFatAABB(proxyId).RayCast(&output, input) == false)
+				{
+					return input.maxFraction;
+				}
+
+				closest = proxyId;
+				return output.fraction;
+			}
+
+			const b2DynamicTree* tree;
+			int32 closest;
+		};
+
+		auto check = [&]() {
+			for (int32 q = 0; q < 50; ++q)
+			{
+				b2AABB aabb = RandomAABB(seed, 100.0f, 1.0f, 30.0f);
+				uint16 maskBits = q % 2 == 0 ? 0xFFFF : 0x0005;
+
+				b2RayCastInput input;
+				input.p1.Set(RandomFloat(seed, -100.0f, 100.0f), RandomFloat(seed, -100.0f, 100.0f));
+				input.p2.Set(RandomFloat(seed, -100.0f, 100.0f), RandomFloat(seed, -100.0f, 100.0f));
+				input.maxFraction = 1.0f;
+
+				CHECK(tree.HasWideNodes() == false);
+
+				std::vector<int32> expected, expectedRay;
+				tree.Query(aabb, expected, maskBits);
+				tree.RayCast(input, expectedRay, maskBits);
+				ClosestCallback expectedClosest = { &tree, b2_nullNode };
+				tree.RayCast(&expectedClosest, input, maskBits);
+
+				tree.BuildWideNodes();
+				CHECK(tree.HasWideNodes());
+
+				std::vector<int32> actual, actualRay;
+				tree.Query(aabb, actual, maskBits);
+				tree.RayCast(input, actualRay, maskBits);
+				ClosestCallback actualClosest = { &tree, b2_nullNode };
+				tree.RayCast(&actualClosest, input, maskBits);
+
+				std::sort(expected.begin(), expected.end());
+				std::sort(actual.begin(), actual.end());
+				std::sort(expectedRay.begin(), expectedRay.end());
+				std::sort(actualRay.begin(), actualRay.end());
+
+				CHECK(actual == expected);
+				CHECK(actualRay == expectedRay);
+				CHECK(actualClosest.closest == expectedClosest.closest);
+
+				// Any change to the tree falls back to the binary nodes.
+				int32 proxyId = proxies[q];
+				b2AABB moved = tree.GetFatAABB(proxyId);
+				b2Vec2 d(RandomFloat(seed, -20.0f, 20.0f), RandomFloat(seed, -20.0f, 20.0f));
+				moved.lowerBound += d;
+				moved.upperBound += d;
+				CHECK(tree.MoveProxy(proxyId, moved, d));
+			}
+		};
+
+		check();
+
+		// A tree whose root is a leaf.
+		b2DynamicTree single;
+		b2AABB box;
+		box.lowerBound.Set(0.0f, 0.0f);
+		box.upperBound.Set(1.0f, 1.0f);
+		single.CreateProxy(box, nullptr);
+		single.BuildWideNodes();
+
+		std::vector<int32> hits;
+		CHECK(single.Query(box, hits) == 1);
+	}
+
+	SUBCASE("dynamic tree bulk create")
+	{
+		uint32 seed = 777;
+		std::vector<b2TreeProxyDef> defs(2000);
+		for (size_t i = 0; i < defs.size(); ++i)
+		{
+			defs[i].aabb = RandomAABB(seed, 100.0f, 0.1f, 4.0f);
+			defs[i].userData = &defs[i];
+			defs[i].categoryBits = uint16(1 << (i % 4));
+		}
+
+		// Coincident boxes cannot be split by position.
+		for (size_t i = 0; i < 50; ++i)
+		{
+			defs[i].aabb = defs[0].aabb;
+		}
+
+		b2DynamicTree single;
+		std::vector<int32> singleIds(defs.size());
+		for (size_t i = 0; i < defs.size(); ++i)
+		{
+			singleIds[i] = single.CreateProxy(defs[i].aabb, defs[i].userData, defs[i].categoryBits);
+		}
+
+		// Half into an empty tree, then half next to existing proxies.
+		b2DynamicTree bulk;
+		std::vector<int32> bulkIds(defs.size());
+		int32 half = int32(defs.size() / 2);
+		bulk.CreateProxies(defs.data(), half, bulkIds.data());
+		bulk.Validate();
+		bulk.CreateProxies(defs.data() + half, int32(defs.size()) - half, bulkIds.data() + half);
+		bulk.Validate();
+
+		CHECK(bulk.GetAreaRatio() < single.GetAreaRatio());
+
+		for (size_t i = 0; i < defs.size(); ++i)
+		{
+			CHECK(bulk.GetUserData(bulkIds[i]) == defs[i].userData);
+			CHECK(bulk.WasMoved(bulkIds[i]));
+		}
+
+		// The same user data is found either way.
+		auto query = [](const b2DynamicTree& tree, const b2AABB& aabb, uint16 maskBits) {
+			std::vector<int32> ids;
+			tree.Query(aabb, ids, maskBits);
+
+			std::vector<void*> found;
+			for (int32 id : ids)
+			{
+				found.push_back(tree.GetUserData(id));
+			}
+			std::sort(found.begin(), found.end());
+			return found;
+		};
+
+		for (int32 q = 0; q < 50; ++q)
+		{
+			b2AABB aabb = RandomAABB(seed, 100.0f, 1.0f, 30.0f);
+			uint16 maskBits = q % 2 == 0 ? 0xFFFF : 0x0005;
+
+			CHECK(query(bulk, aabb, maskBits) == query(single, aabb, maskBits));
+		}
+
+		// The bulk-built proxies are ordinary proxies.
+		for (int32 i = 0; i < half; i += 2)
+		{
+			bulk.DestroyProxy(bulkIds[i]);
+		}
+		bulk.Validate();
+	}
+
+	SUBCASE("dynamic tree optimize")
+	{
+		uint32 seed = 4242;
+		b2DynamicTree tree;
+		std::vector<int32> proxies;
+		std::vector<int32> slots(2000);
+		for (int32 i = 0; i < 2000; ++i)
+		{
+			slots[i] = i;
+			proxies.push_back(tree.CreateProxy(RandomAABB(seed, 100.0f, 0.1f, 4.0f), &slots[i]));
+		}
+
+		float insertedRatio = tree.GetAreaRatio();
+
+		// Keep the tree changing while it is rebuilt a little at a time.
+		int32 work = 0;
+		int32 calls = 0;
+		for (; calls < 1000; ++calls)
+		{
+			int32 k = int32(RandomFloat(seed, 0.0f, float(proxies.size())));
+			b2AABB aabb = tree.GetFatAABB(proxies[k]);
+			b2Vec2 displacement(RandomFloat(seed, -8.0f, 8.0f), RandomFloat(seed, -8.0f, 8.0f));
+			aabb.lowerBound += displacement;
+			aabb.upperBound += displacement;
+			tree.MoveProxy(proxies[k], aabb, displacement);
+
+			if (calls % 10 == 0)
+			{
+				// Replace the proxy. Its old id is reused later, possibly for an internal node.
+				int32 proxyId = tree.CreateProxy(RandomAABB(seed, 100.0f, 0.1f, 4.0f), &slots[k]);
+				tree.DestroyProxy(proxies[k]);
+				proxies[k] = proxyId;
+			}
+
+			int32 spent = tree.Optimize(500);
+			tree.Validate();
+			if (spent == 0)
+			{
+				break;
+			}
+			work += spent;
+		}
+
+		CHECK(work > 0);
+		CHECK(calls > 5);
+		CHECK(tree.GetAreaRatio() < insertedRatio);
+
+		// Nothing changed since the rebuild finished.
+		CHECK(tree.Optimize(500) == 0);
+
+		std::vector<int32> found;
+		b2AABB everything;
+		everything.lowerBound.Set(-200.0f, -200.0f);
+		everything.upperBound.Set(200.0f, 200.0f);
+		tree.Query(everything, found);
+		CHECK(found.size() == proxies.size());
+
+		for (size_t i = 0; i < proxies.size(); ++i)
+		{
+			CHECK(tree.GetUserData(proxies[i]) == &slots[i]);
+		}
+	}
+
+	SUBCASE("parallel broad-phase pairs")
+	{
+		// Runs each part on its own thread.
+		class ThreadExecutor : public b2TaskExecutor
+		{
+		public:
+			int32 GetWorkerCount() const override
+			{
+				return 4;
+			}
+
+			void Run(b2Task* task, int32 partCount) override
+			{
+				std::vector<std::thread> threads;
+				for (int32 i = 0; i < partCount; ++i)
+				{
+					threads.emplace_back([task, i]() { task->Execute(i); });
+				}
+
+				for (auto& thread : threads)
+				{
+					thread.join();
+				}
+			}
+		};
+
+		struct PairRecorder
+		{
+			void AddPair(void* userDataA, void* userDataB)
+			{
+				pairs.push_back(std::make_pair(userDataA, userDataB));
+			}
+
+			std::vector<std::pair<void*, void*>> pairs;
+		};
+
+		ThreadExecutor executor;
+		b2BroadPhase serial;
+		b2BroadPhase parallel;
+		parallel.SetTaskExecutor(&executor);
+
+		static int32 ids[2000];
+		int32 proxies[2000];
+
+		uint32 seed = 12345;
+		for (int32 i = 0; i < 2000; ++i)
+		{
+			ids[i] = i;
+
+			b2AABB aabb = RandomAABB(seed, 100.0f, 0.5f, 3.0f);
+
+			// Some static proxies to cover both trees.
+			b2BroadPhase::ProxyType type = i % 4 == 0 ? b2BroadPhase::e_staticProxy : b2BroadPhase::e_movableProxy;
+			proxies[i] = serial.CreateProxy(aabb, ids + i, type);
+			CHECK(parallel.CreateProxy(aabb, ids + i, type) == proxies[i]);
+		}
+
+		for (int32 step = 0; step < 3; ++step)
+		{
+			PairRecorder serialPairs;
+			PairRecorder parallelPairs;
+			serial.UpdatePairs(&serialPairs);
+			parallel.UpdatePairs(&parallelPairs);
+
+			CHECK(serialPairs.pairs.size() > 0);
+			CHECK(parallelPairs.pairs == serialPairs.pairs);
+
+			// Move a subset so that only part of the tree is queried next time.
+			for (int32 i = step; i < 2000; i += 3)
+			{
+				b2AABB aabb = serial.GetFatAABB(proxies[i]);
+				b2Vec2 d(RandomFloat(seed, -2.0f, 2.0f), RandomFloat(seed, -2.0f, 2.0f));
+				aabb.lowerBound += d;
+				aabb.upperBound += d;
+
+				serial.MoveProxy(proxies[i], aabb, d);
+				parallel.MoveProxy(proxies[i], aabb, d);
+			}
+		}
+	}
+
+	SUBCASE("broad-phase static tree")
+	{
+		b2BroadPhase broadPhase;
+
+		uint32 seed = 2468;
+		// Even ids are static.
+		const int32 count = 600;
+		static int32 ids[count];
+		int32 proxies[count];
+		for (int32 i = 0; i < count; ++i)
+		{
+			ids[i] = i;
+
+			b2AABB aabb = RandomAABB(seed, 50.0f, 0.5f, 4.0f);
+
+			b2BroadPhase::ProxyType type = i % 2 == 0 ? b2BroadPhase::e_staticProxy : b2BroadPhase::e_movableProxy;
+			proxies[i] = broadPhase.CreateProxy(aabb, ids + i, type);
+			CHECK(broadPhase.GetUserData(proxies[i]) == ids + i);
+		}
+
+		// Every proxy is new, so every overlap is reported except static against static.
+		struct PairRecorder
+		{
+			void AddPair(void* userDataA, void* userDataB)
+			{
+				int32 a = *(int32*)userDataA;
+				int32 b = *(int32*)userDataB;
+				pairs.push_back(std::make_pair(b2Min(a, b), b2Max(a, b)));
+			}
+
+			std::vector<std::pair<int32, int32>> pairs;
+		};
+
+		PairRecorder recorder;
+		broadPhase.UpdatePairs(&recorder);
+		std::sort(recorder.pairs.begin(), recorder.pairs.end());
+
+		std::vector<std::pair<int32, int32>> expected;
+		for (int32 i = 0; i < count; ++i)
+		{
+			for (int32 j = i + 1; j < count; ++j)
+			{
+				if (i % 2 == 0 && j % 2 == 0)
+				{
+					continue;
+				}
+
+				if (broadPhase.TestOverlap(proxies[i], proxies[j]))
+				{
+					expected.push_back(std::make_pair(i, j));
+				}
+			}
+		}
+
+		CHECK(expected.size() > 0);
+		CHECK(recorder.pairs == expected);
+
+		// Queries and ray casts report proxy ids of both trees.
+		struct Callback
+		{
+			bool QueryCallback(int32 proxyId)
+			{
+				found.push_back(*(int32*)broadPhase->GetUserData(proxyId));
+				return true;
+			}
+
+			float RayCastCallback(const b2RayCastInput& input, int32 proxyId)
+			{
+				b2RayCastOutput output;
+				if (broadPhase->GetFatAABB(proxyId).RayCast(&output, input) == false)
+				{
+					return input.maxFraction;
+				}
+
+				closest = *(int32*)broadPhase->GetUserData(proxyId);
+				return output.fraction;
+			}
+
+			const b2BroadPhase* broadPhase;
+			std::vector<int32> found;
+			int32 closest;
+		};
+
+		auto check = [&]() {
+			for (int32 q = 0; q < 20; ++q)
+			{
+				b2AABB aabb = RandomAABB(seed, 50.0f, 1.0f, 20.0f);
+
+				b2RayCastInput input;
+				input.p1.Set(RandomFloat(seed, -60.0f, 60.0f), RandomFloat(seed, -60.0f, 60.0f));
+				input.p2.Set(RandomFloat(seed, -60.0f, 60.0f), RandomFloat(seed, -60.0f, 60.0f));
+				input.maxFraction = 1.0f;
+
+				std::vector<int32> inside;
+				int32 closest = -1;
+				float closestFraction = 1.0f;
+				for (int32 i = 0; i < count; ++i)
+				{
+					const b2AABB& fatAABB = broadPhase.GetFatAABB(proxies[i]);
+					if (b2TestOverlap(fatAABB, aabb))
+					{
+						inside.push_back(i);
+					}
+
+					b2RayCastOutput output;
+					if (fatAABB.RayCast(&output, input) && output.fraction < closestFraction)
+					{
+						closest = i;
+						closestFraction = output.fraction;
+					}
+				}
+
+				Callback callback = { &broadPhase, {}, -1 };
+				broadPhase.Query(&callback, aabb);
+				broadPhase.RayCast(&callback, input);
+
+				std::sort(callback.found.begin(), callback.found.end());
+				CHECK(callback.found == inside);
+				CHECK(callback.closest == closest);
+			}
+		};
+
+		check();
+
+		// The rebuild keeps the proxy ids.
+		float quality = broadPhase.GetTreeQuality();
+		broadPhase.RebuildStaticTree();
+		CHECK(broadPhase.GetTreeQuality() <= quality);
+
+		for (int32 i = 0; i < count; ++i)
+		{
+			CHECK(broadPhase.GetUserData(proxies[i]) == ids + i);
+		}
+
+		check();
+	}
 }
@@ -0,0 +1,1461 @@
+#include "box2d/box2d.h"
+#include "box2d/b2_distance.h"
+#include "box2d/b2_sector_grid.h"
+#include "doctest.h"
+#include <algorithm>
+#include <thread>
+
+static b2SectorSettings MakeSectorSettings(bool dense, bool preallocate)
+{
+	b2SectorSettings settings;
+	settings.bounds.lowerBound.Set(-1000.0f, -1000.0f);
+	settings.bounds.upperBound.Set(1000.0f, 1000.0f);
+	settings.sectorSize = 100.0f;
+	settings.useDenseSectors = dense;
+	settings.preallocateSectors = preallocate;
+	return settings;
+}
+
+static b2ObjectId SpawnBox(b2SectorGrid& grid, float hx, float hy, const b2Vec2& pos, int* userData)
+{
+	auto box = new b2PolygonShape();
+	box->SetAsBox(hx, hy);
+
+	b2Transform xf(pos, b2Rot(0.0f));
+	auto res = grid.Spawn(box, b2Filter(), xf, userData);
+	CHECK(b2Result::Succeeded(res));
+	return res.first;
+}
+
+//   İ     ; Ѵ
+static void CheckSpawnMoveQuery(const b2SectorSettings& settings)
+{
+	b2SectorGrid grid(settings);
+
+	int ids[3] = { 1, 2, 3 };
+	auto oid1 = SpawnBox(grid, 10.0f, 10.0f, b2Vec2(0.0f, 0.0f), &ids[0]);
+	auto oid2 = SpawnBox(grid, 10.0f, 10.0f, b2Vec2(50.0f, 0.0f), &ids[1]);
+	SpawnBox(grid, 10.0f, 10.0f, b2Vec2(500.0f, 500.0f), &ids[2]);
+
+	std::vector<int> lst;
+	CHECK(grid.QueryCircle(b2Vec2(0.0f, 0.0f), 20.0f, b2Filter(), lst) == 1);
+	CHECK(lst[0] == 1);
+
+	//  踦 ġ 
+	lst.clear();
+	CHECK(grid.QueryCircle(b2Vec2(25.0f, 0.0f), 20.0f, b2Filter(), lst) == 2);
+
+	// ͸ Ѿ ̵
+	grid.Move(oid1, b2Vec2(490.0f, 500.0f), b2Rot(0.0f));
+
+	lst.clear();
+	CHECK(grid.QueryCircle(b2Vec2(0.0f, 0.0f), 20.0f, b2Filter(), lst) == 0);
+
+	lst.clear();
+	CHECK(grid.QueryCircle(b2Vec2(495.0f, 500.0f), 5.0f, b2Filter(), lst) == 2);
+	std::sort(lst.begin(), lst.end());
+	CHECK(lst[0] == 1);
+	CHECK(lst[1] == 3);
+
+	grid.Despawn(oid2);
+
+	lst.clear();
+	CHECK(grid.QueryCircle(b2Vec2(50.0f, 0.0f), 20.0f, b2Filter(), lst) == 0);
+
+	//    ó Ʈ  Ϳ ãƾ Ѵ
+	int id = 4;
+	SpawnBox(grid, 10.0f, 10.0f, b2Vec2(-95.0f, -195.0f), &id);
+
+	lst.clear();
+	CHECK(grid.QueryCircle(b2Vec2(-103.0f, -203.0f), 2.0f, b2Filter(), lst) == 1);
+}
+
+// MoveBatch Move ϳ ȣ Ͱ    Ѵ
+// cluster      Ű ͸ Create  Ѵ
+static void CheckMoveBatch(const b2SectorSettings& settings, bool cluster = false)
+{
+	b2SectorGrid grid1(settings);
+	b2SectorGrid grid2(settings);
+
+	const int count = 50;
+	int ids[count];
+	b2SectorMove moves[count];
+
+	for (int i = 0; i < count; ++i)
+	{
+		ids[i] = i + 1;
+		b2Vec2 p(-500.0f + 20.0f * i, -500.0f + 15.0f * i);
+		if (cluster)
+		{
+			p.Set(-480.0f + 5.0f * (i % 10), -480.0f + 5.0f * (i / 10));
+		}
+
+		auto oid1 = SpawnBox(grid1, 10.0f, 5.0f, p, &ids[i]);
+		auto oid2 = SpawnBox(grid2, 10.0f, 5.0f, p, &ids[i]);
+		CHECK(oid1 == oid2);
+
+		// Ϻδ ڸ, Ϻδ ͸ Ѿ
+		moves[i].oid = oid2;
+		moves[i].position = p + b2Vec2(i % 3 == 0 ? 0.0f : 95.0f, i % 2 == 0 ? 0.0f : -130.0f);
+		moves[i].rotation = b2Rot(0.1f * i);
+		if (cluster)
+		{
+			moves[i].position = p + b2Vec2(300.0f, 200.0f);
+		}
+	}
+
+	for (int i = 0; i < count; ++i)
+	{
+		grid1.Move(moves[i].oid, moves[i].position, moves[i].rotation);
+	}
+
+	grid2.MoveBatch(moves, count);
+
+	for (int i = 0; i < count; ++i)
+	{
+		std::vector<int> lst1;
+		std::vector<int> lst2;
+		grid1.QueryCircle(moves[i].position, 30.0f, b2Filter(), lst1);
+		grid2.QueryCircle(moves[i].position, 30.0f, b2Filter(), lst2);
+
+		std::sort(lst1.begin(), lst1.end());
+		std::sort(lst2.begin(), lst2.end());
+		CHECK(lst1 == lst2);
+		CHECK(std::find(lst2.begin(), lst2.end(), ids[i]) != lst2.end());
+	}
+}
+
+// Ŀ 带  ϴ  
+static void RunWithThreads(int workerCount, const std::function<void(int)>& task)
+{
+	std::vector<std::thread> threads;
+
+	for (int i = 0; i < workerCount; ++i)
+	{
+		threads.emplace_back(task, i);
+	}
+
+	for (auto& thread : threads)
+	{
+		thread.join();
+	}
+}
+
+// QueryBatch collider Query ȣ Ͱ   collider   Ѵ
+static void CheckQueryBatch(const b2SectorSettings& settings, int workerCount, const b2SectorTaskExecutor& executor)
+{
+	b2SectorGrid grid(settings);
+
+	const int count = 200;
+	int ids[count];
+
+	for (int i = 0; i < count; ++i)
+	{
+		ids[i] = i + 1;
+		SpawnBox(grid, 8.0f, 8.0f, b2Vec2(-800.0f + 8.0f * i, 300.0f - 3.0f * i), &ids[i]);
+	}
+
+	b2CircleShape circle;
+	circle.m_radius = 25.0f;
+
+	std::vector<b2SectorCollider> colliders;
+
+	for (int i = 0; i < count; i += 3)
+	{
+		b2Transform xf(b2Vec2(-800.0f + 8.0f * i, 300.0f - 3.0f * i), b2Rot(0.0f));
+		colliders.push_back(b2SectorCollider(&circle, b2Filter(), xf));
+	}
+
+	b2SectorQueryBatch<int> batch;
+
+	//   ؼ  뿡    Ȯ
+	for (int pass = 0; pass < 2; ++pass)
+	{
+		grid.QueryBatch(colliders.data(), static_cast<int>(colliders.size()), workerCount, executor, batch);
+
+		REQUIRE(batch.offsets.size() == colliders.size() + 1);
+		CHECK(batch.offsets.back() == static_cast<int>(batch.ids.size()));
+
+		for (size_t q = 0; q < colliders.size(); ++q)
+		{
+			std::vector<int> expected;
+			grid.Query(colliders[q], expected);
+			std::sort(expected.begin(), expected.end());
+
+			std::vector<int> actual(batch.ids.begin() + batch.offsets[q], batch.ids.begin() + batch.offsets[q + 1]);
+			std::sort(actual.begin(), actual.end());
+
+			CHECK(actual == expected);
+		}
+	}
+}
+
+DOCTEST_TEST_CASE("sector grid")
+{
+	SUBCASE("spawn move query with sector map")
+	{
+		CheckSpawnMoveQuery(MakeSectorSettings(false, false));
+	}
+
+	SUBCASE("spawn move query with dense sectors")
+	{
+		CheckSpawnMoveQuery(MakeSectorSettings(true, false));
+		CheckSpawnMoveQuery(MakeSectorSettings(true, true));
+	}
+
+	SUBCASE("move batch")
+	{
+		CheckMoveBatch(MakeSectorSettings(false, false));
+		CheckMoveBatch(MakeSectorSettings(true, false));
+
+		//  Ϳ Create  Ʈ   
+		CheckMoveBatch(MakeSectorSettings(false, false), true);
+	}
+
+	SUBCASE("query batch")
+	{
+		CheckQueryBatch(MakeSectorSettings(true, false), 1, nullptr);
+		CheckQueryBatch(MakeSectorSettings(true, false), 4, RunWithThreads);
+		CheckQueryBatch(MakeSectorSettings(false, false), 3, RunWithThreads);
+	}
+
+	SUBCASE("object straddling sectors is reported once")
+	{
+		b2SectorGrid grid(MakeSectorSettings(true, false));
+
+		//    谡  ̴
+		int id = 7;
+		SpawnBox(grid, 10.0f, 10.0f, b2Vec2(0.0f, 0.0f), &id);
+
+		std::vector<int> lst;
+		CHECK(grid.QueryCircle(b2Vec2(0.0f, 0.0f), 5.0f, b2Filter(), lst) == 1);
+
+		b2AABB aabb;
+		aabb.lowerBound.Set(-20.0f, -20.0f);
+		aabb.upperBound.Set(20.0f, 20.0f);
+
+		lst.clear();
+		CHECK(grid.Query(aabb, lst) == 1);
+		CHECK(lst[0] == 7);
+	}
+
+	SUBCASE("despawned handles are stale")
+	{
+		b2SectorGrid grid(MakeSectorSettings(true, false));
+
+		int ids[3] = { 1, 2, 3 };
+		auto first = SpawnBox(grid, 5.0f, 5.0f, b2Vec2(0.0f, 0.0f), &ids[0]);
+		CHECK(b2SectorGrid::IsValid(first));
+		CHECK(grid.IsAlive(first));
+
+		grid.Despawn(first);
+		CHECK_FALSE(grid.IsAlive(first));
+
+		//   밡 ٸ
+		auto second = SpawnBox(grid, 5.0f, 5.0f, b2Vec2(300.0f, 0.0f), &ids[1]);
+		CHECK(b2GetObjectIndex(second) == b2GetObjectIndex(first));
+		CHECK(b2GetObjectGeneration(second) != b2GetObjectGeneration(first));
+		CHECK(second != first);
+
+		//  ڵδ  Ʈ ̰ų  Ѵ
+		grid.Move(first, b2Vec2(-300.0f, 0.0f), b2Rot(0.0f));
+		grid.Despawn(first);
+		CHECK(grid.IsAlive(second));
+
+		std::vector<int> lst;
+		CHECK(grid.QueryCircle(b2Vec2(300.0f, 0.0f), 1.0f, b2Filter(), lst) == 1);
+		CHECK(lst[0] == 2);
+
+		auto third = SpawnBox(grid, 5.0f, 5.0f, b2Vec2(0.0f, 300.0f), &ids[2]);
+		CHECK(b2GetObjectIndex(third) != b2GetObjectIndex(second));
+
+		//   Spawn ߸ ڵ
+		auto box = new b2PolygonShape();
+		box->SetAsBox(1.0f, 1.0f);
+		b2Transform xf(b2Vec2(5000.0f, 0.0f), b2Rot(0.0f));
+		auto res = grid.Spawn(box, b2Filter(), xf, &ids[0]);
+		CHECK_FALSE(b2Result::Succeeded(res));
+		CHECK_FALSE(b2SectorGrid::IsValid(res.first));
+		delete box;
+	}
+
+	SUBCASE("pooled shapes spawned by value")
+	{
+		for (int snapshots = 0; snapshots < 2; ++snapshots)
+		{
+			b2SectorSettings settings = MakeSectorSettings(true, false);
+			settings.useSectorSnapshots = snapshots != 0;
+
+			b2SectorGrid grid(settings);
+
+			//  shape ϹǷ ȣ ʿ   
+			b2CircleShape bullet;
+			bullet.m_radius = 1.0f;
+
+			b2PolygonShape box;
+			box.SetAsBox(5.0f, 5.0f);
+
+			int ids[2] = { 1, 2 };
+			auto wall = grid.Spawn(box, b2Filter(), b2Transform(b2Vec2(0.0f, 0.0f), b2Rot(0.0f)), &ids[0]);
+			REQUIRE(b2Result::Succeeded(wall));
+
+			// źȯ , ϱ⸦ ݺ
+			for (int i = 0; i < 1000; ++i)
+			{
+				b2Transform xf(b2Vec2(-300.0f + 0.6f * i, 50.0f), b2Rot(0.0f));
+				auto res = grid.Spawn(bullet, b2Filter(), xf, &ids[1]);
+				REQUIRE(b2Result::Succeeded(res));
+
+				if (i % 10 == 0 && snapshots)
+				{
+					grid.PublishSnapshots();
+				}
+
+				grid.Despawn(res.first);
+			}
+
+			if (snapshots)
+			{
+				grid.PublishSnapshots();
+			}
+
+			std::vector<int> lst;
+			CHECK(grid.QueryCircle(b2Vec2(0.0f, 50.0f), 100.0f, b2Filter(), lst) == 1);
+			CHECK(lst[0] == 1);
+
+			//  ̸ Ǯ  ʰ 
+			auto res = grid.Spawn(bullet, b2Filter(), b2Transform(b2Vec2(5000.0f, 0.0f), b2Rot(0.0f)), &ids[1]);
+			CHECK(res.second == b2Result::Fail_Invalid_Object_Position);
+		}
+	}
+
+	SUBCASE("shape templates are shared by objects")
+	{
+		b2SectorGrid grid(MakeSectorSettings(true, false));
+
+		b2PolygonShape hitBox;
+		hitBox.SetAsBox(4.0f, 1.0f, b2Vec2(2.0f, 0.0f), 0.0f);
+		auto boxTemplate = grid.RegisterShapeTemplate(hitBox);
+
+		b2CircleShape footprint;
+		footprint.m_radius = 3.0f;
+		auto circleTemplate = grid.RegisterShapeTemplate(footprint);
+
+		CHECK(boxTemplate != circleTemplate);
+		REQUIRE(grid.GetShapeTemplate(boxTemplate));
+		CHECK(grid.GetShapeTemplate(boxTemplate)->radius == doctest::Approx(b2Vec2(6.0f + b2_polygonRadius, 1.0f + b2_polygonRadius).Length()));
+		CHECK(grid.GetShapeTemplate(7) == nullptr);
+
+		int ids[2] = { 1, 2 };
+		auto box = grid.Spawn(boxTemplate, b2Filter(), b2Transform(b2Vec2(100.0f, 0.0f), b2Rot(0.3f)), &ids[0]);
+		auto circle = grid.Spawn(circleTemplate, b2Filter(), b2Transform(b2Vec2(-100.0f, 0.0f), b2Rot(0.0f)), &ids[1]);
+		REQUIRE(b2Result::Succeeded(box));
+		REQUIRE(b2Result::Succeeded(circle));
+
+		auto res = grid.Spawn(5, b2Filter(), b2Transform(b2Vec2(0.0f, 0.0f), b2Rot(0.0f)), &ids[0]);
+		CHECK(res.second == b2Result::Fail_Invalid_Shape_Template);
+
+		// ĳ  AABB  AABB  AABB   
+		const b2SectorShapeTemplate* shared = grid.GetShapeTemplate(boxTemplate);
+		for (int i = 0; i < 16; ++i)
+		{
+			b2Transform xf(b2Vec2(1.0f, 2.0f), b2Rot(0.4f * i));
+
+			b2AABB exact, cached;
+			hitBox.ComputeAABB(&exact, xf, 0);
+			shared->ComputeAABB(&cached, xf);
+			CHECK(cached.Contains(exact));
+
+			footprint.ComputeAABB(&exact, xf, 0);
+			grid.GetShapeTemplate(circleTemplate)->ComputeAABB(&cached, xf);
+			CHECK(cached.lowerBound.x == doctest::Approx(exact.lowerBound.x));
+			CHECK(cached.upperBound.y == doctest::Approx(exact.upperBound.y));
+		}
+
+		// ȸ   ã´
+		b2Rot q(0.3f);
+		b2Vec2 tip = b2Vec2(100.0f, 0.0f) + b2Mul(q, b2Vec2(5.5f, 0.0f));
+
+		std::vector<int> lst;
+		CHECK(grid.QueryCircle(tip, 0.2f, b2Filter(), lst) == 1);
+		CHECK(lst[0] == 1);
+
+		// ̵ص ø shape ״ 
+		grid.Move(box.first, b2Vec2(250.0f, 100.0f), b2Rot(1.2f));
+		lst.clear();
+		CHECK(grid.QueryCircle(b2Vec2(250.0f, 100.0f) + b2Mul(b2Rot(1.2f), b2Vec2(5.5f, 0.0f)), 0.2f, b2Filter(), lst) == 1);
+		lst.clear();
+		CHECK(grid.QueryCircle(tip, 0.2f, b2Filter(), lst) == 0);
+
+		grid.Despawn(box.first);
+		grid.Despawn(circle.first);
+
+		// ø Ʈ   ´
+		auto again = grid.Spawn(boxTemplate, b2Filter(), b2Transform(b2Vec2(0.0f, 0.0f), b2Rot(0.0f)), &ids[0]);
+		CHECK(b2Result::Succeeded(again));
+	}
+
+	SUBCASE("small steps across sector boundaries")
+	{
+		b2SectorGrid grid(MakeSectorSettings(true, false));
+
+		int id = 1;
+		b2Vec2 p(-250.0f, -250.0f);
+		auto oid = SpawnBox(grid, 10.0f, 10.0f, p, &id);
+
+		b2AABB all;
+		all.lowerBound.Set(-1000.0f, -1000.0f);
+		all.upperBound.Set(1000.0f, 1000.0f);
+
+		//  ܿ 7 밢 ̵ϸ     ٲ
+		for (int i = 0; i < 80; ++i)
+		{
+			b2Vec2 prev = p;
+			p += b2Vec2(7.0f, 7.0f);
+			grid.Move(oid, p, b2Rot(0.0f));
+
+			std::vector<int> lst;
+			CHECK(grid.QueryCircle(p + b2Vec2(9.0f, -9.0f), 0.5f, b2Filter(), lst) == 1);
+
+			lst.clear();
+			CHECK(grid.QueryCircle(prev - b2Vec2(9.0f, 9.0f), 0.5f, b2Filter(), lst) == 0);
+
+			lst.clear();
+			CHECK(grid.Query(all, lst) == 1);
+		}
+	}
+
+	SUBCASE("moving proxies predict displacement")
+	{
+		for (int batch = 0; batch < 2; ++batch)
+		{
+			b2SectorSettings settings = MakeSectorSettings(true, false);
+			settings.proxyExtension = 2.0f;
+
+			b2SectorGrid grid(settings);
+
+			int id = 1;
+			b2Vec2 p(-280.0f, -250.0f);
+			auto oid = SpawnBox(grid, 2.0f, 2.0f, p, &id);
+
+			b2SectorGridStats stats;
+			grid.GetStats(stats, true);
+
+			//   ȿ ƽ  ӵ ̵
+			const int moveCount = 50;
+			for (int i = 0; i < moveCount; ++i)
+			{
+				p += b2Vec2(1.0f, 0.0f);
+
+				if (batch)
+				{
+					b2SectorMove move{ oid, p, b2Rot(0.0f) };
+					grid.MoveBatch(&move, 1);
+				}
+				else
+				{
+					grid.Move(oid, p, b2Rot(0.0f));
+				}
+			}
+
+			grid.GetStats(stats, true);
+			REQUIRE(stats.sectors.size() == 1);
+			CHECK(stats.moveCount == moveCount);
+			CHECK(stats.sectors[0].moveCount == moveCount);
+
+			// ̵  ø fat AABB ȿ ̴  ٽ  ʴ´
+			CHECK(stats.sectors[0].GetReinsertRate() < 0.3f);
+
+			grid.GetStats(stats);
+			CHECK(stats.moveCount == 0);
+		}
+	}
+
+	SUBCASE("stats find hot sectors")
+	{
+		b2SectorGrid grid(MakeSectorSettings(true, false));
+
+		// (250, 250) Ϳ    Ʈ  
+		const int crowdCount = 40;
+		std::vector<int> ids(crowdCount + 4);
+
+		for (int i = 0; i < crowdCount; ++i)
+		{
+			ids[i] = i;
+			SpawnBox(grid, 1.0f, 1.0f, b2Vec2(210.0f + 2.0f * i, 250.0f), &ids[i]);
+		}
+
+		const b2Vec2 scattered[4] = { b2Vec2(-750.0f, -750.0f), b2Vec2(-750.0f, 750.0f), b2Vec2(750.0f, -750.0f), b2Vec2(650.0f, 650.0f) };
+		for (int i = 0; i < 4; ++i)
+		{
+			ids[crowdCount + i] = crowdCount + i;
+			SpawnBox(grid, 1.0f, 1.0f, scattered[i], &ids[crowdCount + i]);
+		}
+
+		b2SectorGridStats stats;
+		grid.GetStats(stats, true);
+
+		std::vector<int> lst;
+		CHECK(grid.QueryCircle(b2Vec2(250.0f, 250.0f), 5.0f, b2Filter(), lst) == 7);
+
+		grid.GetStats(stats);
+		CHECK(stats.residentSectorCount == 5);
+		CHECK(stats.proxyCount == crowdCount + 4);
+		CHECK(stats.queryCount == 1);
+		CHECK(stats.hitCount == 7);
+		CHECK(stats.candidateCount >= stats.hitCount);
+		CHECK(stats.GetHitRate() <= 1.0f);
+
+		int proxySectors = 0;
+		int heightSectors = 0;
+		for (int i = 0; i < b2SectorGridStats::HistogramSize; ++i)
+		{
+			proxySectors += stats.proxyHistogram[i];
+			heightSectors += stats.treeHeightHistogram[i];
+		}
+
+		CHECK(proxySectors == stats.residentSectorCount);
+		CHECK(heightSectors == stats.residentSectorCount);
+		CHECK(stats.proxyHistogram[1] == 4);   // Ͻ 1
+		CHECK(stats.proxyHistogram[6] == 1);   // Ͻ 32 ~ 63
+
+		b2SectorHeatmap heatmap;
+		stats.GetHeatmap(0, b2SectorHeatValue::ProxyCount, heatmap);
+		REQUIRE(heatmap.width == grid.GetSectorCountX());
+		REQUIRE(heatmap.height == grid.GetSectorCountY());
+		CHECK(heatmap.maxValue == static_cast<float>(crowdCount));
+
+		int hotX = static_cast<int>((250.0f - heatmap.bounds.lowerBound.x) / heatmap.sectorSize);
+		int hotY = static_cast<int>((250.0f - heatmap.bounds.lowerBound.y) / heatmap.sectorSize);
+		CHECK(heatmap.GetValue(hotX, hotY) == heatmap.maxValue);
+
+		stats.GetHeatmap(0, b2SectorHeatValue::CandidateCount, heatmap);
+		CHECK(heatmap.GetValue(hotX, hotY) == static_cast<float>(stats.candidateCount));
+
+		std::string csv;
+		heatmap.WriteCsv(csv);
+		CHECK(std::count(csv.begin(), csv.end(), '\n') == heatmap.height);
+		CHECK(std::count(csv.begin(), csv.end(), ',') == (heatmap.width - 1) * heatmap.height);
+
+		// ī͸   GetStats 0 
+		grid.GetStats(stats, true);
+		grid.GetStats(stats);
+		CHECK(stats.queryCount == 0);
+		CHECK(stats.sectors[0].queryCount == 0);
+		CHECK(stats.proxyCount == crowdCount + 4);
+	}
+
+	SUBCASE("sweep query reports hits by time of impact")
+	{
+		b2SectorGrid grid(MakeSectorSettings(true, false));
+
+		// Ѿ˺  .   ο  ִ
+		int ids[5] = { 1, 2, 3, 4, 5 };
+		SpawnBox(grid, 0.5f, 20.0f, b2Vec2(200.0f, 0.0f), &ids[0]);
+		SpawnBox(grid, 0.5f, 20.0f, b2Vec2(-100.0f, 0.0f), &ids[1]);
+		SpawnBox(grid, 0.5f, 20.0f, b2Vec2(50.0f, 0.0f), &ids[2]);
+		SpawnBox(grid, 0.5f, 20.0f, b2Vec2(0.0f, 100.0f), &ids[3]);
+
+		//  ġ ̹ ģ Ʈ
+		SpawnBox(grid, 5.0f, 5.0f, b2Vec2(-300.0f, 0.0f), &ids[4]);
+
+		b2CircleShape bullet;
+		bullet.m_radius = 1.0f;
+
+		b2Transform xfStart(b2Vec2(-300.0f, 0.0f), b2Rot(0.0f));
+		b2Transform xfEnd(b2Vec2(300.0f, 0.0f), b2Rot(0.0f));
+
+		std::vector<b2SectorSweepHit<int>> hits;
+		REQUIRE(grid.QuerySweep(&bullet, b2Filter(), xfStart, xfEnd, hits) == 4);
+
+		CHECK(hits[0].id == 5);
+		CHECK(hits[0].toi == 0.0f);
+		CHECK(hits[1].id == 2);
+		CHECK(hits[2].id == 3);
+		CHECK(hits[3].id == 1);
+
+		//  ո鿡  
+		CHECK(hits[1].toi == doctest::Approx((-101.5f + 300.0f) / 600.0f).epsilon(0.001));
+		CHECK(hits[3].toi == doctest::Approx((198.5f + 300.0f) / 600.0f).epsilon(0.001));
+
+		//     ħ ˻ϸ ó  ġ  ã Ѵ
+		std::vector<int> lst;
+		CHECK(grid.QueryCircle(xfEnd.p, 1.0f, b2Filter(), lst) == 0);
+
+		// ͸
+		b2Filter filter;
+		filter.maskBits = 0;
+
+		hits.clear();
+		CHECK(grid.QuerySweep(&bullet, filter, xfStart, xfEnd, hits) == 0);
+
+		//  (y 80 ~ 120)  ƽƽϰ ġ  浹 ƴϴ
+		hits.clear();
+		CHECK(grid.QuerySweep(&bullet, b2Filter(), 
+			b2Transform(b2Vec2(-50.0f, 121.05f), b2Rot(0.0f)), b2Transform(b2Vec2(50.0f, 121.05f), b2Rot(0.0f)), hits) == 0);
+
+		// 鼭  뵵 밢 ( 2.01) ָ 浹 ƴϴ
+		b2PolygonShape bar;
+		bar.SetAsBox(2.0f, 0.2f);
+
+		hits.clear();
+		CHECK(grid.QuerySweep(&bar, b2Filter(), 
+			b2Transform(b2Vec2(-50.0f, 122.1f), b2Rot(0.0f)), b2Transform(b2Vec2(50.0f, 122.1f), b2Rot(10.0f)), hits) == 0);
+
+		//    ´
+		hits.clear();
+		CHECK(grid.QuerySweep(&bar, b2Filter(), 
+			b2Transform(b2Vec2(-50.0f, 121.0f), b2Rot(0.0f)), b2Transform(b2Vec2(50.0f, 121.0f), b2Rot(10.0f)), hits) == 1);
+	}
+
+	SUBCASE("ray cast visits sectors along the ray")
+	{
+		for (int dense = 0; dense < 2; ++dense)
+		{
+			b2SectorSettings settings = MakeSectorSettings(dense != 0, false);
+			settings.levelCount = 2;
+
+			b2SectorGrid grid(settings);
+
+			//  迡 ģ , ū   , ο  
+			int ids[4] = { 1, 2, 3, 4 };
+			SpawnBox(grid, 10.0f, 10.0f, b2Vec2(0.0f, 0.0f), &ids[0]);
+			SpawnBox(grid, 2.0f, 150.0f, b2Vec2(300.0f, 0.0f), &ids[1]);
+			SpawnBox(grid, 10.0f, 10.0f, b2Vec2(-300.0f, 0.0f), &ids[2]);
+			SpawnBox(grid, 10.0f, 10.0f, b2Vec2(0.0f, 200.0f), &ids[3]);
+
+			b2SectorRayCastHit hit;
+			REQUIRE(grid.RayCastClosest(b2Vec2(-500.0f, 0.0f), b2Vec2(500.0f, 0.0f), b2Filter(), hit));
+			CHECK(hit.object->GetUserData<int>() == 3);
+			CHECK(hit.point.x == doctest::Approx(-310.0f));
+			CHECK(hit.normal.x == doctest::Approx(-1.0f));
+			CHECK(hit.fraction == doctest::Approx(190.0f / 1000.0f));
+
+			// ݴ  ū   
+			REQUIRE(grid.RayCastClosest(b2Vec2(500.0f, 0.0f), b2Vec2(-500.0f, 0.0f), b2Filter(), hit));
+			CHECK(hit.object->GetUserData<int>() == 2);
+
+			// ڸ     ȣȴ
+			std::vector<int> lst;
+			grid.RayCast(b2Vec2(-500.0f, 0.0f), b2Vec2(500.0f, 0.0f), b2Filter(), 
+				[&lst](b2SectorObject* object, const b2Vec2&, const b2Vec2&, float) {
+					lst.push_back(object->GetUserData<int>());
+					return 1.0f;
+				});
+
+			std::sort(lst.begin(), lst.end());
+			CHECK(lst == std::vector<int>{ 1, 2, 3 });
+
+			// callback ȿ ٽ RayCast ҷ ٱ   ״δ
+			lst.clear();
+			int innerCount = 0;
+			grid.RayCast(b2Vec2(-500.0f, 0.0f), b2Vec2(500.0f, 0.0f), b2Filter(),
+				[&](b2SectorObject* object, const b2Vec2&, const b2Vec2&, float) {
+					lst.push_back(object->GetUserData<int>());
+					grid.RayCast(b2Vec2(-500.0f, 0.0f), b2Vec2(500.0f, 0.0f), b2Filter(),
+						[&innerCount](b2SectorObject*, const b2Vec2&, const b2Vec2&, float) {
+							++innerCount;
+							return 1.0f;
+						});
+					return 1.0f;
+				});
+
+			std::sort(lst.begin(), lst.end());
+			CHECK(lst == std::vector<int>{ 1, 2, 3 });
+			CHECK(innerCount == 9);
+
+			// 0 ϸ ߴ
+			int callCount = 0;
+			grid.RayCast(b2Vec2(-500.0f, 0.0f), b2Vec2(500.0f, 0.0f), b2Filter(),
+				[&callCount](b2SectorObject*, const b2Vec2&, const b2Vec2&, float) {
+					++callCount;
+					return 0.0f;
+				});
+			CHECK(callCount == 1);
+
+			// ͸  
+			b2Filter filter;
+			filter.maskBits = 0;
+			CHECK_FALSE(grid.RayCastClosest(b2Vec2(-500.0f, 0.0f), b2Vec2(500.0f, 0.0f), filter, hit));
+			CHECK_FALSE(grid.RayCastClosest(b2Vec2(-500.0f, 100.0f), b2Vec2(-350.0f, 100.0f), b2Filter(), hit));
+
+			// 밢  ۿ  
+			REQUIRE(grid.RayCastClosest(b2Vec2(-2000.0f, 2200.0f), b2Vec2(200.0f, 0.0f), b2Filter(), hit));
+			CHECK(hit.object->GetUserData<int>() == 4);
+		}
+	}
+
+	SUBCASE("ray cast matches brute force")
+	{
+		b2SectorGrid grid(MakeSectorSettings(true, false));
+
+		uint32 seed = 12345;
+		auto random = [&seed](float lo, float hi) {
+			seed = seed * 1664525u + 1013904223u;
+			return lo + (hi - lo) * static_cast<float>(seed >> 8) / static_cast<float>(1u << 24);
+		};
+
+		std::vector<int> ids(300);
+		for (int i = 0; i < static_cast<int>(ids.size()); ++i)
+		{
+			ids[i] = i;
+			SpawnBox(grid, random(1.0f, 30.0f), random(1.0f, 30.0f), b2Vec2(random(-900.0f, 900.0f), random(-900.0f, 900.0f)), &ids[i]);
+		}
+
+		b2SectorQueryScratch scratch;
+		b2PolygonShape all;
+		all.SetAsBox(1000.0f, 1000.0f);
+		grid.QueryObjects(b2SectorCollider(&all, b2Filter(), b2Transform(b2Vec2_zero, b2Rot(0.0f))), scratch);
+		REQUIRE(scratch.objects.size() == ids.size());
+
+		for (int i = 0; i < 200; ++i)
+		{
+			b2RayCastInput input;
+			input.p1.Set(random(-1000.0f, 1000.0f), random(-1000.0f, 1000.0f));
+			input.p2.Set(random(-1000.0f, 1000.0f), random(-1000.0f, 1000.0f));
+			input.maxFraction = 1.0f;
+
+			float closest = 1.0f;
+			bool expected = false;
+			for (auto obj : scratch.objects)
+			{
+				b2RayCastOutput output;
+				if (obj->GetShape()->RayCast(&output, input, obj->GetTransform(), 0) && output.fraction <= closest)
+				{
+					closest = output.fraction;
+					expected = true;
+				}
+			}
+
+			b2SectorRayCastHit hit;
+			bool found = grid.RayCastClosest(input.p1, input.p2, b2Filter(), hit);
+
+			REQUIRE(found == expected);
+			if (found)
+			{
+				CHECK(hit.fraction == doctest::Approx(closest));
+			}
+		}
+	}
+
+	SUBCASE("nearest queries expand ring by ring")
+	{
+		for (int dense = 0; dense < 2; ++dense)
+		{
+			b2SectorSettings settings = MakeSectorSettings(dense != 0, false);
+			settings.levelCount = 2;
+
+			b2SectorGrid grid(settings);
+
+			uint32 seed = 777;
+			auto random = [&seed](float lo, float hi) {
+				seed = seed * 1664525u + 1013904223u;
+				return lo + (hi - lo) * static_cast<float>(seed >> 8) / static_cast<float>(1u << 24);
+			};
+
+			//  ڵ ū     
+			std::vector<int> ids(200);
+			std::vector<b2ObjectId> oids;
+			for (int i = 0; i < static_cast<int>(ids.size()); ++i)
+			{
+				ids[i] = i;
+				float h = i % 20 == 0 ? random(60.0f, 90.0f) : random(1.0f, 20.0f);
+				oids.push_back(SpawnBox(grid, h, random(1.0f, 20.0f), b2Vec2(random(-900.0f, 900.0f), random(-900.0f, 900.0f)), &ids[i]));
+			}
+
+			b2SectorQueryScratch scratch;
+			b2PolygonShape all;
+			all.SetAsBox(1000.0f, 1000.0f);
+			grid.QueryObjects(b2SectorCollider(&all, b2Filter(), b2Transform(b2Vec2_zero, b2Rot(0.0f))), scratch);
+			std::vector<b2SectorObject*> objects = scratch.objects;
+			REQUIRE(objects.size() == ids.size());
+
+			//  Ʈ Ÿ  
+			auto bruteForce = [&objects](const b2Shape* shape, const b2Transform& xf, const b2SectorObject* exclude) {
+				std::vector<float> distances;
+				for (auto obj : objects)
+				{
+					if (obj == exclude)
+					{
+						continue;
+					}
+
+					b2DistanceInput input;
+					input.proxyA.Set(shape, 0);
+					input.proxyB.Set(obj->GetShape(), 0);
+					input.transformA = xf;
+					input.transformB = obj->GetTransform();
+					input.useRadii = true;
+
+					b2SimplexCache cache;
+					cache.count = 0;
+					b2DistanceOutput output;
+					b2Distance(&output, &cache, &input);
+					distances.push_back(output.distance);
+				}
+
+				std::sort(distances.begin(), distances.end());
+				return distances;
+			};
+
+			for (int i = 0; i < 50; ++i)
+			{
+				b2CircleShape point;
+				point.m_radius = 0.0f;
+				point.m_p.Set(random(-1100.0f, 1100.0f), random(-1100.0f, 1100.0f));
+
+				b2Transform identity;
+				identity.SetIdentity();
+				auto expected = bruteForce(&point, identity, nullptr);
+
+				std::vector<b2SectorNearest<int>> nearest;
+				REQUIRE(grid.KNearest(point.m_p, 5, b2Filter(), nearest) == 5);
+				for (int j = 0; j < 5; ++j)
+				{
+					CHECK(nearest[j].distance == doctest::Approx(expected[j]));
+				}
+
+				nearest.clear();
+				int count = static_cast<int>(std::upper_bound(expected.begin(), expected.end(), 150.0f) - expected.begin());
+				REQUIRE(grid.QueryRadiusSorted(point.m_p, 150.0f, b2Filter(), nearest) == count);
+				for (int j = 0; j < count; ++j)
+				{
+					CHECK(nearest[j].distance == doctest::Approx(expected[j]));
+				}
+			}
+
+			// Ʈ  ڽ Ѵ
+			for (int i = 0; i < 20; ++i)
+			{
+				const b2SectorObject* self = nullptr;
+				for (auto obj : objects)
+				{
+					if (obj->GetObjectId() == oids[i * 7])
+					{
+						self = obj;
+					}
+				}
+				REQUIRE(self);
+
+				auto expected = bruteForce(self->GetShape(), self->GetTransform(), self);
+
+				std::vector<b2SectorNearest<int>> nearest;
+				REQUIRE(grid.KNearest(oids[i * 7], 3, b2Filter(), nearest) == 3);
+				for (int j = 0; j < 3; ++j)
+				{
+					CHECK(nearest[j].id != i * 7);
+					CHECK(nearest[j].distance == doctest::Approx(expected[j]));
+				}
+			}
+
+			// ͸  Ʈ
+			b2Filter filter;
+			filter.maskBits = 0;
+
+			std::vector<b2SectorNearest<int>> nearest;
+			CHECK(grid.KNearest(b2Vec2_zero, 5, filter, nearest) == 0);
+			CHECK(grid.KNearest(b2_nullObjectId, 5, b2Filter(), nearest) == 0);
+
+			// ã  ų  
+			CHECK(grid.KNearest(b2Vec2_zero, 0, b2Filter(), nearest) == 0);
+			CHECK(grid.KNearest(oids[0], -1, b2Filter(), nearest) == 0);
+			CHECK(grid.QueryRadiusSorted(b2Vec2_zero, -1.0f, b2Filter(), nearest) == 0);
+			CHECK(grid.QueryRadiusSorted(oids[0], -1.0f, b2Filter(), nearest) == 0);
+			CHECK(nearest.empty());
+		}
+	}
+
+	SUBCASE("find all pairs reports each pair once")
+	{
+		for (int dense = 0; dense < 2; ++dense)
+		{
+			b2SectorSettings settings = MakeSectorSettings(dense != 0, false);
+			settings.levelCount = 2;
+
+			b2SectorGrid grid(settings);
+
+			uint32 seed = 4242;
+			auto random = [&seed](float lo, float hi) {
+				seed = seed * 1664525u + 1013904223u;
+				return lo + (hi - lo) * static_cast<float>(seed >> 8) / static_cast<float>(1u << 24);
+			};
+
+			// źȯ(īװ 2) (īװ 4). Ϻδ ū  
+			std::vector<int> ids(400);
+			for (int i = 0; i < static_cast<int>(ids.size()); ++i)
+			{
+				ids[i] = i;
+
+				b2Filter filter;
+				filter.categoryBits = i % 3 == 0 ? 0x0002 : 0x0004;
+
+				auto box = new b2PolygonShape();
+				float h = i % 25 == 0 ? random(55.0f, 90.0f) : random(2.0f, 30.0f);
+				box->SetAsBox(h, random(2.0f, 30.0f));
+
+				b2Transform xf(b2Vec2(random(-600.0f, 600.0f), random(-600.0f, 600.0f)), b2Rot(random(0.0f, b2_pi)));
+				REQUIRE(b2Result::Succeeded(grid.Spawn(box, filter, xf, &ids[i])));
+			}
+
+			b2SectorQueryScratch scratch;
+			b2PolygonShape all;
+			all.SetAsBox(1000.0f, 1000.0f);
+			grid.QueryObjects(b2SectorCollider(&all, b2Filter(), b2Transform(b2Vec2_zero, b2Rot(0.0f))), scratch);
+			std::vector<b2SectorObject*> objects = scratch.objects;
+			REQUIRE(objects.size() == ids.size());
+
+			b2Filter projectile;
+			projectile.categoryBits = 0xFFFF;
+			projectile.maskBits = 0x0002;
+
+			b2Filter unit;
+			unit.categoryBits = 0xFFFF;
+			unit.maskBits = 0x0004;
+
+			//    ˻
+			using Pair = std::pair<int, int>;
+			std::vector<Pair> expectedAll, expectedFiltered;
+			for (size_t i = 0; i < objects.size(); ++i)
+			{
+				for (size_t j = i + 1; j < objects.size(); ++j)
+				{
+					auto a = objects[i];
+					auto b = objects[j];
+					if (!b2TestOverlap(a->GetShape(), 0, b->GetShape(), 0, a->GetTransform(), b->GetTransform()))
+					{
+						continue;
+					}
+
+					int ia = a->GetUserData<int>();
+					int ib = b->GetUserData<int>();
+					expectedAll.emplace_back(ia, ib);
+
+					if (a->GetFilter().categoryBits == 0x0002 && b->GetFilter().categoryBits == 0x0004)
+					{
+						expectedFiltered.emplace_back(ia, ib);
+					}
+					else if (b->GetFilter().categoryBits == 0x0002 && a->GetFilter().categoryBits == 0x0004)
+					{
+						expectedFiltered.emplace_back(ib, ia);
+					}
+				}
+			}
+
+			std::sort(expectedAll.begin(), expectedAll.end());
+			std::sort(expectedFiltered.begin(), expectedFiltered.end());
+			REQUIRE(expectedFiltered.size() > 0);
+
+			std::vector<Pair> pairs;
+			grid.FindAllPairs(b2Filter(), b2Filter(), [&pairs](b2SectorObject* a, b2SectorObject* b) {
+				pairs.emplace_back(a->GetUserData<int>(), b->GetUserData<int>());
+				});
+
+			std::sort(pairs.begin(), pairs.end());
+			CHECK(pairs == expectedAll);
+
+			// Ŀ    
+			std::vector<Pair> serial;
+			grid.FindAllPairs(projectile, unit, [&serial](b2SectorObject* a, b2SectorObject* b) {
+				serial.emplace_back(a->GetUserData<int>(), b->GetUserData<int>());
+				});
+
+			b2SectorPairBatch batch;
+			std::vector<Pair> parallel;
+			grid.FindAllPairs(projectile, unit, 4, RunWithThreads, batch, [&parallel](b2SectorObject* a, b2SectorObject* b) {
+				parallel.emplace_back(a->GetUserData<int>(), b->GetUserData<int>());
+				});
+
+			CHECK(serial == parallel);
+
+			std::sort(serial.begin(), serial.end());
+			CHECK(serial == expectedFiltered);
+		}
+	}
+
+	SUBCASE("objects larger than a sector go to coarser levels")
+	{
+		for (int dense = 0; dense < 2; ++dense)
+		{
+			b2SectorSettings settings = MakeSectorSettings(dense != 0, false);
+			settings.levelCount = 3;
+
+			b2SectorGrid grid(settings);
+			CHECK(grid.GetLevelCount() == 3);
+			CHECK(grid.GetSectorSize(2) == 400.0f);
+
+			int ids[3] = { 1, 2, 3 };
+			SpawnBox(grid, 5.0f, 5.0f, b2Vec2(0.0f, 0.0f), &ids[0]);
+			auto wall = SpawnBox(grid, 180.0f, 10.0f, b2Vec2(0.0f, 300.0f), &ids[1]);
+			SpawnBox(grid, 120.0f, 120.0f, b2Vec2(-500.0f, -500.0f), &ids[2]);
+
+			//     ã´
+			std::vector<int> lst;
+			CHECK(grid.QueryCircle(b2Vec2(-175.0f, 300.0f), 3.0f, b2Filter(), lst) == 1);
+			lst.clear();
+			CHECK(grid.QueryCircle(b2Vec2(175.0f, 300.0f), 3.0f, b2Filter(), lst) == 1);
+			CHECK(lst[0] == 2);
+
+			// ȸص   ´
+			grid.Move(wall, b2Vec2(0.0f, 300.0f), b2Rot(0.5f * b2_pi));
+
+			lst.clear();
+			CHECK(grid.QueryCircle(b2Vec2(175.0f, 300.0f), 3.0f, b2Filter(), lst) == 0);
+			lst.clear();
+			CHECK(grid.QueryCircle(b2Vec2(0.0f, 475.0f), 3.0f, b2Filter(), lst) == 1);
+
+			// ͺ ū aabb   ˻
+			b2AABB aabb;
+			aabb.lowerBound.Set(-1000.0f, -1000.0f);
+			aabb.upperBound.Set(1000.0f, 1000.0f);
+
+			lst.clear();
+			CHECK(grid.Query(aabb, lst) == 3);
+		}
+
+		//  ϳ 4 ͺ а ġ Ʈ   
+		b2SectorGrid grid(MakeSectorSettings(true, false));
+
+		auto box = new b2PolygonShape();
+		box->SetAsBox(150.0f, 10.0f);
+
+		int id = 1;
+		b2Transform xf(b2Vec2(0.0f, 0.0f), b2Rot(0.0f));
+		auto res = grid.Spawn(box, b2Filter(), xf, &id);
+		CHECK(res.second == b2Result::Fail_Too_Large_Object);
+		delete box;
+	}
+
+	SUBCASE("idle sectors are evicted")
+	{
+		for (int mode = 0; mode < 3; ++mode)
+		{
+			b2SectorSettings settings = MakeSectorSettings(mode != 0, false);
+			settings.useSectorSnapshots = mode == 2;
+			settings.sectorEvictTicks = 2;
+			settings.sectorTreePoolSize = 2;
+
+			b2SectorGrid grid(settings);
+
+			int id = 1;
+			auto oid = SpawnBox(grid, 10.0f, 10.0f, b2Vec2(-550.0f, -550.0f), &id);
+
+			b2SectorGridStats stats;
+			grid.GetStats(stats);
+			CHECK(stats.residentSectorCount == 1);
+			CHECK(stats.sectorMemory > 0);
+
+			// Ʈ ִ ʹ ´
+			for (int i = 0; i < 3; ++i)
+			{
+				CHECK(grid.EvictSectors() == 0);
+			}
+
+			grid.Move(oid, b2Vec2(550.0f, 550.0f), b2Rot(0.0f));
+
+			CHECK(grid.EvictSectors() == 0);
+			CHECK(grid.EvictSectors() == 1);
+
+			grid.GetStats(stats);
+			CHECK(stats.residentSectorCount == 1);
+			CHECK(stats.evictedSectorCount == 1);
+
+			//      ȣ Ŀ Ʈ Ѵ
+			grid.EvictSectors();
+			grid.EvictSectors();
+
+			grid.GetStats(stats);
+			CHECK(stats.pooledTreeCount == 1);
+
+			//  ͷ ƿ͵ ã  ְ  Ʈ Ѵ
+			grid.Move(oid, b2Vec2(-550.0f, -550.0f), b2Rot(0.0f));
+			if (settings.useSectorSnapshots)
+			{
+				grid.PublishSnapshots();
+			}
+
+			std::vector<int> lst;
+			CHECK(grid.QueryCircle(b2Vec2(-550.0f, -550.0f), 5.0f, b2Filter(), lst) == 1);
+
+			grid.GetStats(stats);
+			CHECK(stats.pooledTreeCount == 0);
+		}
+	}
+
+	SUBCASE("sector snapshots")
+	{
+		b2SectorSettings settings = MakeSectorSettings(true, false);
+		settings.useSectorSnapshots = true;
+
+		b2SectorGrid grid(settings);
+
+		int ids[2] = { 1, 2 };
+		auto oid1 = SpawnBox(grid, 10.0f, 10.0f, b2Vec2(-300.0f, 0.0f), &ids[0]);
+		auto oid2 = SpawnBox(grid, 10.0f, 10.0f, b2Vec2(300.0f, 0.0f), &ids[1]);
+		grid.PublishSnapshots();
+
+		std::vector<int> lst;
+		CHECK(grid.QueryCircle(b2Vec2(-300.0f, 0.0f), 5.0f, b2Filter(), lst) == 1);
+
+		// Խ    ġ ã´
+		grid.Move(oid1, b2Vec2(-300.0f, 250.0f), b2Rot(0.0f));
+
+		lst.clear();
+		CHECK(grid.Query(b2AABB{ b2Vec2(-310.0f, -10.0f), b2Vec2(-290.0f, 10.0f) }, lst) == 1);
+
+		grid.PublishSnapshots();
+
+		lst.clear();
+		CHECK(grid.QueryCircle(b2Vec2(-300.0f, 0.0f), 5.0f, b2Filter(), lst) == 0);
+		lst.clear();
+		CHECK(grid.QueryCircle(b2Vec2(-300.0f, 250.0f), 5.0f, b2Filter(), lst) == 1);
+
+		// Despawn Ʈ  Խú  ʰ   Խ Ŀ 
+		grid.Despawn(oid2);
+		grid.PublishSnapshots();
+
+		lst.clear();
+		CHECK(grid.QueryCircle(b2Vec2(300.0f, 0.0f), 5.0f, b2Filter(), lst) == 0);
+
+		grid.PublishSnapshots();
+		grid.PublishSnapshots();
+	}
+
+	SUBCASE("frame phases read without locks")
+	{
+		// 0: sector map, 1: dense sectors, 2: dense sectors + , 3: sector map + wide ,
+		// 4: 3 + Ʈ ǰ 
+		for (int mode = 0; mode < 5; ++mode)
+		{
+			b2SectorSettings settings = MakeSectorSettings(mode == 1 || mode == 2, false);
+			settings.useFramePhases = true;
+			settings.useSectorSnapshots = mode == 2;
+			settings.useWideTrees = mode >= 3;
+			settings.treeOptimizeBudget = mode == 4 ? 64 : 0;
+
+			b2SectorGrid grid(settings);
+			CHECK(grid.GetPhase() == b2SectorPhase::Idle);
+
+			const int count = 64;
+			int ids[count];
+			b2ObjectId oids[count];
+
+			grid.BeginWrite();
+			CHECK(grid.GetPhase() == b2SectorPhase::Write);
+
+			for (int i = 0; i < count; ++i)
+			{
+				ids[i] = i + 1;
+				oids[i] = SpawnBox(grid, 8.0f, 8.0f, b2Vec2(-600.0f + 20.0f * i, 0.0f), &ids[i]);
+			}
+
+			grid.EndWrite();
+			CHECK(grid.GetPhase() == b2SectorPhase::Idle);
+
+			for (int tick = 0; tick < 3; ++tick)
+			{
+				grid.BeginWrite();
+
+				for (int i = 0; i < count; ++i)
+				{
+					grid.Move(oids[i], b2Vec2(-600.0f + 20.0f * i, 40.0f * (tick + 1)), b2Rot(0.0f));
+				}
+
+				grid.EndWrite();
+
+				grid.BeginRead();
+				CHECK(grid.GetPhase() == b2SectorPhase::Read);
+
+				//  尡   ÿ д´
+				std::atomic<int> mismatches(0);
+
+				RunWithThreads(4, [&](int worker) {
+					for (int i = worker; i < count; i += 4)
+					{
+						std::vector<int> lst;
+						grid.QueryCircle(b2Vec2(-600.0f + 20.0f * i, 40.0f * (tick + 1)), 2.0f, b2Filter(), lst);
+
+						if (lst.size() != 1 || lst[0] != ids[i])
+						{
+							++mismatches;
+						}
+					}
+				});
+
+				CHECK(mismatches.load() == 0);
+
+				std::vector<b2SectorNearest<int>> nearest;
+				grid.KNearest(oids[10], 2, b2Filter(), nearest);
+				REQUIRE(nearest.size() == 2);
+				CHECK(nearest[0].id == ids[9]);
+				CHECK(nearest[1].id == ids[11]);
+
+				grid.EndRead();
+				CHECK(grid.GetPhase() == b2SectorPhase::Idle);
+			}
+		}
+	}
+
+	SUBCASE("category masks prune filtered subtrees")
+	{
+		for (int snapshots = 0; snapshots < 2; ++snapshots)
+		{
+			b2SectorSettings settings = MakeSectorSettings(true, false);
+			settings.useSectorSnapshots = snapshots != 0;
+
+			b2SectorGrid grid(settings);
+
+			uint32 seed = 777;
+			auto random = [&seed](float lo, float hi) {
+				seed = seed * 1664525u + 1013904223u;
+				return lo + (hi - lo) * static_cast<float>(seed >> 8) / static_cast<float>(1u << 24);
+			};
+
+			//   īװ ϳ  0  Ϻδ  ׷쿡 Ѵ
+			const int count = 400;
+			std::vector<int> ids(count);
+			std::vector<b2Filter> filters(count);
+			std::vector<b2ObjectId> oids(count);
+
+			for (int i = 0; i < count; ++i)
+			{
+				ids[i] = i;
+				filters[i].categoryBits = static_cast<uint16>(1 << (i % 4));
+				filters[i].groupIndex = i % 12 == 0 ? 3 : 0;
+
+				b2PolygonShape box;
+				box.SetAsBox(random(1.0f, 10.0f), random(1.0f, 10.0f));
+
+				b2Transform xf(b2Vec2(random(-900.0f, 900.0f), random(-900.0f, 900.0f)), b2Rot(0.0f));
+				auto res = grid.Spawn(box, filters[i], xf, &ids[i]);
+				REQUIRE(b2Result::Succeeded(res));
+				oids[i] = res.first;
+			}
+
+			// ٽ 鼭 ȸ  īװ յ ¾ƾ Ѵ
+			for (int i = 0; i < count; i += 2)
+			{
+				grid.Move(oids[i], b2Vec2(random(-900.0f, 900.0f), random(-900.0f, 900.0f)), b2Rot(0.0f));
+			}
+
+			if (settings.useSectorSnapshots)
+			{
+				grid.PublishSnapshots();
+			}
+
+			auto shouldCollide = [](const b2Filter& a, const b2Filter& b) {
+				if (a.groupIndex == b.groupIndex && a.groupIndex != 0)
+				{
+					return a.groupIndex > 0;
+				}
+
+				return (a.maskBits & b.categoryBits) != 0 && (a.categoryBits & b.maskBits) != 0;
+			};
+
+			for (int q = 0; q < 100; ++q)
+			{
+				b2Filter filter;
+				filter.categoryBits = 0x0001;
+				filter.maskBits = static_cast<uint16>(q % 2 == 0 ? 0x0002 : 0x000C);
+				filter.groupIndex = q % 5 == 0 ? 3 : 0;
+
+				b2Vec2 center(random(-900.0f, 900.0f), random(-900.0f, 900.0f));
+
+				std::vector<int> all;
+				grid.QueryCircle(center, 150.0f, b2Filter(), all);
+
+				std::vector<int> expected;
+				for (int id : all)
+				{
+					if (shouldCollide(filter, filters[id]))
+					{
+						expected.push_back(id);
+					}
+				}
+
+				std::vector<int> actual;
+				grid.QueryCircle(center, 150.0f, filter, actual);
+
+				std::sort(expected.begin(), expected.end());
+				std::sort(actual.begin(), actual.end());
+				CHECK(actual == expected);
+
+				// ̵ ũ  ϴ Ʈ  ʴ´
+				b2SectorRayCastHit hit;
+				b2Vec2 p2 = center + b2Vec2(random(-300.0f, 300.0f), random(-300.0f, 300.0f));
+				if (grid.RayCastClosest(center, p2, filter, hit))
+				{
+					CHECK(shouldCollide(filter, hit.object->GetFilter()));
+				}
+			}
+		}
+	}
+
+	SUBCASE("save and load restores objects")
+	{
+		b2SectorSettings settings = MakeSectorSettings(false, false);
+		settings.levelCount = 2;
+		settings.treeOptimizeBudget = 256;
+
+		b2SectorGrid grid(settings);
+
+		uint32 seed = 2024;
+		auto random = [&seed](float lo, float hi) {
+			seed = seed * 1664525u + 1013904223u;
+			return lo + (hi - lo) * static_cast<float>(seed >> 8) / static_cast<float>(1u << 24);
+		};
+
+		b2CircleShape circle;
+		circle.m_radius = 5.0f;
+		auto circleTemplate = grid.RegisterShapeTemplate(circle);
+
+		const int count = 300;
+		std::vector<int> ids(count);
+		std::vector<b2ObjectId> oids(count);
+
+		// Ǯ shape, ø,  ѱ shape, ,    ū ڽ ´
+		for (int i = 0; i < count; ++i)
+		{
+			ids[i] = i;
+
+			b2Filter filter;
+			filter.categoryBits = static_cast<uint16>(1 << (i % 3));
+
+			b2Vec2 pos(random(-900.0f, 900.0f), random(-900.0f, 900.0f));
+			b2Transform xf(pos, b2Rot(random(-b2_pi, b2_pi)));
+			std::pair<b2ObjectId, b2Result::Code> res;
+
+			switch (i % 5)
+			{
+			case 0:
+			{
+				b2PolygonShape box;
+				box.SetAsBox(random(1.0f, 20.0f), random(1.0f, 20.0f));
+				res = grid.Spawn(box, filter, xf, &ids[i]);
+				break;
+			}
+			case 1:
+				res = grid.Spawn(circleTemplate, filter, xf, &ids[i]);
+				break;
+			case 2:
+			{
+				auto box = new b2PolygonShape();
+				box->SetAsBox(random(1.0f, 20.0f), random(1.0f, 20.0f));
+				res = grid.Spawn(box, filter, xf, &ids[i]);
+				break;
+			}
+			case 3:
+			{
+				b2EdgeShape edge;
+				edge.SetTwoSided(b2Vec2(-10.0f, 0.0f), b2Vec2(10.0f, 0.0f));
+				res = grid.Spawn(edge, filter, xf, &ids[i]);
+				break;
+			}
+			case 4:
+			{
+				b2PolygonShape box;
+				box.SetAsBox(60.0f, 40.0f);
+				res = grid.Spawn(box, filter, xf, &ids[i]);
+				break;
+			}
+			}
+
+			REQUIRE(b2Result::Succeeded(res));
+			oids[i] = res.first;
+		}
+
+		//  ԰ ö 뵵 Ǿ Ѵ
+		b2ObjectId lastDespawned = b2_nullObjectId;
+		for (int i = 0; i < count; i += 7)
+		{
+			grid.Despawn(oids[i]);
+			lastDespawned = oids[i];
+		}
+
+		for (int i = 1; i < count; i += 3)
+		{
+			grid.Move(oids[i], b2Vec2(random(-900.0f, 900.0f), random(-900.0f, 900.0f)), b2Rot(0.0f));
+		}
+
+		auto saver = [](const void* userData) { return static_cast<uint64_t>(*static_cast<const int*>(userData)); };
+		auto loader = [&ids](uint64_t key) -> void* { return key < ids.size() ? &ids[key] : nullptr; };
+
+		auto checkSame = [&](b2SectorGrid& loaded) {
+			for (int i = 0; i < count; ++i)
+			{
+				CHECK(loaded.IsAlive(oids[i]) == grid.IsAlive(oids[i]));
+			}
+
+			uint32 querySeed = 99;
+			for (int q = 0; q < 50; ++q)
+			{
+				querySeed = querySeed * 1664525u + 1013904223u;
+				b2Vec2 center(static_cast<float>(querySeed % 1800) - 900.0f, static_cast<float>((querySeed >> 12) % 1800) - 900.0f);
+
+				b2Filter filter;
+				filter.maskBits = q % 2 == 0 ? 0xFFFF : 0x0002;
+
+				std::vector<int> expected, actual;
+				grid.QueryCircle(center, 120.0f, filter, expected);
+				loaded.QueryCircle(center, 120.0f, filter, actual);
+				CHECK(actual == expected);
+			}
+
+			//  Spawn      
+			b2PolygonShape box;
+			box.SetAsBox(1.0f, 1.0f);
+			b2Transform xf(b2Vec2(0.0f, 0.0f), b2Rot(0.0f));
+			auto res = loaded.Spawn(box, b2Filter(), xf, &ids[0]);
+			CHECK(b2GetObjectIndex(res.first) == b2GetObjectIndex(lastDespawned));
+			CHECK(b2GetObjectGeneration(res.first) == b2GetObjectGeneration(lastDespawned) + 1);
+		};
+
+		for (int trees = 0; trees < 2; ++trees)
+		{
+			std::vector<uint8_t> data;
+			grid.Save(data, saver, trees != 0);
+
+			b2SectorSettings loadedSettings;
+			REQUIRE(b2SectorGrid::LoadSettings(data.data(), data.size(), loadedSettings) == b2Result::Success);
+			CHECK(loadedSettings.sectorSize == settings.sectorSize);
+			CHECK(loadedSettings.levelCount == settings.levelCount);
+			CHECK(loadedSettings.treeOptimizeBudget == settings.treeOptimizeBudget);
+
+			{
+				b2SectorGrid loaded(loadedSettings);
+				REQUIRE(loaded.Load(data.data(), data.size(), loader) == b2Result::Success);
+
+				// ٽ ϸ  Ͱ ´
+				std::vector<uint8_t> again;
+				loaded.Save(again, saver, trees != 0);
+				CHECK(again == data);
+
+				checkSame(loaded);
+
+				CHECK(loaded.Load(data.data(), data.size(), loader) == b2Result::Fail_Grid_Not_Empty);
+			}
+
+			//  ġ ٸ Ʈ  Ͻø  
+			{
+				b2SectorSettings other = loadedSettings;
+				other.sectorSize = 50.0f;
+				other.useDenseSectors = true;
+				other.levelCount = 3;
+
+				b2SectorGrid loaded(other);
+				REQUIRE(loaded.Load(data.data(), data.size(), loader) == b2Result::Success);
+				checkSame(loaded);
+			}
+
+			// ߸ų  
+			for (std::size_t size : { std::size_t(0), std::size_t(6), data.size() / 3, data.size() / 2, data.size() - 1 })
+			{
+				b2SectorGrid loaded(loadedSettings);
+				CHECK(loaded.Load(data.data(), size, loader) == b2Result::Fail_Invalid_Data);
+			}
+
+			std::vector<uint8_t> corrupt = data;
+			corrupt[0] ^= 0xFF;
+			CHECK(b2SectorGrid::LoadSettings(corrupt.data(), corrupt.size(), loadedSettings) == b2Result::Fail_Invalid_Data);
+		}
+	}
+}
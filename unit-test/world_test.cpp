@@ -71,3 +71,70 @@ DOCTEST_TEST_CASE("begin contact")
 	CHECK(world.GetContactList() != nullptr);
 	CHECK(begin_contact == true);
 }
+
+DOCTEST_TEST_CASE("create fixtures")
+{
+	b2World world = b2World(b2Vec2(0.0f, -10.0f));
+
+	// A static floor of many small boxes created in one batch.
+	const int32 count = 100;
+	b2PolygonShape boxes[count];
+	b2FixtureDef defs[count];
+	for (int32 i = 0; i < count; ++i)
+	{
+		boxes[i].SetAsBox(0.5f, 0.5f, b2Vec2(float(i) - 50.0f, 0.0f), 0.0f);
+		defs[i].shape = boxes + i;
+	}
+
+	b2BodyDef groundDef;
+	b2Body* ground = world.CreateBody(&groundDef);
+
+	b2Fixture* fixtures[count];
+	ground->CreateFixtures(defs, count, fixtures);
+
+	CHECK(ground->GetFixtureList() == fixtures[count - 1]);
+	CHECK(world.GetProxyCount() == count);
+
+	for (int32 i = 0; i < count; ++i)
+	{
+		b2AABB aabb = fixtures[i]->GetAABB(0);
+		CHECK(aabb.GetCenter().x == doctest::Approx(float(i) - 50.0f));
+	}
+
+	b2CircleShape circle;
+	circle.m_radius = 0.5f;
+
+	b2BodyDef ballDef;
+	ballDef.type = b2_dynamicBody;
+	ballDef.position.Set(0.3f, 2.0f);
+	b2Body* ball = world.CreateBody(&ballDef);
+	ball->CreateFixture(&circle, 1.0f);
+
+	for (int32 i = 0; i < 120; ++i)
+	{
+		world.Step(1.0f / 60.0f, 6, 2);
+	}
+
+	// The ball rests on the floor.
+	CHECK(world.GetContactCount() > 0);
+	CHECK(ball->GetPosition().y == doctest::Approx(1.0f).epsilon(0.02f));
+
+	// Re-enabling the ground creates the proxies in one batch as well.
+	ground->SetEnabled(false);
+	CHECK(world.GetProxyCount() == 1);
+	ground->SetEnabled(true);
+	CHECK(world.GetProxyCount() == count + 1);
+
+	// Static proxies have their own tree, so a type change moves them to the other one.
+	ground->SetType(b2_kinematicBody);
+	CHECK(world.GetProxyCount() == count + 1);
+	CHECK(world.GetContactCount() == 0);
+	world.Step(1.0f / 60.0f, 6, 2);
+	CHECK(world.GetContactCount() > 0);
+
+	ground->SetType(b2_staticBody);
+	CHECK(world.GetContactCount() == 0);
+	world.Step(1.0f / 60.0f, 6, 2);
+	CHECK(world.GetContactCount() > 0);
+	CHECK(ball->GetPosition().y == doctest::Approx(1.0f).epsilon(0.02f));
+}